@@ -0,0 +1,149 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdio.h>
+
+#include "argo.h"
+
+/*
+ * Definitions for the streaming modes of "argo".  These modes walk the
+ * input one token at a time instead of building a tree of ARGO_VALUEs
+ * with argo_read_value(), so the memory they use does not grow with the
+ * size of the input document.
+ */
+
+/*
+ * Additional option bits stored in global_options by validargs().
+ *   If --columns is specified, then the COLUMNS_OPTION bit is set and
+ *   "argo_columns" points at the comma-separated list of fields.
+ *   If -w is specified together with --columns, then the FIXED_WIDTH_OPTION
+ *   bit is set and the least-significant byte of global_options holds the
+ *   column width.
+ *   If --merge-patch is specified, then the MERGE_PATCH_OPTION bit is set and
+ *   "argo_patch_file" holds the name of the file containing the patch.
+ *   If --schema is specified, then the SCHEMA_OPTION bit is set and
+ *   "argo_schema_file" holds the name of the file containing the schema.
+ */
+#define COLUMNS_OPTION (0x08000000)
+#define FIXED_WIDTH_OPTION (0x04000000)
+#define MERGE_PATCH_OPTION (0x02000000)
+#define SCHEMA_OPTION (0x01000000)
+
+/*
+ * Comma-separated list of the fields selected by --columns.  Each field is
+ * a sequence of member names separated by periods ("a,b.c,d"), giving the
+ * path from the top of a record to the member to be extracted.
+ */
+char *argo_columns;
+
+/*
+ * Name of the file holding the RFC 7386 merge patch given with --merge-patch.
+ */
+char *argo_patch_file;
+
+/*
+ * Name of the file holding the JSON Schema given with --schema.
+ */
+char *argo_schema_file;
+
+/*
+ * Compression methods for argo_open_input() and argo_open_output().
+ * "argo_output_compression" is set by validargs() if --compress METHOD
+ * is given along with any of the other options, and is zero otherwise.
+ */
+#define ARGO_GZIP 1
+#define ARGO_ZSTD 2
+int argo_output_compression;
+
+/*
+ * Read the next character from an input stream, keeping argo_lines_read and
+ * argo_chars_read up to date.
+ */
+ARGO_CHAR argo_next_char(FILE *f);
+
+/*
+ * Push a character read by argo_next_char() back onto the input stream.
+ */
+void argo_unread_char(ARGO_CHAR c, FILE *f);
+
+/*
+ * Read the four hex digits of a \u escape and return the code point they
+ * represent, or -1 (after printing an error message) if they are malformed.
+ */
+ARGO_CHAR argo_read_hex(FILE *f);
+
+/*
+ * Skip over whitespace and return (without consuming) the next character
+ * on the input stream, or EOF.
+ */
+ARGO_CHAR argo_peek_char(FILE *f);
+
+/*
+ * Consume the next non-whitespace character, which must be c.  Returns zero
+ * on success; otherwise a one-line error message is printed and nonzero is
+ * returned.
+ */
+int argo_expect_char(FILE *f, ARGO_CHAR c);
+
+/*
+ * Read one of the tokens "true", "false" or "null" from the input stream.
+ * Returns zero on success, nonzero if there is any error.
+ */
+int argo_read_basic(ARGO_BASIC *b, FILE *f);
+
+/*
+ * Skip over one complete value on the input stream without building any
+ * ARGO_VALUEs.  The value is still checked for syntax errors.  If sink is
+ * not NULL, the compact text of the value is appended to it.
+ * Returns zero on success, nonzero if there is any error.
+ */
+int argo_skip_value(FILE *f, ARGO_STRING *sink);
+
+/*
+ * Read a top-level array of objects from the input stream, and write the
+ * fields selected by argo_columns to the output stream, one record per line.
+ * The output is CSV unless FIXED_WIDTH_OPTION is set.
+ * Returns zero on success, nonzero if there is any error.
+ */
+int argo_write_columns(FILE *in, FILE *out);
+
+/*
+ * Apply an RFC 7386 merge patch, already read into a tree of ARGO_VALUEs,
+ * to the document on the input stream and write the canonical result to
+ * the output stream.  The document itself is copied through token by token;
+ * only the patch is held in memory.
+ * Returns zero on success, nonzero if there is any error.
+ */
+int argo_merge_patch(FILE *in, ARGO_VALUE *patch, FILE *out);
+
+/*
+ * Check the document on the input stream against a JSON Schema, already
+ * read into a tree of ARGO_VALUEs.  The supported keywords are "type",
+ * "required", "properties", "items", "enum" (scalar values only),
+ * "minimum", "maximum" and "maxLength" (counting UTF-8 characters, not
+ * bytes); others are ignored.  The schema is
+ * compiled first and then applied while the document is parsed, in one
+ * pass.  Parsing stops at the first violation, which is reported with a
+ * JSON Pointer to the offending value.
+ * Returns zero if the document is valid, nonzero otherwise.
+ */
+int argo_validate_schema(FILE *in, ARGO_VALUE *schema);
+
+/*
+ * Return a stream from which the decompressed contents of "in" can be read.
+ * The start of the input is checked for the whole gzip or zstd magic number;
+ * uncompressed input is returned unchanged, or if it began with the first
+ * byte of one, through a stream that gives back the bytes read to check it.  Returns NULL (after printing an
+ * error message) if the input is compressed with a method for which support
+ * was not built in.
+ */
+FILE *argo_open_input(FILE *in);
+
+/*
+ * Return a stream whose output is compressed with the given method and
+ * written to "out", or "out" itself if method is zero.  The returned stream
+ * must be closed with fclose() to flush the end of the compressed data.
+ */
+FILE *argo_open_output(FILE *out, int method);
+
+#endif
@@ -1,9 +1,11 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <limits.h>
 
 #include "argo.h"
 #include "global.h"
 #include "debug.h"
+#include "stream.h"
 int argo_write_object();
 int argo_write_array();
 int argo_write_basic();
@@ -51,8 +53,46 @@ int argo_write_basic();
  * nonzero if there is any error.
  */
 int argo_read_string(ARGO_STRING *s, FILE *f) {
-    // TO BE IMPLEMENTED.
-    abort();
+    if (argo_expect_char(f, ARGO_QUOTE)) { return -1; }
+    while (1) {
+        ARGO_CHAR c = argo_next_char(f);
+        if (c == EOF) {
+            fprintf(stderr, "[%d] Premature EOF in string\n", argo_lines_read);
+            return -1;
+        }
+        if (c == ARGO_QUOTE) { return 0; }
+        if (argo_is_control(c)) {
+            fprintf(stderr, "[%d] Control character in string\n", argo_lines_read);
+            return -1;
+        }
+        if (c == ARGO_BSLASH) {
+            c = argo_next_char(f);
+            switch(c) {
+                case ARGO_QUOTE: case ARGO_BSLASH: case ARGO_FSLASH: break;
+                case ARGO_B: c = ARGO_BS; break;
+                case ARGO_F: c = ARGO_FF; break;
+                case ARGO_N: c = ARGO_LF; break;
+                case ARGO_R: c = ARGO_CR; break;
+                case ARGO_T: c = ARGO_HT; break;
+                case ARGO_U:
+                    if ((c = argo_read_hex(f)) < 0) { return -1; }
+                    if (c >= 0xd800 && c < 0xdc00) {           //high surrogate, the low half must follow
+                        ARGO_CHAR lo;
+                        if (argo_next_char(f) != ARGO_BSLASH || argo_next_char(f) != ARGO_U
+                            || (lo = argo_read_hex(f)) < 0xdc00 || lo >= 0xe000) {
+                            fprintf(stderr, "[%d] Unpaired surrogate in string\n", argo_lines_read);
+                            return -1;
+                        }
+                        c = 0x10000 + ((c - 0xd800) << 10) + (lo - 0xdc00);
+                    }
+                    break;
+                default:
+                    fprintf(stderr, "[%d] Bad escape sequence in string\n", argo_lines_read);
+                    return -1;
+            }
+        }
+        if (argo_append_char(s, c)) { return -1; }
+    }
 }
 
 /**
@@ -78,8 +118,79 @@ int argo_read_string(ARGO_STRING *s, FILE *f) {
  * nonzero if there is any error.
  */
 int argo_read_number(ARGO_NUMBER *n, FILE *f) {
-    // TO BE IMPLEMENTED.
-    abort();
+    ARGO_STRING *s = &n -> string_value;
+    ARGO_CHAR c = argo_next_char(f);
+    long num = 0;
+    int neg = 0, is_int = 1;
+    char *text;
+
+    if (c == ARGO_MINUS) {
+        neg = 1;
+        if (argo_append_char(s, c)) { return -1; }
+        c = argo_next_char(f);
+    }
+    if (!argo_is_digit(c)) {
+        fprintf(stderr, "[%d] Expected a digit in number\n", argo_lines_read);
+        return -1;
+    }
+    if (c == ARGO_DIGIT0) {                              //a leading zero must stand alone
+        if (argo_append_char(s, c)) { return -1; }
+        c = argo_next_char(f);
+    } else {
+        while (argo_is_digit(c)) {
+            if (is_int && num > (LONG_MAX - (c - ARGO_DIGIT0)) / 10) { is_int = 0; }    //too big for a long
+            if (is_int) { num = num * 10 + (c - ARGO_DIGIT0); }
+            if (argo_append_char(s, c)) { return -1; }
+            c = argo_next_char(f);
+        }
+    }
+    if (c == ARGO_PERIOD) {
+        is_int = 0;
+        if (argo_append_char(s, c)) { return -1; }
+        c = argo_next_char(f);
+        if (!argo_is_digit(c)) {
+            fprintf(stderr, "[%d] Expected a digit after decimal point\n", argo_lines_read);
+            return -1;
+        }
+        while (argo_is_digit(c)) {
+            if (argo_append_char(s, c)) { return -1; }
+            c = argo_next_char(f);
+        }
+    }
+    if (argo_is_exponent(c)) {
+        is_int = 0;
+        if (argo_append_char(s, c)) { return -1; }
+        c = argo_next_char(f);
+        if (c == ARGO_PLUS || c == ARGO_MINUS) {
+            if (argo_append_char(s, c)) { return -1; }
+            c = argo_next_char(f);
+        }
+        if (!argo_is_digit(c)) {
+            fprintf(stderr, "[%d] Expected a digit in exponent\n", argo_lines_read);
+            return -1;
+        }
+        while (argo_is_digit(c)) {
+            if (argo_append_char(s, c)) { return -1; }
+            c = argo_next_char(f);
+        }
+    }
+    argo_unread_char(c, f);
+
+    // The text is plain ASCII by now; strtod rounds it correctly, as repeated
+    // multiplying and dividing by ten would not.
+    if ((text = malloc(s -> length + 1)) == NULL) {
+        fprintf(stderr, "[%d] Out of memory\n", argo_lines_read);
+        return -1;
+    }
+    for (size_t i = 0; i < s -> length; i++) { text[i] = s -> content[i]; }
+    text[s -> length] = '\0';
+    n -> float_value = strtod(text, NULL);
+    free(text);
+    n -> valid_string = 1;
+    n -> valid_float = 1;
+    n -> int_value = neg ? -num : num;
+    n -> valid_int = is_int;
+    return 0;
 }
 
 /**
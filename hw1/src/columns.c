@@ -0,0 +1,248 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "argo.h"
+#include "global.h"
+#include "debug.h"
+#include "stream.h"
+
+/*
+ * One field selected by --columns.  The path is kept as an array of member
+ * names (decoded to code points so that they compare directly with names
+ * read by argo_read_string()).  "matched" is the number of leading path
+ * components that match the members enclosing the current read position.
+ * "cell" holds the text extracted for the current record.
+ */
+typedef struct column {
+    int depth;                         // Number of components in the path.
+    ARGO_STRING *path;                 // Member names along the path.
+    char *spec;                        // The field as given on the command line.
+    int spec_len;
+    int matched;                       // Path components matched so far.
+    ARGO_STRING cell;                  // Text of the field in this record.
+} COLUMN;
+
+static COLUMN *columns;
+static int num_columns;
+static ARGO_STRING member_name;
+
+static int string_eq(ARGO_STRING *a, ARGO_STRING *b) {
+    if (a -> length != b -> length) { return 0; }
+    for (size_t i = 0; i < a -> length; i++) {
+        if (a -> content[i] != b -> content[i]) { return 0; }
+    }
+    return 1;
+}
+
+/*
+ * Split argo_columns into the columns array.  Fields are separated by ','
+ * and the components of a field by '.'.
+ */
+static int parse_columns(char *list) {
+    int n = 1;
+    for (char *p = list; *p != '\0'; p++) { if (*p == ',') { n++; } }
+    columns = calloc(n, sizeof(COLUMN));
+    if (!columns) { return -1; }
+    num_columns = n;
+
+    COLUMN *col = columns;
+    char *p = list;
+    while (1) {
+        col -> spec = p;
+        col -> depth = 1;
+        for (char *q = p; *q != '\0' && *q != ','; q++) { if (*q == ARGO_PERIOD) { col -> depth++; } }
+        col -> path = calloc(col -> depth, sizeof(ARGO_STRING));
+        if (!col -> path) { return -1; }
+        int d = 0;
+        for ( ; *p != '\0' && *p != ','; p++) {
+            if (*p == ARGO_PERIOD) { d++; }
+            else if (argo_append_char(&col -> path[d], (unsigned char)*p)) { return -1; }
+        }
+        col -> spec_len = p - col -> spec;
+        if (*p == '\0') { break; }
+        p++;
+        col++;
+    }
+    return 0;
+}
+
+/*
+ * Write a code point to the output.  Values below 0x100 came from single
+ * input bytes and are written back unchanged; anything larger came from a
+ * \u escape and is written as UTF-8.
+ */
+static void write_code_point(ARGO_CHAR c, FILE *out) {
+    if (c < 0x100) { fputc(c, out); }
+    else if (c < 0x800) {
+        fputc(0xc0 | (c >> 6), out);
+        fputc(0x80 | (c & 0x3f), out);
+    } else if (c < 0x10000) {
+        fputc(0xe0 | (c >> 12), out);
+        fputc(0x80 | ((c >> 6) & 0x3f), out);
+        fputc(0x80 | (c & 0x3f), out);
+    } else {
+        fputc(0xf0 | (c >> 18), out);
+        fputc(0x80 | ((c >> 12) & 0x3f), out);
+        fputc(0x80 | ((c >> 6) & 0x3f), out);
+        fputc(0x80 | (c & 0x3f), out);
+    }
+}
+
+/*
+ * Write one cell.  CSV cells are quoted only if they contain a separator,
+ * a quote or a line break.  Fixed-width cells are truncated or padded with
+ * spaces to exactly "width" characters.
+ */
+static void write_cell(ARGO_CHAR *text, int len, int width, FILE *out) {
+    int i;
+    if (global_options & FIXED_WIDTH_OPTION) {
+        for (i = 0; i < width; i++) {
+            if (i < len && !argo_is_control(text[i])) { write_code_point(text[i], out); }
+            else { fputc(ARGO_SPACE, out); }
+        }
+        return;
+    }
+    int quote = 0;
+    for (i = 0; i < len; i++) {
+        if (text[i] == ARGO_COMMA || text[i] == ARGO_QUOTE || text[i] == ARGO_LF || text[i] == ARGO_CR) { quote = 1; }
+    }
+    if (quote) { fputc(ARGO_QUOTE, out); }
+    for (i = 0; i < len; i++) {
+        if (text[i] == ARGO_QUOTE) { fputc(ARGO_QUOTE, out); }
+        write_code_point(text[i], out);
+    }
+    if (quote) { fputc(ARGO_QUOTE, out); }
+}
+
+static void write_row(int header, FILE *out) {
+    int width = global_options & 0xff;
+    for (int i = 0; i < num_columns; i++) {
+        if (i > 0) { fputc((global_options & FIXED_WIDTH_OPTION) ? ARGO_SPACE : ARGO_COMMA, out); }
+        if (header) {
+            ARGO_STRING spec = { 0, 0, NULL };
+            for (int j = 0; j < columns[i].spec_len; j++) { argo_append_char(&spec, (unsigned char)columns[i].spec[j]); }
+            write_cell(spec.content, spec.length, width, out);
+            free(spec.content);
+        } else {
+            write_cell(columns[i].cell.content, columns[i].cell.length, width, out);
+        }
+    }
+    fputc(ARGO_LF, out);
+}
+
+/*
+ * Store the value at the read position as the cell of every column whose
+ * path ends at the current member.  Scalars are decoded with the same
+ * routines the parser uses; objects and arrays are stored as compact JSON.
+ */
+static int read_cell(FILE *in, int depth) {
+    COLUMN *first = NULL;
+    ARGO_BASIC basic;
+    for (int i = 0; i < num_columns; i++) {
+        if (columns[i].matched == depth + 1 && columns[i].depth == depth + 1) {
+            first = &columns[i];
+            break;
+        }
+    }
+    ARGO_STRING *cell = &first -> cell;
+    cell -> length = 0;
+    ARGO_CHAR c = argo_peek_char(in);
+    if (c == ARGO_QUOTE) {
+        if (argo_read_string(cell, in)) { return -1; }
+    } else if (c == ARGO_LBRACE || c == ARGO_LBRACK) {
+        if (argo_skip_value(in, cell)) { return -1; }
+    } else if (c == 't' || c == 'f' || c == 'n') {
+        if (argo_read_basic(&basic, in)) { return -1; }
+        char *token = basic == ARGO_TRUE ? ARGO_TRUE_TOKEN : basic == ARGO_FALSE ? ARGO_FALSE_TOKEN : "";
+        while (*token != '\0') { if (argo_append_char(cell, *token++)) { return -1; } }
+    } else {
+        ARGO_NUMBER n = { *cell, 0, 0.0, 0, 0, 0 };
+        if (argo_read_number(&n, in)) { return -1; }
+        *cell = n.string_value;
+    }
+    for (COLUMN *col = first + 1; col < columns + num_columns; col++) {
+        if (col -> matched == depth + 1 && col -> depth == depth + 1) {
+            col -> cell.length = 0;
+            for (size_t j = 0; j < cell -> length; j++) {
+                if (argo_append_char(&col -> cell, cell -> content[j])) { return -1; }
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * Read the members of an object at the given nesting depth within a record.
+ * Members that no column refers to are skipped without being stored.  If one
+ * column selects a member and another selects something inside it, the
+ * member is stored whole and the inner column is left empty.
+ */
+static int read_object(FILE *in, int depth) {
+    if (argo_expect_char(in, ARGO_LBRACE)) { return -1; }
+    if (argo_peek_char(in) == ARGO_RBRACE) { return argo_expect_char(in, ARGO_RBRACE); }
+    while (1) {
+        int leaf = 0, inner = 0;
+        member_name.length = 0;
+        if (argo_read_string(&member_name, in)) { return -1; }
+        if (argo_expect_char(in, ARGO_COLON)) { return -1; }
+        for (int i = 0; i < num_columns; i++) {
+            COLUMN *col = &columns[i];
+            if (col -> matched == depth && string_eq(&col -> path[depth], &member_name)) {
+                col -> matched++;
+                if (col -> depth == depth + 1) { leaf = 1; }
+                else { inner = 1; }
+            }
+        }
+        if (leaf) {
+            if (read_cell(in, depth)) { return -1; }
+        } else if (inner && argo_peek_char(in) == ARGO_LBRACE) {
+            if (read_object(in, depth + 1)) { return -1; }
+        } else {
+            if (argo_skip_value(in, NULL)) { return -1; }
+        }
+        for (int i = 0; i < num_columns; i++) {
+            if (columns[i].matched > depth) { columns[i].matched = depth; }
+        }
+        ARGO_CHAR c = argo_peek_char(in);
+        argo_next_char(in);
+        if (c == ARGO_RBRACE) { return 0; }
+        if (c != ARGO_COMMA) {
+            fprintf(stderr, "[%d] Expected ',' or '}' in object\n", argo_lines_read);
+            return -1;
+        }
+    }
+}
+
+int argo_write_columns(FILE *in, FILE *out) {
+    if (parse_columns(argo_columns)) {
+        fprintf(stderr, "Failed to allocate space for columns\n");
+        return -1;
+    }
+    write_row(1, out);
+    if (argo_expect_char(in, ARGO_LBRACK)) { return -1; }
+    if (argo_peek_char(in) == ARGO_RBRACK) { return argo_expect_char(in, ARGO_RBRACK); }
+    while (1) {
+        for (int i = 0; i < num_columns; i++) {
+            columns[i].cell.length = 0;
+            columns[i].matched = 0;
+        }
+        if (argo_peek_char(in) != ARGO_LBRACE) {
+            fprintf(stderr, "[%d] Expected an object in array of records\n", argo_lines_read);
+            return -1;
+        }
+        if (read_object(in, 0)) { return -1; }
+        write_row(0, out);
+        ARGO_CHAR c = argo_peek_char(in);
+        argo_next_char(in);
+        if (c == ARGO_RBRACK) { break; }
+        if (c != ARGO_COMMA) {
+            fprintf(stderr, "[%d] Expected ',' or ']' in array\n", argo_lines_read);
+            return -1;
+        }
+    }
+    if (argo_peek_char(in) != EOF) {
+        fprintf(stderr, "[%d] Extra input after array of records\n", argo_lines_read);
+        return -1;
+    }
+    return 0;
+}
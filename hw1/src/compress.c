@@ -0,0 +1,295 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "argo.h"
+#include "global.h"
+#include "debug.h"
+#include "stream.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/*
+ * Compressed input and output are handled by wrapping the underlying stream
+ * in a stdio stream (fopencookie) that compresses or decompresses as data
+ * passes through.  The parser and writers keep using ordinary FILE
+ * functions and never see the compressed bytes.
+ */
+
+#define CHUNK_SIZE (64 * 1024)
+
+static const unsigned char gzip_magic[] = { 0x1f, 0x8b };              // Start of a gzip member.
+static const unsigned char zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };  // Start of a zstd frame.
+
+typedef struct codec {
+    FILE *file;                        // Underlying compressed stream.
+    int method;                        // ARGO_GZIP, ARGO_ZSTD, or 0 to pass the input through.
+    int writing;                       // Compressing rather than decompressing.
+    int eof;                           // Underlying stream is exhausted.
+    int ended;                         // Last gzip member or zstd frame is complete.
+    unsigned char *buf;                // Compressed data in transit.
+    size_t len, pos;
+#ifdef HAVE_ZLIB
+    z_stream zs;
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_DStream *zds;
+    ZSTD_CStream *zcs;
+#endif
+} CODEC;
+
+static CODEC *new_codec(FILE *file, int method) {
+    CODEC *c = calloc(1, sizeof(CODEC));
+    if (!c) { return NULL; }
+    c -> file = file;
+    c -> method = method;
+    c -> buf = malloc(CHUNK_SIZE);
+    if (!c -> buf) {
+        free(c);
+        return NULL;
+    }
+    return c;
+}
+
+static void free_codec(CODEC *c) {
+    free(c -> buf);
+    free(c);
+}
+
+static int fill(CODEC *c) {
+    if (c -> pos < c -> len || c -> eof) { return 0; }
+    c -> len = fread(c -> buf, 1, CHUNK_SIZE, c -> file);
+    c -> pos = 0;
+    if (c -> len == 0) {
+        c -> eof = 1;
+        return ferror(c -> file) ? -1 : 0;
+    }
+    return 0;
+}
+
+static ssize_t codec_read(void *cookie, char *data, size_t size) {
+    CODEC *c = cookie;
+    size_t done = 0;
+    if (c -> method == 0) {
+        // Uncompressed input that began like a magic number: the bytes read
+        // to check it come first, then the rest of the input.
+        if (c -> pos < c -> len) {
+            done = c -> len - c -> pos < size ? c -> len - c -> pos : size;
+            memcpy(data, c -> buf + c -> pos, done);
+            c -> pos += done;
+            return done;
+        }
+        done = fread(data, 1, size, c -> file);
+        return done == 0 && ferror(c -> file) ? -1 : (ssize_t)done;
+    }
+    while (done == 0) {
+        if (fill(c)) { return -1; }
+        // Once the input is used up, the decoder is still asked for what it
+        // holds back; the input is only complete if its last member or frame
+        // is.
+        int drained = c -> eof && c -> pos == c -> len;
+        if (drained && c -> ended) { return 0; }
+#ifdef HAVE_ZLIB
+        if (c -> method == ARGO_GZIP) {
+            c -> zs.next_in = c -> buf + c -> pos;
+            c -> zs.avail_in = c -> len - c -> pos;
+            c -> zs.next_out = (unsigned char *)data;
+            c -> zs.avail_out = size;
+            int ret = inflate(&c -> zs, Z_NO_FLUSH);
+            c -> pos = c -> len - c -> zs.avail_in;
+            done = size - c -> zs.avail_out;
+            c -> ended = ret == Z_STREAM_END;
+            if (ret == Z_STREAM_END) { inflateReset(&c -> zs); }      // Concatenated members.
+            else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                fprintf(stderr, "Corrupt gzip input: %s\n", c -> zs.msg ? c -> zs.msg : "inflate failed");
+                return -1;
+            }
+        }
+#endif
+#ifdef HAVE_ZSTD
+        if (c -> method == ARGO_ZSTD) {
+            ZSTD_inBuffer in = { c -> buf, c -> len, c -> pos };
+            ZSTD_outBuffer out = { data, size, 0 };
+            size_t ret = ZSTD_decompressStream(c -> zds, &out, &in);
+            if (ZSTD_isError(ret)) {
+                fprintf(stderr, "Corrupt zstd input: %s\n", ZSTD_getErrorName(ret));
+                return -1;
+            }
+            c -> pos = in.pos;
+            done = out.pos;
+            c -> ended = ret == 0;
+        }
+#endif
+        if (done == 0 && drained && !c -> ended) {
+            fprintf(stderr, "Truncated %s input\n", c -> method == ARGO_GZIP ? "gzip" : "zstd");
+            return -1;
+        }
+    }
+    return done;
+}
+
+static ssize_t codec_write(void *cookie, const char *data, size_t size) {
+    CODEC *c = cookie;
+#ifdef HAVE_ZLIB
+    if (c -> method == ARGO_GZIP) {
+        c -> zs.next_in = (unsigned char *)data;
+        c -> zs.avail_in = size;
+        while (c -> zs.avail_in > 0) {
+            c -> zs.next_out = c -> buf;
+            c -> zs.avail_out = CHUNK_SIZE;
+            deflate(&c -> zs, Z_NO_FLUSH);
+            size_t n = CHUNK_SIZE - c -> zs.avail_out;
+            if (n && fwrite(c -> buf, 1, n, c -> file) != n) { return -1; }
+        }
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (c -> method == ARGO_ZSTD) {
+        ZSTD_inBuffer in = { data, size, 0 };
+        while (in.pos < in.size) {
+            ZSTD_outBuffer out = { c -> buf, CHUNK_SIZE, 0 };
+            if (ZSTD_isError(ZSTD_compressStream(c -> zcs, &out, &in))) { return -1; }
+            if (out.pos && fwrite(c -> buf, 1, out.pos, c -> file) != out.pos) { return -1; }
+        }
+    }
+#endif
+    return size;
+}
+
+static int codec_close(void *cookie) {
+    CODEC *c = cookie;
+    int ret = 0;
+#ifdef HAVE_ZLIB
+    if (c -> method == ARGO_GZIP) {
+        if (c -> writing) {
+            int z;
+            do {
+                c -> zs.next_out = c -> buf;
+                c -> zs.avail_out = CHUNK_SIZE;
+                z = deflate(&c -> zs, Z_FINISH);
+                size_t n = CHUNK_SIZE - c -> zs.avail_out;
+                if (n && fwrite(c -> buf, 1, n, c -> file) != n) { ret = -1; }
+            } while (z == Z_OK);
+            deflateEnd(&c -> zs);
+        } else {
+            inflateEnd(&c -> zs);
+        }
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (c -> zcs) {
+        size_t left;
+        do {
+            ZSTD_outBuffer out = { c -> buf, CHUNK_SIZE, 0 };
+            left = ZSTD_endStream(c -> zcs, &out);
+            if (ZSTD_isError(left)) { ret = -1; break; }
+            if (out.pos && fwrite(c -> buf, 1, out.pos, c -> file) != out.pos) { ret = -1; }
+        } while (left > 0);
+        ZSTD_freeCStream(c -> zcs);
+    }
+    if (c -> zds) { ZSTD_freeDStream(c -> zds); }
+#endif
+    if (fflush(c -> file)) { ret = -1; }
+    free_codec(c);
+    return ret;
+}
+
+FILE *argo_open_input(FILE *in) {
+    // Most input starts with neither magic number, and only its first byte
+    // needs to be given back.
+    int first = fgetc(in);
+    if (first != gzip_magic[0] && first != zstd_magic[0]) {
+        ungetc(first, in);
+        return in;
+    }
+    // Otherwise read as much more as the magic number needs.  Only one byte
+    // can be pushed back, so the bytes read go at the front of the codec's
+    // buffer, to be decompressed or passed through before the rest.
+    unsigned char magic[sizeof(zstd_magic)] = { first };
+    size_t want = first == gzip_magic[0] ? sizeof(gzip_magic) : sizeof(zstd_magic);
+    size_t got = 1 + fread(magic + 1, 1, want - 1, in);
+    int method = 0;
+    if (got == want && !memcmp(magic, gzip_magic, want)) { method = ARGO_GZIP; }
+    if (got == want && !memcmp(magic, zstd_magic, want)) { method = ARGO_ZSTD; }
+
+    CODEC *c = new_codec(in, method);
+    if (!c) {
+        fprintf(stderr, "Failed to allocate space for %s\n", method ? "decompression" : "input");
+        return NULL;
+    }
+    memcpy(c -> buf, magic, got);
+    c -> len = got;
+    if (method == 0) {
+        cookie_io_functions_t io = { codec_read, NULL, NULL, codec_close };
+        return fopencookie(c, "r", io);
+    }
+#ifdef HAVE_ZLIB
+    if (method == ARGO_GZIP) {
+        if (inflateInit2(&c -> zs, 15 + 32) != Z_OK) {                   // Accept gzip or zlib headers.
+            fprintf(stderr, "Failed to initialize decompression\n");
+            free_codec(c);
+            return NULL;
+        }
+        cookie_io_functions_t io = { codec_read, NULL, NULL, codec_close };
+        return fopencookie(c, "r", io);
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (method == ARGO_ZSTD) {
+        if (!(c -> zds = ZSTD_createDStream())) {
+            fprintf(stderr, "Failed to initialize decompression\n");
+            free_codec(c);
+            return NULL;
+        }
+        ZSTD_initDStream(c -> zds);
+        cookie_io_functions_t io = { codec_read, NULL, NULL, codec_close };
+        return fopencookie(c, "r", io);
+    }
+#endif
+    fprintf(stderr, "Input is %s-compressed, but argo was built without %s support\n",
+            method == ARGO_GZIP ? "gzip" : "zstd", method == ARGO_GZIP ? "zlib" : "zstd");
+    free_codec(c);
+    return NULL;
+}
+
+FILE *argo_open_output(FILE *out, int method) {
+    if (method == 0) { return out; }
+    CODEC *c = new_codec(out, method);
+    if (!c) {
+        fprintf(stderr, "Failed to allocate space for compression\n");
+        return NULL;
+    }
+    c -> writing = 1;
+#ifdef HAVE_ZLIB
+    if (method == ARGO_GZIP) {
+        if (deflateInit2(&c -> zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            fprintf(stderr, "Failed to initialize compression\n");
+            free_codec(c);
+            return NULL;
+        }
+        cookie_io_functions_t io = { NULL, codec_write, NULL, codec_close };
+        return fopencookie(c, "w", io);
+    }
+#endif
+#ifdef HAVE_ZSTD
+    if (method == ARGO_ZSTD) {
+        if (!(c -> zcs = ZSTD_createCStream())) {
+            fprintf(stderr, "Failed to initialize compression\n");
+            free_codec(c);
+            return NULL;
+        }
+        ZSTD_initCStream(c -> zcs, 3);
+        cookie_io_functions_t io = { NULL, codec_write, NULL, codec_close };
+        return fopencookie(c, "w", io);
+    }
+#endif
+    fprintf(stderr, "argo was built without %s support\n", method == ARGO_GZIP ? "zlib" : "zstd");
+    free_codec(c);
+    return NULL;
+}
@@ -4,6 +4,7 @@
 #include "argo.h"
 #include "global.h"
 #include "debug.h"
+#include "stream.h"
 
 #ifdef _STRING_H
 #error "Do not #include <string.h>. You will get a ZERO."
@@ -23,11 +24,44 @@ int main(int argc, char **argv)
         USAGE(*argv, EXIT_FAILURE);
     if(global_options == HELP_OPTION)
         USAGE(*argv, EXIT_SUCCESS);
+    FILE *in = argo_open_input(stdin);
+    FILE *out = argo_open_output(stdout, argo_output_compression);
+    if(!in || !out)
+        return EXIT_FAILURE;
+    int ret = EXIT_FAILURE;
+    if(global_options & COLUMNS_OPTION)
+        ret = argo_write_columns(in, out) ? EXIT_FAILURE : EXIT_SUCCESS;
+    if(global_options & (MERGE_PATCH_OPTION | SCHEMA_OPTION)) {
+        char *name = (global_options & MERGE_PATCH_OPTION) ? argo_patch_file : argo_schema_file;
+        FILE *pf = fopen(name, "r");
+        if(!pf) {
+            fprintf(stderr, "Cannot open %s\n", name);
+            return EXIT_FAILURE;
+        }
+        FILE *zpf = argo_open_input(pf);
+        ARGO_VALUE *v = zpf ? argo_read_value(zpf) : NULL;
+        fclose(zpf ? zpf : pf);
+        argo_lines_read = argo_chars_read = 0;
+        if(!v)
+            return EXIT_FAILURE;
+        if(global_options & MERGE_PATCH_OPTION)
+            ret = argo_merge_patch(in, v, out) ? EXIT_FAILURE : EXIT_SUCCESS;
+        else
+            ret = argo_validate_schema(in, v) ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
     if(global_options == VALIDATE_OPTION)
-        argo_read_value(stdin);
-    if(global_options >= CANONICALIZE_OPTION)
-        argo_write_value(argo_read_value(stdin), stdout);
-    return EXIT_FAILURE;
+        ret = argo_read_value(in) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if(global_options & CANONICALIZE_OPTION) {
+        ARGO_VALUE *v = argo_read_value(in);
+        ret = (v && !argo_write_value(v, out)) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if(ferror(in))
+        ret = EXIT_FAILURE;
+    if(fclose(in))
+        ret = EXIT_FAILURE;
+    if(fclose(out))
+        ret = EXIT_FAILURE;
+    return ret;
 }
 
 /*
@@ -0,0 +1,185 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "argo.h"
+#include "global.h"
+#include "debug.h"
+#include "stream.h"
+
+int argo_write_basic(ARGO_BASIC *b, FILE *f);
+
+/*
+ * Scratch space reused while copying the base document, so that memory
+ * stays proportional to the patch rather than to the base.
+ */
+static ARGO_STRING scratch_string;
+static ARGO_NUMBER scratch_number;
+
+static int string_eq(ARGO_STRING *a, ARGO_STRING *b) {
+    if (a -> length != b -> length) { return 0; }
+    for (size_t i = 0; i < a -> length; i++) {
+        if (a -> content[i] != b -> content[i]) { return 0; }
+    }
+    return 1;
+}
+
+static int is_null(ARGO_VALUE *v) {
+    return v -> type == ARGO_BASIC_TYPE && v -> content.basic == ARGO_NULL;
+}
+
+/*
+ * Write the result of merging patch value v into a missing target.  For an
+ * object this drops the members whose value is null, at every level;
+ * anything else is written as it is.
+ */
+static int write_patch_value(ARGO_VALUE *v, FILE *out) {
+    if (v -> type != ARGO_OBJECT_TYPE) { return argo_write_value(v, out); }
+    ARGO_VALUE *head = v -> content.object.member_list;
+    int first = 1;
+    fputc(ARGO_LBRACE, out);
+    for (ARGO_VALUE *m = head -> next; m != head; m = m -> next) {
+        if (is_null(m)) { continue; }
+        if (!first) { fputc(ARGO_COMMA, out); }
+        first = 0;
+        argo_write_string(&m -> name, out);
+        fputs(": ", out);
+        if (write_patch_value(m, out)) { return -1; }
+    }
+    fputc(ARGO_RBRACE, out);
+    return 0;
+}
+
+/*
+ * Copy one value from the base document to the output in canonical form,
+ * one token at a time.
+ */
+static int copy_value(FILE *in, FILE *out) {
+    ARGO_BASIC basic;
+    ARGO_CHAR c = argo_peek_char(in);
+    switch(c) {
+        case ARGO_QUOTE:
+            scratch_string.length = 0;
+            if (argo_read_string(&scratch_string, in)) { return -1; }
+            return argo_write_string(&scratch_string, out);
+        case ARGO_LBRACE:
+        case ARGO_LBRACK:
+            argo_next_char(in);
+            fputc(c, out);
+            ARGO_CHAR close = (c == ARGO_LBRACE) ? ARGO_RBRACE : ARGO_RBRACK;
+            if (argo_peek_char(in) == close) {
+                argo_next_char(in);
+                fputc(close, out);
+                return 0;
+            }
+            while (1) {
+                if (c == ARGO_LBRACE) {
+                    scratch_string.length = 0;
+                    if (argo_read_string(&scratch_string, in)) { return -1; }
+                    if (argo_expect_char(in, ARGO_COLON)) { return -1; }
+                    argo_write_string(&scratch_string, out);
+                    fputs(": ", out);
+                }
+                if (copy_value(in, out)) { return -1; }
+                ARGO_CHAR next = argo_peek_char(in);
+                argo_next_char(in);
+                if (next != ARGO_COMMA && next != close) {
+                    fprintf(stderr, "[%d] Expected ',' or '%c'\n", argo_lines_read, close);
+                    return -1;
+                }
+                fputc(next, out);
+                if (next == close) { return 0; }
+            }
+        case 't':
+        case 'f':
+        case 'n':
+            if (argo_read_basic(&basic, in)) { return -1; }
+            return argo_write_basic(&basic, out);
+        case EOF:
+            fprintf(stderr, "[%d] Premature EOF, expected a value\n", argo_lines_read);
+            return -1;
+    }
+    scratch_number.string_value.length = 0;
+    if (argo_read_number(&scratch_number, in)) { return -1; }
+    return argo_write_number(&scratch_number, out);
+}
+
+/*
+ * Merge patch p into the value at the read position of the base document
+ * and write the result.  Only object patches need to look at the base:
+ * every member the patch does not mention is copied through unchanged,
+ * members it sets to null are dropped, the rest are merged recursively,
+ * and patch members the base did not have are appended at the end.
+ */
+static int merge_value(FILE *in, ARGO_VALUE *p, FILE *out) {
+    if (p -> type != ARGO_OBJECT_TYPE || argo_peek_char(in) != ARGO_LBRACE) {
+        if (argo_skip_value(in, NULL)) { return -1; }
+        return write_patch_value(p, out);
+    }
+
+    ARGO_VALUE *head = p -> content.object.member_list, *m;
+    int num_members = 0, i, first = 1;
+    for (m = head -> next; m != head; m = m -> next) { num_members++; }
+    char *seen = calloc(num_members + 1, sizeof(char));
+    if (!seen) {
+        fprintf(stderr, "[%d] Failed to allocate space for merge\n", argo_lines_read);
+        return -1;
+    }
+
+    argo_next_char(in);
+    fputc(ARGO_LBRACE, out);
+    if (argo_peek_char(in) == ARGO_RBRACE) { argo_next_char(in); }
+    else {
+        while (1) {
+            scratch_string.length = 0;
+            if (argo_read_string(&scratch_string, in)) { goto error; }
+            if (argo_expect_char(in, ARGO_COLON)) { goto error; }
+            for (m = head -> next, i = 0; m != head; m = m -> next, i++) {
+                if (string_eq(&m -> name, &scratch_string)) { break; }
+            }
+            if (m != head && is_null(m)) {
+                seen[i] = 1;
+                if (argo_skip_value(in, NULL)) { goto error; }
+            } else {
+                if (!first) { fputc(ARGO_COMMA, out); }
+                first = 0;
+                argo_write_string(&scratch_string, out);
+                fputs(": ", out);
+                if (m != head) {
+                    seen[i] = 1;
+                    if (merge_value(in, m, out)) { goto error; }
+                } else if (copy_value(in, out)) { goto error; }
+            }
+            ARGO_CHAR c = argo_peek_char(in);
+            argo_next_char(in);
+            if (c == ARGO_RBRACE) { break; }
+            if (c != ARGO_COMMA) {
+                fprintf(stderr, "[%d] Expected ',' or '}' in object\n", argo_lines_read);
+                goto error;
+            }
+        }
+    }
+    for (m = head -> next, i = 0; m != head; m = m -> next, i++) {
+        if (seen[i] || is_null(m)) { continue; }
+        if (!first) { fputc(ARGO_COMMA, out); }
+        first = 0;
+        argo_write_string(&m -> name, out);
+        fputs(": ", out);
+        if (write_patch_value(m, out)) { goto error; }
+    }
+    fputc(ARGO_RBRACE, out);
+    free(seen);
+    return 0;
+
+error:
+    free(seen);
+    return -1;
+}
+
+int argo_merge_patch(FILE *in, ARGO_VALUE *patch, FILE *out) {
+    if (merge_value(in, patch, out)) { return -1; }
+    if (argo_peek_char(in) != EOF) {
+        fprintf(stderr, "[%d] Extra input after value\n", argo_lines_read);
+        return -1;
+    }
+    return 0;
+}
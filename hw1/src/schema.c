@@ -0,0 +1,442 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "argo.h"
+#include "global.h"
+#include "debug.h"
+#include "stream.h"
+
+/*
+ * Bits for the "type" keyword.  A node with no type bits accepts any type.
+ */
+#define SCHEMA_NULL (0x01)
+#define SCHEMA_BOOLEAN (0x02)
+#define SCHEMA_OBJECT (0x04)
+#define SCHEMA_ARRAY (0x08)
+#define SCHEMA_NUMBER (0x10)
+#define SCHEMA_INTEGER (0x20)
+#define SCHEMA_STRING (0x40)
+
+/*
+ * A schema compiled for checking one location in the document.  Each
+ * member listed under "properties" and the "items" schema become nodes of
+ * their own, so the compiled schema is a tree indexed by path, and the
+ * validator only ever looks at the node for the value it is reading.
+ * Names and enum values point into the ARGO_VALUE tree of the schema.
+ */
+typedef struct schema {
+    int types;                          // Allowed types, zero if unrestricted.
+    int num_required;
+    ARGO_STRING **required;             // Names of the required members.
+    int num_properties;
+    ARGO_STRING **property_names;
+    struct schema **properties;         // Schema for each named member.
+    struct schema *items;               // Schema for array elements, or NULL.
+    int num_enum;
+    ARGO_VALUE **enum_values;           // Allowed values (scalars only).
+    char has_minimum, has_maximum;
+    double minimum, maximum;
+    long max_length;                    // Maximum string length, -1 if none.
+} SCHEMA;
+
+/*
+ * One step of the path from the top of the document to the value being
+ * read, used to report violations as a JSON Pointer.  For array elements
+ * "index" is the element number; for object members it is -1 and "name"
+ * holds the member name.
+ */
+typedef struct path_step {
+    long index;
+    ARGO_STRING name;
+} PATH_STEP;
+
+static PATH_STEP *path;
+static int path_depth, path_capacity;
+static ARGO_STRING scratch_string;
+static ARGO_NUMBER scratch_number;
+
+static int string_eq(ARGO_STRING *a, ARGO_STRING *b) {
+    if (a -> length != b -> length) { return 0; }
+    for (size_t i = 0; i < a -> length; i++) {
+        if (a -> content[i] != b -> content[i]) { return 0; }
+    }
+    return 1;
+}
+
+static int string_is(ARGO_STRING *a, char *b) {
+    size_t i;
+    for (i = 0; i < a -> length; i++) {
+        if (b[i] == '\0' || a -> content[i] != b[i]) { return 0; }
+    }
+    return b[i] == '\0';
+}
+
+/*
+ * The number of characters in a string, as "maxLength" counts them.
+ * Characters written out in the input are stored one byte at a time, so the
+ * bytes following the first of a UTF-8 sequence are not counted; a \u
+ * escape is stored, and counted, as a single character.
+ */
+static long string_chars(ARGO_STRING *a) {
+    long n = 0;
+    int follow = 0;                     // Continuation bytes still expected.
+    for (size_t i = 0; i < a -> length; i++) {
+        ARGO_CHAR c = a -> content[i];
+        if (follow > 0 && c >= 0x80 && c <= 0xbf) { follow--; continue; }
+        if (c >= 0xc2 && c <= 0xdf) { follow = 1; }
+        else if (c >= 0xe0 && c <= 0xef) { follow = 2; }
+        else if (c >= 0xf0 && c <= 0xf4) { follow = 3; }
+        else { follow = 0; }
+        n++;
+    }
+    return n;
+}
+
+static ARGO_VALUE *schema_member(ARGO_VALUE *v, char *name) {
+    ARGO_VALUE *head = v -> content.object.member_list;
+    for (ARGO_VALUE *m = head -> next; m != head; m = m -> next) {
+        if (string_is(&m -> name, name)) { return m; }
+    }
+    return NULL;
+}
+
+static int count_list(ARGO_VALUE *head) {
+    int n = 0;
+    for (ARGO_VALUE *m = head -> next; m != head; m = m -> next) { n++; }
+    return n;
+}
+
+static int type_bit(ARGO_VALUE *v) {
+    ARGO_STRING *s = &v -> content.string;
+    if (v -> type != ARGO_STRING_TYPE) { return 0; }
+    if (string_is(s, "null")) { return SCHEMA_NULL; }
+    if (string_is(s, "boolean")) { return SCHEMA_BOOLEAN; }
+    if (string_is(s, "object")) { return SCHEMA_OBJECT; }
+    if (string_is(s, "array")) { return SCHEMA_ARRAY; }
+    if (string_is(s, "number")) { return SCHEMA_NUMBER; }
+    if (string_is(s, "integer")) { return SCHEMA_INTEGER; }
+    if (string_is(s, "string")) { return SCHEMA_STRING; }
+    return 0;
+}
+
+static double number_value(ARGO_NUMBER *n) {
+    return n -> valid_int ? (double)n -> int_value : n -> float_value;
+}
+
+static SCHEMA *compile_schema(ARGO_VALUE *v) {
+    ARGO_VALUE *m, *e;
+    int i;
+    if (v -> type != ARGO_OBJECT_TYPE) {
+        fprintf(stderr, "Schema error: a schema must be an object\n");
+        return NULL;
+    }
+    SCHEMA *s = calloc(1, sizeof(SCHEMA));
+    if (!s) { goto nomem; }
+    s -> max_length = -1;
+
+    if ((m = schema_member(v, "type"))) {
+        if (m -> type == ARGO_ARRAY_TYPE) {
+            ARGO_VALUE *head = m -> content.array.element_list;
+            for (e = head -> next; e != head; e = e -> next) { s -> types |= type_bit(e); }
+        } else {
+            s -> types = type_bit(m);
+        }
+        if (s -> types == 0) {
+            fprintf(stderr, "Schema error: unknown \"type\"\n");
+            return NULL;
+        }
+    }
+    if ((m = schema_member(v, "required"))) {
+        if (m -> type != ARGO_ARRAY_TYPE) {
+            fprintf(stderr, "Schema error: \"required\" must be an array of names\n");
+            return NULL;
+        }
+        ARGO_VALUE *head = m -> content.array.element_list;
+        s -> num_required = count_list(head);
+        s -> required = calloc(s -> num_required + 1, sizeof(ARGO_STRING *));
+        if (!s -> required) { goto nomem; }
+        for (e = head -> next, i = 0; e != head; e = e -> next, i++) {
+            if (e -> type != ARGO_STRING_TYPE) {
+                fprintf(stderr, "Schema error: \"required\" must be an array of names\n");
+                return NULL;
+            }
+            s -> required[i] = &e -> content.string;
+        }
+    }
+    if ((m = schema_member(v, "properties"))) {
+        if (m -> type != ARGO_OBJECT_TYPE) {
+            fprintf(stderr, "Schema error: \"properties\" must be an object\n");
+            return NULL;
+        }
+        ARGO_VALUE *head = m -> content.object.member_list;
+        s -> num_properties = count_list(head);
+        s -> property_names = calloc(s -> num_properties + 1, sizeof(ARGO_STRING *));
+        s -> properties = calloc(s -> num_properties + 1, sizeof(SCHEMA *));
+        if (!s -> property_names || !s -> properties) { goto nomem; }
+        for (e = head -> next, i = 0; e != head; e = e -> next, i++) {
+            s -> property_names[i] = &e -> name;
+            if (!(s -> properties[i] = compile_schema(e))) { return NULL; }
+        }
+    }
+    if ((m = schema_member(v, "items"))) {
+        if (!(s -> items = compile_schema(m))) { return NULL; }
+    }
+    if ((m = schema_member(v, "enum"))) {
+        if (m -> type != ARGO_ARRAY_TYPE) {
+            fprintf(stderr, "Schema error: \"enum\" must be an array\n");
+            return NULL;
+        }
+        ARGO_VALUE *head = m -> content.array.element_list;
+        s -> num_enum = count_list(head);
+        s -> enum_values = calloc(s -> num_enum + 1, sizeof(ARGO_VALUE *));
+        if (!s -> enum_values) { goto nomem; }
+        for (e = head -> next, i = 0; e != head; e = e -> next, i++) {
+            if (e -> type == ARGO_OBJECT_TYPE || e -> type == ARGO_ARRAY_TYPE) {
+                fprintf(stderr, "Schema error: only scalar \"enum\" values are supported\n");
+                return NULL;
+            }
+            s -> enum_values[i] = e;
+        }
+    }
+    if ((m = schema_member(v, "minimum"))) {
+        if (m -> type != ARGO_NUMBER_TYPE) {
+            fprintf(stderr, "Schema error: \"minimum\" must be a number\n");
+            return NULL;
+        }
+        s -> has_minimum = 1;
+        s -> minimum = number_value(&m -> content.number);
+    }
+    if ((m = schema_member(v, "maximum"))) {
+        if (m -> type != ARGO_NUMBER_TYPE) {
+            fprintf(stderr, "Schema error: \"maximum\" must be a number\n");
+            return NULL;
+        }
+        s -> has_maximum = 1;
+        s -> maximum = number_value(&m -> content.number);
+    }
+    if ((m = schema_member(v, "maxLength"))) {
+        if (m -> type != ARGO_NUMBER_TYPE || !m -> content.number.valid_int
+            || m -> content.number.int_value < 0) {
+            fprintf(stderr, "Schema error: \"maxLength\" must be a nonnegative integer\n");
+            return NULL;
+        }
+        s -> max_length = m -> content.number.int_value;
+    }
+    return s;
+
+nomem:
+    fprintf(stderr, "Failed to allocate space for schema\n");
+    return NULL;
+}
+
+/*
+ * Print a violation, with the JSON Pointer of the value being read.
+ */
+static int violation(char *msg, ARGO_STRING *name) {
+    fprintf(stderr, "[%d] Schema violation at \"", argo_lines_read);
+    for (int i = 0; i < path_depth; i++) {
+        fputc(ARGO_FSLASH, stderr);
+        if (path[i].index >= 0) {
+            fprintf(stderr, "%ld", path[i].index);
+            continue;
+        }
+        for (size_t j = 0; j < path[i].name.length; j++) {
+            ARGO_CHAR c = path[i].name.content[j];
+            if (c == '~') { fputs("~0", stderr); }
+            else if (c == ARGO_FSLASH) { fputs("~1", stderr); }
+            else { fputc(c, stderr); }
+        }
+    }
+    fprintf(stderr, "\": %s", msg);
+    if (name) {
+        fputs(" \"", stderr);
+        for (size_t j = 0; j < name -> length; j++) { fputc(name -> content[j], stderr); }
+        fputc(ARGO_QUOTE, stderr);
+    }
+    fputc(ARGO_LF, stderr);
+    return -1;
+}
+
+static PATH_STEP *push_step(long index) {
+    if (path_depth == path_capacity) {
+        int capacity = path_capacity ? 2 * path_capacity : 16;
+        PATH_STEP *p = realloc(path, capacity * sizeof(PATH_STEP));
+        if (!p) {
+            fprintf(stderr, "[%d] Failed to allocate space for path\n", argo_lines_read);
+            return NULL;
+        }
+        for (int i = path_capacity; i < capacity; i++) {
+            p[i].name.capacity = p[i].name.length = 0;
+            p[i].name.content = NULL;
+        }
+        path = p;
+        path_capacity = capacity;
+    }
+    PATH_STEP *step = &path[path_depth++];
+    step -> index = index;
+    step -> name.length = 0;
+    return step;
+}
+
+static int check_enum(SCHEMA *s, ARGO_VALUE_TYPE type, ARGO_BASIC basic) {
+    if (s -> num_enum == 0) { return 0; }
+    for (int i = 0; i < s -> num_enum; i++) {
+        ARGO_VALUE *e = s -> enum_values[i];
+        if (e -> type != type) { continue; }
+        if (type == ARGO_STRING_TYPE && string_eq(&e -> content.string, &scratch_string)) { return 0; }
+        if (type == ARGO_NUMBER_TYPE && number_value(&e -> content.number) == number_value(&scratch_number)) { return 0; }
+        if (type == ARGO_BASIC_TYPE && e -> content.basic == basic) { return 0; }
+    }
+    return violation("value is not one of the \"enum\" values", NULL);
+}
+
+static int validate_value(FILE *in, SCHEMA *s);
+
+static int validate_object(FILE *in, SCHEMA *s) {
+    char *seen = NULL;
+    int i;
+    if (s && s -> num_required) {
+        if (!(seen = calloc(s -> num_required, sizeof(char)))) {
+            fprintf(stderr, "[%d] Failed to allocate space for object\n", argo_lines_read);
+            return -1;
+        }
+    }
+    argo_next_char(in);
+    if (argo_peek_char(in) == ARGO_RBRACE) { argo_next_char(in); }
+    else {
+        while (1) {
+            PATH_STEP *step = push_step(-1);
+            if (!step) { goto error; }
+            if (argo_read_string(&step -> name, in)) { goto error; }
+            if (argo_expect_char(in, ARGO_COLON)) { goto error; }
+            SCHEMA *member = NULL;
+            if (s) {
+                for (i = 0; i < s -> num_required; i++) {
+                    if (string_eq(s -> required[i], &step -> name)) { seen[i] = 1; }
+                }
+                for (i = 0; i < s -> num_properties; i++) {
+                    if (string_eq(s -> property_names[i], &step -> name)) {
+                        member = s -> properties[i];
+                        break;
+                    }
+                }
+            }
+            if (member) {
+                if (validate_value(in, member)) { goto error; }
+            } else if (argo_skip_value(in, NULL)) { goto error; }
+            path_depth--;
+            ARGO_CHAR c = argo_peek_char(in);
+            argo_next_char(in);
+            if (c == ARGO_RBRACE) { break; }
+            if (c != ARGO_COMMA) {
+                fprintf(stderr, "[%d] Expected ',' or '}' in object\n", argo_lines_read);
+                goto error;
+            }
+        }
+    }
+    for (i = 0; s && i < s -> num_required; i++) {
+        if (!seen[i]) {
+            violation("missing required member", s -> required[i]);
+            goto error;
+        }
+    }
+    free(seen);
+    return 0;
+
+error:
+    free(seen);
+    return -1;
+}
+
+static int validate_array(FILE *in, SCHEMA *s) {
+    long index = 0;
+    argo_next_char(in);
+    if (argo_peek_char(in) == ARGO_RBRACK) {
+        argo_next_char(in);
+        return 0;
+    }
+    while (1) {
+        if (!push_step(index++)) { return -1; }
+        if (s && s -> items) {
+            if (validate_value(in, s -> items)) { return -1; }
+        } else if (argo_skip_value(in, NULL)) { return -1; }
+        path_depth--;
+        ARGO_CHAR c = argo_peek_char(in);
+        argo_next_char(in);
+        if (c == ARGO_RBRACK) { return 0; }
+        if (c != ARGO_COMMA) {
+            fprintf(stderr, "[%d] Expected ',' or ']' in array\n", argo_lines_read);
+            return -1;
+        }
+    }
+}
+
+/*
+ * Read one value while checking it against compiled schema s.  The first
+ * violation stops the parse, so the rest of the document is never read.
+ */
+static int validate_value(FILE *in, SCHEMA *s) {
+    ARGO_BASIC basic;
+    ARGO_CHAR c = argo_peek_char(in);
+    int type;
+
+    switch(c) {
+        case ARGO_LBRACE: type = SCHEMA_OBJECT; break;
+        case ARGO_LBRACK: type = SCHEMA_ARRAY; break;
+        case ARGO_QUOTE: type = SCHEMA_STRING; break;
+        case 't': case 'f': type = SCHEMA_BOOLEAN; break;
+        case 'n': type = SCHEMA_NULL; break;
+        case EOF:
+            fprintf(stderr, "[%d] Premature EOF, expected a value\n", argo_lines_read);
+            return -1;
+        default: type = SCHEMA_NUMBER; break;
+    }
+    if (s -> types && type != SCHEMA_NUMBER && !(s -> types & type)) {
+        return violation("value does not have the type required by the schema", NULL);
+    }
+
+    switch(type) {
+        case SCHEMA_OBJECT:
+            return validate_object(in, s);
+        case SCHEMA_ARRAY:
+            return validate_array(in, s);
+        case SCHEMA_STRING:
+            scratch_string.length = 0;
+            if (argo_read_string(&scratch_string, in)) { return -1; }
+            if (s -> max_length >= 0 && string_chars(&scratch_string) > s -> max_length) {
+                return violation("string is longer than \"maxLength\"", NULL);
+            }
+            return check_enum(s, ARGO_STRING_TYPE, ARGO_NULL);
+        case SCHEMA_BOOLEAN:
+        case SCHEMA_NULL:
+            if (argo_read_basic(&basic, in)) { return -1; }
+            return check_enum(s, ARGO_BASIC_TYPE, basic);
+    }
+    scratch_number.string_value.length = 0;
+    if (argo_read_number(&scratch_number, in)) { return -1; }
+    double value = number_value(&scratch_number);
+    if (s -> types && !(s -> types & SCHEMA_NUMBER)
+        && !((s -> types & SCHEMA_INTEGER) && isfinite(value) && floor(value) == value)) {
+        return violation("value does not have the type required by the schema", NULL);
+    }
+    if (s -> has_minimum && value < s -> minimum) {
+        return violation("number is less than \"minimum\"", NULL);
+    }
+    if (s -> has_maximum && value > s -> maximum) {
+        return violation("number is greater than \"maximum\"", NULL);
+    }
+    return check_enum(s, ARGO_NUMBER_TYPE, ARGO_NULL);
+}
+
+int argo_validate_schema(FILE *in, ARGO_VALUE *schema) {
+    SCHEMA *s = compile_schema(schema);
+    if (!s) { return -1; }
+    path_depth = 0;
+    if (validate_value(in, s)) { return -1; }
+    if (argo_peek_char(in) != EOF) {
+        fprintf(stderr, "[%d] Extra input after value\n", argo_lines_read);
+        return -1;
+    }
+    return 0;
+}
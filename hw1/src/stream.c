@@ -0,0 +1,180 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "argo.h"
+#include "global.h"
+#include "debug.h"
+#include "stream.h"
+
+/*
+ * Scratch number reused by argo_skip_value(), so that skipping a member
+ * does not allocate anything once the scratch text has grown to size.
+ */
+static ARGO_NUMBER skip_number;
+
+ARGO_CHAR argo_next_char(FILE *f) {
+    ARGO_CHAR c = fgetc(f);
+    if (c == ARGO_LF) {
+        argo_lines_read++;
+        argo_chars_read = 0;
+    } else if (c != EOF) {
+        argo_chars_read++;
+    }
+    return c;
+}
+
+void argo_unread_char(ARGO_CHAR c, FILE *f) {
+    if (c == EOF) { return; }
+    ungetc(c, f);
+    if (c == ARGO_LF) { argo_lines_read--; }
+    else { argo_chars_read--; }
+}
+
+ARGO_CHAR argo_read_hex(FILE *f) {
+    ARGO_CHAR code = 0;
+    for (int i = 0; i < 4; i++) {
+        ARGO_CHAR c = argo_next_char(f);
+        if (!argo_is_hex(c)) {
+            fprintf(stderr, "[%d] Bad \\u escape in string\n", argo_lines_read);
+            return -1;
+        }
+        if (argo_is_digit(c)) { code = code * 16 + (c - ARGO_DIGIT0); }
+        else if (c >= 'a') { code = code * 16 + (c - 'a' + 10); }
+        else { code = code * 16 + (c - 'A' + 10); }
+    }
+    return code;
+}
+
+ARGO_CHAR argo_peek_char(FILE *f) {
+    ARGO_CHAR c = argo_next_char(f);
+    while (argo_is_whitespace(c)) { c = argo_next_char(f); }
+    argo_unread_char(c, f);
+    return c;
+}
+
+int argo_expect_char(FILE *f, ARGO_CHAR c) {
+    ARGO_CHAR got = argo_peek_char(f);
+    if (got != c) {
+        if (got == EOF) { fprintf(stderr, "[%d] Premature EOF, expected '%c'\n", argo_lines_read, c); }
+        else { fprintf(stderr, "[%d] Expected '%c', found '%c'\n", argo_lines_read, c, got); }
+        return -1;
+    }
+    argo_next_char(f);
+    return 0;
+}
+
+static int read_token(FILE *f, char *token) {
+    while (*token != '\0') {
+        if (argo_next_char(f) != *token) {
+            fprintf(stderr, "[%d] Unrecognized token\n", argo_lines_read);
+            return -1;
+        }
+        token++;
+    }
+    return 0;
+}
+
+int argo_read_basic(ARGO_BASIC *b, FILE *f) {
+    switch(argo_peek_char(f)) {
+        case 't':
+            *b = ARGO_TRUE;
+            return read_token(f, ARGO_TRUE_TOKEN);
+        case 'f':
+            *b = ARGO_FALSE;
+            return read_token(f, ARGO_FALSE_TOKEN);
+        case 'n':
+            *b = ARGO_NULL;
+            return read_token(f, ARGO_NULL_TOKEN);
+    }
+    fprintf(stderr, "[%d] Unrecognized token\n", argo_lines_read);
+    return -1;
+}
+
+static int append_token(ARGO_STRING *sink, char *token) {
+    while (*token != '\0') {
+        if (argo_append_char(sink, *token++)) { return -1; }
+    }
+    return 0;
+}
+
+/*
+ * Skip a string literal.  When copying to a sink the literal is copied
+ * verbatim, escapes included, so that the sink holds valid JSON text.
+ */
+static int skip_string(FILE *f, ARGO_STRING *sink) {
+    if (argo_expect_char(f, ARGO_QUOTE)) { return -1; }
+    if (sink && argo_append_char(sink, ARGO_QUOTE)) { return -1; }
+    while (1) {
+        ARGO_CHAR c = argo_next_char(f);
+        if (c == EOF || argo_is_control(c)) {
+            fprintf(stderr, "[%d] Unterminated string\n", argo_lines_read);
+            return -1;
+        }
+        if (sink && argo_append_char(sink, c)) { return -1; }
+        if (c == ARGO_QUOTE) { return 0; }
+        if (c == ARGO_BSLASH) {
+            c = argo_next_char(f);
+            if (c == EOF) {
+                fprintf(stderr, "[%d] Unterminated string\n", argo_lines_read);
+                return -1;
+            }
+            if (sink && argo_append_char(sink, c)) { return -1; }
+        }
+    }
+}
+
+int argo_skip_value(FILE *f, ARGO_STRING *sink) {
+    ARGO_CHAR c = argo_peek_char(f);
+    ARGO_BASIC basic;
+    ARGO_STRING *text = &skip_number.string_value;
+
+    switch(c) {
+        case ARGO_QUOTE:
+            return skip_string(f, sink);
+        case ARGO_LBRACE:
+        case ARGO_LBRACK:
+            argo_next_char(f);
+            if (sink && argo_append_char(sink, c)) { return -1; }
+            ARGO_CHAR close = (c == ARGO_LBRACE) ? ARGO_RBRACE : ARGO_RBRACK;
+            if (argo_peek_char(f) == close) {
+                argo_next_char(f);
+                return sink ? argo_append_char(sink, close) : 0;
+            }
+            while (1) {
+                if (c == ARGO_LBRACE) {
+                    if (skip_string(f, sink)) { return -1; }
+                    if (argo_expect_char(f, ARGO_COLON)) { return -1; }
+                    if (sink && argo_append_char(sink, ARGO_COLON)) { return -1; }
+                }
+                if (argo_skip_value(f, sink)) { return -1; }
+                ARGO_CHAR next = argo_peek_char(f);
+                argo_next_char(f);
+                if (sink && argo_append_char(sink, next)) { return -1; }
+                if (next == close) { return 0; }
+                if (next != ARGO_COMMA) {
+                    fprintf(stderr, "[%d] Expected ',' or '%c'\n", argo_lines_read, close);
+                    return -1;
+                }
+            }
+        case 't':
+        case 'f':
+        case 'n':
+            if (argo_read_basic(&basic, f)) { return -1; }
+            if (sink) {
+                return append_token(sink, basic == ARGO_TRUE ? ARGO_TRUE_TOKEN :
+                                          basic == ARGO_FALSE ? ARGO_FALSE_TOKEN : ARGO_NULL_TOKEN);
+            }
+            return 0;
+        case EOF:
+            fprintf(stderr, "[%d] Premature EOF, expected a value\n", argo_lines_read);
+            return -1;
+    }
+    text -> length = 0;
+    if (argo_read_number(&skip_number, f)) { return -1; }
+    if (sink) {
+        for (size_t i = 0; i < text -> length; i++) {
+            if (argo_append_char(sink, text -> content[i])) { return -1; }
+        }
+    }
+    return 0;
+}
@@ -3,6 +3,60 @@
 #include "argo.h"
 #include "global.h"
 #include "debug.h"
+#include "stream.h"
+
+static int str_eq(char *a, char *b) {
+    while (*a != '\0' && *a == *b) { a++; b++; }
+    return *a == *b;
+}
+
+/*
+ * Validates the arguments of the streaming modes, which are selected by
+ * a long option in argv[1]:
+ *     --columns FIELDS [-w WIDTH]
+ *     --merge-patch FILE
+ *     --schema FILE
+ */
+static int validargs_stream(int argc, char **argv) {
+    global_options = 0x0;
+    for (int i = 1; i < argc; i++) {
+        if (str_eq(*(argv+i), "--columns") && i+1 < argc) {
+            global_options |= COLUMNS_OPTION;
+            argo_columns = *(argv + ++i);
+        } else if (str_eq(*(argv+i), "--merge-patch") && i+1 < argc) {
+            global_options |= MERGE_PATCH_OPTION;
+            argo_patch_file = *(argv + ++i);
+        } else if (str_eq(*(argv+i), "--schema") && i+1 < argc) {
+            global_options |= SCHEMA_OPTION;
+            argo_schema_file = *(argv + ++i);
+        } else if (str_eq(*(argv+i), "-w") && i+1 < argc) {
+            int width = 0;
+            for (char *p = *(argv + ++i); *p != '\0'; p++) {
+                if (*p < '0' || *p > '9') { width = 0x100; break; }
+                width = width * 10 + (*p - '0');
+                if (width > 0xff) { break; }
+            }
+            if (width == 0 || width > 0xff) {
+                global_options=0x0;
+                return -1;
+            }
+            global_options |= FIXED_WIDTH_OPTION | width;
+        } else {
+            global_options=0x0;
+            return -1;
+        }
+    }
+    if (global_options & COLUMNS_OPTION) {
+        if (*argo_columns == '\0' || (global_options & (MERGE_PATCH_OPTION | SCHEMA_OPTION))) {
+            global_options=0x0;
+            return -1;
+        }
+    } else if (global_options != MERGE_PATCH_OPTION && global_options != SCHEMA_OPTION) {
+        global_options=0x0;
+        return -1;
+    }
+    return 0;
+}
 
 /**
  * @brief Validates command line arguments passed to the program.
@@ -27,6 +81,25 @@ int validargs(int argc, char **argv) {
     argv is the array itself, given the nature of variables in C, argv points to the first variable of the array. argv = argv[0].
     */
 
+    argo_output_compression = 0;
+    for (int i = 1; i+1 < argc; i++) {              // --compress may accompany any other option
+        if (str_eq(*(argv+i), "--compress")) {
+            if (str_eq(*(argv+i+1), "gzip")) { argo_output_compression = ARGO_GZIP; }
+            else if (str_eq(*(argv+i+1), "zstd")) { argo_output_compression = ARGO_ZSTD; }
+            else {
+                global_options=0x0;
+                return -1;
+            }
+            for (int j = i; j+2 <= argc; j++) { *(argv+j) = *(argv+j+2); }
+            argc -= 2;
+            break;
+        }
+    }
+
+    if (argc >= 2 && *(*(argv+1)) == '-' && *(*(argv+1)+1) == '-') {
+        return validargs_stream(argc, argv);
+    }
+
     if (argc < 2 || argc > 4) {
         global_options=0x0;
         return -1;
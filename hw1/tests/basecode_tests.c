@@ -93,3 +93,175 @@ Test(basecode_suite, argo_basic_test) {
     cr_assert_eq(return_code, EXIT_SUCCESS,
                  "Program output did not match reference output.");
 }
+
+Test(basecode_suite, argo_columns_test) {
+    char *cmd = "bin/argo --columns id,name,addr.city,addr.zip,tags,ok < rsrc/records.json > test_output/records_--columns.csv";
+    char *cmp = "cmp test_output/records_--columns.csv tests/rsrc/records_--columns.csv";
+
+    int return_code = WEXITSTATUS(system(cmd));
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with 0x%x instead of EXIT_SUCCESS",
+		 return_code);
+    return_code = WEXITSTATUS(system(cmp));
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program output did not match reference output.");
+}
+
+Test(basecode_suite, argo_read_number_test) {
+    char text[] = "123.456 0.30000000000000004 9223372036854775807 "
+	"-9223372036854775807 9223372036854775808 1234567890123456789012 ";
+    double exp_float[] = {123.456, 0.30000000000000004, 9223372036854775807.0,
+			  -9223372036854775807.0, 9223372036854775808.0, 1234567890123456789012.0};
+    int exp_valid_int[] = {0, 0, 1, 1, 0, 0};
+    FILE *f = fmemopen(text, sizeof(text) - 1, "r");
+
+    for (int i = 0; i < 6; i++) {
+	ARGO_NUMBER n = {{0, 0, NULL}, 0, 0.0, 0, 0, 0};
+	cr_assert_eq(argo_read_number(&n, f), 0, "Number %d was not read", i);
+	cr_assert_eq(n.float_value, exp_float[i], "Float value of number %d is %.17g, not %.17g",
+		     i, n.float_value, exp_float[i]);
+	cr_assert_eq(n.valid_int, exp_valid_int[i], "valid_int of number %d is %d, not %d",
+		     i, n.valid_int, exp_valid_int[i]);
+	if (n.valid_int)
+	    cr_assert_eq((double)n.int_value, exp_float[i], "Int value of number %d is %ld",
+			 i, n.int_value);
+	free(n.string_value.content);
+	fgetc(f);
+    }
+    fclose(f);
+}
+
+Test(basecode_suite, argo_merge_patch_test) {
+    char *cmd = "bin/argo --merge-patch rsrc/merge_patch.json < rsrc/merge_base.json > test_output/merge_base_--merge-patch.json";
+    char *cmp = "cmp test_output/merge_base_--merge-patch.json tests/rsrc/merge_base_--merge-patch.json";
+
+    int return_code = WEXITSTATUS(system(cmd));
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with 0x%x instead of EXIT_SUCCESS",
+		 return_code);
+    return_code = WEXITSTATUS(system(cmp));
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program output did not match reference output.");
+}
+
+Test(basecode_suite, argo_schema_test) {
+    char *cmd = "bin/argo --schema rsrc/schema.json < rsrc/records.json > /dev/null 2>&1";
+    char *bad = "bin/argo --schema rsrc/schema.json < rsrc/records_invalid.json > /dev/null 2>&1";
+
+    int return_code = WEXITSTATUS(system(cmd));
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with 0x%x instead of EXIT_SUCCESS",
+		 return_code);
+    return_code = WEXITSTATUS(system(bad));
+    cr_assert_eq(return_code, EXIT_FAILURE,
+                 "Program exited with 0x%x instead of EXIT_FAILURE",
+		 return_code);
+}
+
+Test(basecode_suite, argo_schema_messages_test) {
+    // Each document breaks the schema once; the message must name the rule
+    // and give the JSON Pointer of the value that broke it.
+    char *cases[][2] = {
+	{"cat rsrc/records_invalid.json",
+	 "Schema violation at \"/0/id\": number is greater than \"maximum\""},
+	{"echo '[{\"id\": 1.5, \"name\": \"x\"}]'",
+	 "Schema violation at \"/0/id\": value does not have the type required by the schema"},
+	{"echo '[{\"id\": 1}, {\"id\": 2}]'",
+	 "Schema violation at \"/0\": missing required member"},
+	{"echo '[{\"id\": 1, \"name\": \"x\"}, {\"id\": 2, \"name\": \"seventeen chars!!\"}]'",
+	 "Schema violation at \"/1/name\": string is longer than \"maxLength\""},
+	{"echo '[{\"id\": 1, \"name\": \"x\", \"tags\": [\"a\", \"d\"]}]'",
+	 "Schema violation at \"/0/tags/1\": value is not one of the \"enum\" values"},
+	{"echo '[{\"id\": 1e300, \"name\": \"x\"}]'",
+	 "Schema violation at \"/0/id\": number is greater than \"maximum\""},
+    };
+    char cmd[500];
+
+    for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+	snprintf(cmd, sizeof(cmd), "%s | bin/argo --schema rsrc/schema.json > /dev/null"
+		 " 2> test_output/schema_messages.err", cases[i][0]);
+	int return_code = WEXITSTATUS(system(cmd));
+	cr_assert_eq(return_code, EXIT_FAILURE,
+		     "Program exited with 0x%x instead of EXIT_FAILURE for: %s",
+		     return_code, cases[i][0]);
+	snprintf(cmd, sizeof(cmd), "grep -qF '%s' test_output/schema_messages.err", cases[i][1]);
+	return_code = WEXITSTATUS(system(cmd));
+	cr_assert_eq(return_code, EXIT_SUCCESS, "Expected message \"%s\" for: %s",
+		     cases[i][1], cases[i][0]);
+    }
+}
+
+Test(basecode_suite, argo_schema_max_length_test) {
+    // Sixteen characters, but 32 bytes of UTF-8, are within "maxLength": 16;
+    // so are sixteen written as \u escapes.
+    char *cmd = "printf '%s' '[{\"id\": 1, \"name\": \"\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9"
+	"\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9\"}, {\"id\": 2, \"name\": "
+	"\"\\u00e9\\u00e9\\u00e9\\u00e9\\u00e9\\u00e9\\u00e9\\u00e9"
+	"\\u00e9\\u00e9\\u00e9\\u00e9\\u00e9\\u00e9\\u00e9\\u00e9\"}]'"
+	" | bin/argo --schema rsrc/schema.json > /dev/null 2>&1";
+
+    int return_code = WEXITSTATUS(system(cmd));
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with 0x%x instead of EXIT_SUCCESS",
+		 return_code);
+}
+
+Test(basecode_suite, argo_gzip_test) {
+    char *cmd = "gzip -c rsrc/records.json | bin/argo --columns id,name,addr.city,addr.zip,tags,ok --compress gzip"
+	" | gzip -dc > test_output/records_gzip.csv";
+    char *cmp = "cmp test_output/records_gzip.csv tests/rsrc/records_--columns.csv";
+
+    int return_code = WEXITSTATUS(system(cmd));
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with 0x%x instead of EXIT_SUCCESS",
+		 return_code);
+    return_code = WEXITSTATUS(system(cmp));
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program output did not match reference output.");
+}
+
+Test(basecode_suite, argo_validate_exit_test) {
+    char *cmd = "bin/argo -v < rsrc/records.json > /dev/null 2>&1";
+    char *gz = "gzip -c rsrc/records.json | bin/argo -v > /dev/null 2>&1";
+
+    int return_code = WEXITSTATUS(system(cmd));
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with 0x%x instead of EXIT_SUCCESS",
+		 return_code);
+    return_code = WEXITSTATUS(system(gz));
+    cr_assert_eq(return_code, EXIT_SUCCESS,
+                 "Program exited with 0x%x instead of EXIT_SUCCESS for gzip input",
+		 return_code);
+}
+
+Test(basecode_suite, argo_gzip_truncated_test) {
+    // Every record is there, but the gzip trailer is cut short.
+    char *cmd = "gzip -c rsrc/records.json | head -c -4 | bin/argo --columns id,name > /dev/null 2>&1";
+
+    int return_code = WEXITSTATUS(system(cmd));
+    cr_assert_eq(return_code, EXIT_FAILURE,
+                 "Program exited with 0x%x instead of EXIT_FAILURE",
+		 return_code);
+}
+
+Test(basecode_suite, argo_magic_prefix_test) {
+    // Each input starts with the first byte of a magic number but is not
+    // compressed: it must be parsed (and rejected) as JSON, not decompressed.
+    char *cases[] = {
+	"printf '(1)'",
+	"printf '\\050\\265\\057'",
+	"printf '\\0371'",
+	"printf '\\037'",
+    };
+    char cmd[500];
+
+    for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+	snprintf(cmd, sizeof(cmd), "%s | bin/argo -v > /dev/null 2> test_output/magic_prefix.err", cases[i]);
+	int return_code = WEXITSTATUS(system(cmd));
+	cr_assert_eq(return_code, EXIT_FAILURE,
+		     "Program exited with 0x%x instead of EXIT_FAILURE for: %s",
+		     return_code, cases[i]);
+	return_code = WEXITSTATUS(system("grep -qE 'gzip|zstd' test_output/magic_prefix.err"));
+	cr_assert_neq(return_code, EXIT_SUCCESS, "Input was taken as compressed for: %s", cases[i]);
+    }
+}
@@ -0,0 +1,290 @@
+/*********************/
+/* par_bench.c       */
+/* for Par 3.20      */
+/*********************/
+
+/* Times libpar on deterministic corpora of several shapes, phase by   */
+/* phase (see "stats.h"). Each corpus is fed to par_reformat() in       */
+/* chunks ending after blank lines, as par does, using a fresh context  */
+/* for every run, and the fastest of the runs is reported. The corpora  */
+/* come from a fixed generator, so that results from different commits */
+/* can be compared line by line. Allocations are counted by wrapping    */
+/* malloc(), calloc() and realloc() at link time (see the Makefile).    */
+/*                                                                      */
+/* Usage: par_bench [runs]                                              */
+
+
+#include "libpar.h"
+#include "stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#undef NULL
+#define NULL ((void *) 0)
+
+#define CHUNKSIZE 16384
+#define NUMCORPORA 6
+
+
+static long allocations;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+  ++allocations;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+  ++allocations;
+  return __real_calloc(n,size);
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+  ++allocations;
+  return __real_realloc(p,size);
+}
+
+
+struct text {
+  char *chars;
+  size_t len, size;
+};
+
+
+static unsigned long seed;
+
+static unsigned long rnd(unsigned long n)
+/* Returns a pseudo-random number in [0,n), the same on every platform. */
+{
+  seed = (seed * 6364136223846793005UL + 1442695040888963407UL)
+         & 0xffffffffffffffffUL;
+  return (seed >> 33) % n;
+}
+
+
+static void put(struct text *t, const char *s, size_t n)
+/* Appends the n chars at s to t. */
+{
+  if (t->len + n > t->size) {
+    t->size = t->size ? 2 * t->size : 65536;
+    while (t->len + n > t->size) t->size *= 2;
+    t->chars = realloc(t->chars, t->size);
+    if (!t->chars) {
+      fprintf(stderr, "Out of memory.\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  memcpy(t->chars + t->len, s, n);
+  t->len += n;
+}
+
+
+static void putwords(struct text *t, const char *prefix, size_t lines,
+                     size_t linelen)
+/* Appends to t lines of about linelen chars of random words, each */
+/* line starting with prefix, followed by a blank line.            */
+{
+  char word[16];
+  size_t k, n, col;
+
+  while (lines--) {
+    put(t, prefix, strlen(prefix));
+    for (col = 0;  col < linelen; ) {
+      n = 1 + rnd(9) + rnd(4);
+      for (k = 0;  k < n;  ++k) word[k] = 'a' + rnd(26);
+      word[n++] = ' ';
+      put(t, word, n);
+      col += n;
+    }
+    put(t, "\n", 1);
+  }
+  put(t, "\n", 1);
+}
+
+
+static void putwords8(struct text *t, size_t lines, size_t linelen)
+/* Like putwords(t,"",lines,linelen), but the words are of UTF-8 */
+/* chars, some of them two columns wide, and linelen is a width. */
+{
+  static const char * const chars[] =
+    { "\xc3\xa9", "\xc3\xbc", "\xc3\x9f", "a", "n",
+      "\xe6\x97\xa5", "\xe6\x9c\xac", "\xe8\xaa\x9e",
+      "\xe3\x81\x8b", "\xe3\x81\xaa" };
+  size_t k, n, col, c;
+
+  while (lines--) {
+    for (col = 0;  col < linelen; ) {
+      n = 1 + rnd(5) + rnd(3);
+      for (k = 0;  k < n;  ++k) {
+        c = rnd(10);
+        put(t, chars[c], strlen(chars[c]));
+        col += c < 5 ? 1 : 2;
+      }
+      put(t, " ", 1);
+      ++col;
+    }
+    put(t, "\n", 1);
+  }
+  put(t, "\n", 1);
+}
+
+
+struct corpus {
+  const char *name;
+  struct par_opts opts;
+  struct text text;
+};
+
+
+static void makecorpora(struct corpus *c)
+/* Fills in the corpora. The last two are measured in columns, */
+/* one of them with the same text as the first.                */
+{
+  static const char * const quotes[] =
+    { "> ", "> > ", ">> ", "> > > > ", ">>> > ", "> > > > > > > > ", "|  > ", "" };
+  size_t i;
+
+  seed = 1;
+  c[0].name = "short";
+  for (i = 0;  i < 40000;  ++i)
+    putwords(&c[0].text, "", 1 + rnd(5), 40 + rnd(30));
+
+  c[1].name = "huge";
+  for (i = 0;  i < 3;  ++i)
+    putwords(&c[1].text, "", 20000 + rnd(10000), 60 + rnd(15));
+
+  c[2].name = "mail";
+  for (i = 0;  i < 20000;  ++i)
+    putwords(&c[2].text, quotes[rnd(8)], 2 + rnd(6), 30 + rnd(40));
+
+  c[3].name = "wide";
+  c[3].opts.width = 4000;
+  for (i = 0;  i < 200;  ++i)
+    putwords(&c[3].text, "", 20 + rnd(20), 500 + rnd(2000));
+
+  seed = 1;
+  c[4].name = "short8";
+  c[4].opts.utf8 = 1;
+  for (i = 0;  i < 40000;  ++i)
+    putwords(&c[4].text, "", 1 + rnd(5), 40 + rnd(30));
+
+  c[5].name = "kanji";
+  c[5].opts.utf8 = 1;
+  for (i = 0;  i < 40000;  ++i)
+    putwords8(&c[5].text, 1 + rnd(5), 40 + rnd(30));
+}
+
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static size_t nextchunk(const char *p, size_t len)
+/* Returns the length of the chunk at the start of p[0..len), which */
+/* ends after the first blank line at least CHUNKSIZE chars in.     */
+{
+  const char *q;
+
+  if (len <= CHUNKSIZE) return len;
+  q = memchr(p + CHUNKSIZE, '\n', len - CHUNKSIZE);
+  while (q && q + 1 < p + len && q[1] != '\n')
+    q = memchr(q + 1, '\n', p + len - q - 1);
+  return q && q + 1 < p + len ? q + 2 - p : len;
+}
+
+
+static int run(const struct corpus *c, struct parstats *best, double *bestsecs,
+               long *allocs, size_t *outbytes)
+/* Reformats c once, and replaces *best, *bestsecs, *allocs and  */
+/* *outbytes if it was the fastest run so far. Returns 0 on      */
+/* success, -1 after reporting an error.                         */
+{
+  par_ctx *ctx;
+  const char *p = c->text.chars, *end = p + c->text.len, *out;
+  size_t n, outlen, total = 0;
+  double start, secs;
+  long before;
+
+  memset(&parstats, 0, sizeof parstats);
+  before = allocations;
+  start = now();
+
+  ctx = par_new(&c->opts);
+  if (!ctx) {
+    fprintf(stderr, "par_new() failed.\n");
+    return -1;
+  }
+  for ( ;  p < end;  p += n) {
+    n = nextchunk(p, end - p);
+    if (par_reformat(ctx, p, n, &out, &outlen)) {
+      fprintf(stderr, "%s: %s", c->name, par_error(ctx));
+      par_free(ctx);
+      return -1;
+    }
+    total += outlen;
+  }
+  par_free(ctx);
+
+  secs = now() - start;
+  if (*bestsecs < 0 || secs < *bestsecs) {
+    *best = parstats;
+    *bestsecs = secs;
+    *allocs = allocations - before;
+    *outbytes = total;
+  }
+  return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+  struct corpus corpora[NUMCORPORA];
+  struct parstats best;
+  double secs, mb;
+  long allocs;
+  size_t outbytes;
+  int runs = argc > 1 ? atoi(argv[1]) : 5, i, k, ph;
+  static const char * const phases[NUMPHASES] =
+    { "read", "defaults", "words", "breaks", "output" };
+
+  if (runs < 1) runs = 1;
+  memset(corpora, 0, sizeof corpora);
+  for (i = 0;  i < NUMCORPORA;  ++i) {
+    corpora[i].opts.width = corpora[i].opts.prefix = corpora[i].opts.suffix = -1;
+    corpora[i].opts.hang = corpora[i].opts.last = corpora[i].opts.min = -1;
+  }
+  makecorpora(corpora);
+
+  printf("par_bench: best of %d runs; phase times in ms\n", runs);
+  printf("%-6s %7s %7s", "corpus", "MB", "paras");
+  for (ph = 0;  ph < NUMPHASES;  ++ph) printf(" %8s", phases[ph]);
+  printf(" %8s %10s %8s %11s\n", "total", "paras/s", "MB/s", "allocs/para");
+
+  for (i = 0;  i < NUMCORPORA;  ++i) {
+    secs = -1;
+    for (k = 0;  k < runs;  ++k)
+      if (run(&corpora[i], &best, &secs, &allocs, &outbytes)) return EXIT_FAILURE;
+    mb = corpora[i].text.len / 1e6;
+    printf("%-6s %7.2f %7ld", corpora[i].name, mb, best.paragraphs);
+    for (ph = 0;  ph < NUMPHASES;  ++ph) printf(" %8.2f", best.seconds[ph] * 1e3);
+    printf(" %8.2f %10.0f %8.1f %11.2f\n", secs * 1e3, best.paragraphs / secs,
+           mb / secs, (double) allocs / best.paragraphs);
+    free(corpora[i].text.chars);
+  }
+
+  return EXIT_SUCCESS;
+}
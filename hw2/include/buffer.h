@@ -8,8 +8,10 @@
 /* This is ANSI C code. */
 
 
-/* Note: Those functions declared here which do not use errmsg    */
-/* always succeed, provided that they are passed valid arguments. */
+/* Note: None of the functions declared here uses errmsg. Those  */
+/* which can fail do so only when out of memory, and say so by   */
+/* their return value; the others always succeed, provided that  */
+/* they are passed valid arguments.                              */
 
 
 #include <stddef.h>
@@ -24,7 +26,7 @@ struct buffer *newbuffer(size_t itemsize);
   /* buffer which holds items of size itemsize. Any struct buffer */
   /* *buf passed to any function declared in this header must     */
   /* have been obtained from this function. itemsize must not be  */
-  /* 0. newbuffer() uses errmsg, and returns NULL on failure.     */
+  /* 0. newbuffer() returns NULL on failure.                     */
 
 
 void freebuffer(struct buffer *buf);
@@ -39,13 +41,31 @@ void clearbuffer(struct buffer *buf);
   /* *buf, but does not free any memory.     */
 
 
-void additem(struct buffer *buf, const void *item);
+int additem(struct buffer *buf, const void *item);
 
   /* additem(buf,item) copies *item to the end of *buf. item must point */
-  /* to an object of the proper size for *buf. additem() uses errmsg.   */
+  /* to an object of the proper size for *buf. additem() returns 0 on   */
+  /* success, and -1 on failure.                                        */
 
 
-int numitems(struct buffer *buf);
+void *growbuffer(struct buffer *buf, size_t n);
+
+  /* growbuffer(buf,n) adds n uninitialized items to the end of *buf,  */
+  /* and returns a pointer to the first of them, through which the     */
+  /* caller may fill them in. The pointer is valid only until the next */
+  /* call to additem() or growbuffer(). growbuffer() returns NULL on  */
+  /* failure, which includes *buf growing past the number of bytes a   */
+  /* size_t can count.                                                 */
+
+
+void *bufferitems(struct buffer *buf);
+
+  /* bufferitems(buf) returns a pointer to the array of items in *buf, */
+  /* or (void *) 0 if *buf has no storage. The pointer is valid only   */
+  /* until the next call to additem(), growbuffer(), or detachitems(). */
+
+
+size_t numitems(struct buffer *buf);
 
   /* numitems(buf) returns the number of items in *buf. */
 
@@ -56,7 +76,18 @@ void *copyitems(struct buffer *buf);
   /* *buf, one for each item in *buf, or (void *) 0 if there are no items */
   /* in buf. The elements of the array are copied from the items in *buf, */
   /* in order. The array is allocated with malloc(), so it may be freed   */
-  /* with free(). copyitems() uses errmsg, and returns NULL on failure.   */
+  /* with free(). copyitems() also returns NULL on failure, which can be  */
+  /* told apart from there being no items by numitems(buf).              */
+
+
+void *detachitems(struct buffer *buf);
+
+  /* detachitems(buf) is like copyitems(buf), except that rather  */
+  /* than copying the items it hands over the storage holding     */
+  /* them, leaving *buf empty, so it cannot fail. The array may    */
+  /* have room for more items than it holds. If there are no      */
+  /* items in buf, detachitems() returns (void *) 0 and leaves    */
+  /* *buf unchanged.                                              */
 
 
 void *nextitem(struct buffer *buf);
@@ -66,6 +97,7 @@ void *nextitem(struct buffer *buf);
   /* item in this slot, nextitem(buf) advances the pointer to the next */
   /* slot and returns the old value. If there is no item in the slot,  */
   /* nextitem(buf) leaves the pointer where it is and returns NULL.    */
+  /* The value returned is valid only until the next call to additem. */
 
 
 void rewindbuffer(struct buffer *buf);
@@ -7,15 +7,27 @@
 
 /* This is ANSI C code. */
 
+
+#ifndef ERRMSG_H
+#define ERRMSG_H
+
 #include <stdio.h>
 
 
-static char* err_msg;
+/* Any function which uses errmsg must, before returning,  */
+/* either call clear_error() (indicating success), or call */
+/* set_error() (indicating failure). The error indication  */
+/* is kept separately for each thread.                     */
+
+/* The code behind libpar (see "libpar.h") does not use    */
+/* errmsg, so that it keeps no state outside a par_ctx.    */
+/* Those of its functions that can fail are passed an      */
+/* errmsg_t instead, which they set to "" on success and   */
+/* to the error message on failure.                        */
 
-/* Any function which uses errmsg must, before returning, */
-/* either set errmsg[0] to '\0' (indicating success), or  */
-/* write an error message string into errmsg, (indicating */
-/* failure), being careful not to overrun the space.      */
+#define errmsg_size 163
+
+typedef char errmsg_t[errmsg_size];
 
 /**
  * @brief  Set an error indication, with a specified error message.
@@ -30,6 +42,13 @@ void set_error(char *msg);
  */
 int is_error();
 
+/**
+ * @brief  Get the current error message.
+ * @return The error message, or NULL if there is no error indication.
+ * The string remains valid until the error indication is changed.
+ */
+const char *get_error();
+
 /**
  * @brief  Issue any existing error message to the specified output stream.
  * @param file  Stream to which the error message is to be issued.  
@@ -48,4 +67,8 @@ void clear_error();
 
 
 
-extern const char * const outofmem;  /* "Out of memory.\n" */
+#define OUTOFMEM "Out of memory.\n"
+
+extern const char * const outofmem;  /* OUTOFMEM */
+
+#endif
@@ -0,0 +1,32 @@
+/*********************/
+/* inplace.h         */
+/* for Par 3.20      */
+/*********************/
+
+
+/* parinplace() reformats a batch of files in place, in one process, */
+/* instead of par being run once per file with its output written   */
+/* to a temporary file and moved over the original by the caller.   */
+
+
+struct par_opts;
+
+
+int parinplace(char * const *files, int numfiles,
+               const struct par_opts *opts, int numworkers);
+
+  /* parinplace(files,numfiles,opts,numworkers) reformats each of the   */
+  /* numfiles files named in files[] according to opts, numworkers of   */
+  /* them at a time, each in a thread with a par_ctx of its own. A file */
+  /* is mapped into memory and reformatted as a whole, with the same    */
+  /* result as par would write given the file as input. If that is the  */
+  /* same as the file, the file is left alone, mtime and all. Otherwise */
+  /* the result is written to a new file in the same directory, with    */
+  /* the same permissions, which is then renamed over the original, so  */
+  /* that a reader of the file sees either all of the old contents or   */
+  /* all of the new. A symbolic link is followed, and the file it names */
+  /* is replaced. A file that can't be reformatted is left alone, its   */
+  /* error is reported on stderr, prefixed with its name, in the order  */
+  /* the files were given, and the rest are still reformatted. Returns  */
+  /* the number of files that could not be reformatted. Uses errmsg for */
+  /* any other failure.                                                 */
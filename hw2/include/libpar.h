@@ -0,0 +1,114 @@
+/*********************/
+/* libpar.h          */
+/* for Par 3.20      */
+/*********************/
+
+/* This is ANSI C code. */
+
+
+/* libpar reformats text in the calling process, the way the par  */
+/* command would if the text were its input. All of its state is  */
+/* kept in a par_ctx, so any number of contexts may be used at    */
+/* once, each by one thread at a time. It never calls exit(), and */
+/* keeps the message of its last error in the par_ctx, never in   */
+/* errmsg (see "errmsg.h") or any other global.                   */
+
+
+#include <stddef.h>
+
+
+struct par_quality {
+  int linepenalty,   /* Added to the badness of every line.          */
+      punctpenalty,  /* For a break after punctuation; usually < 0.  */
+      widowpenalty,  /* For a break leaving one word on a last line. */
+      shortpenalty,  /* For a last line shorter than a quarter of L. */
+      adjdemerits,   /* For adjacent lines of unlike tightness.      */
+      stretch;       /* Shortfall, as a percentage of L, at which a  */
+                     /*   line has badness 100.                      */
+};
+
+  /* A struct par_quality holds the parameters of the total-fit line */
+  /* breaking selected by --quality, which is described in           */
+  /* "par.doc".                                                      */
+
+
+struct par_opts {
+  int width, prefix, suffix, hang, last, min;
+  const struct par_quality *quality;
+  int utf8;
+};
+
+  /* The members of a struct par_opts other than quality are the     */
+  /* variables of the same name described in "par.doc". Any that is  */
+  /* negative is given its default value separately for each         */
+  /* paragraph, as par does when the corresponding option is not     */
+  /* given. If quality is not NULL, line breaks are chosen by        */
+  /* total fit with its parameters instead of the usual way, and min */
+  /* decides only the width the lines are padded to. If utf8 is      */
+  /* nonzero, the text is taken to be UTF-8, and words and lines are */
+  /* measured in columns rather than chars, as with --utf8.          */
+
+
+typedef struct par_ctx par_ctx;
+
+
+par_ctx *par_new(const struct par_opts *opts);
+
+  /* par_new(opts) returns a new context that reformats according to */
+  /* *opts, or with every value defaulted if opts is NULL. Returns   */
+  /* NULL if out of memory.                                          */
+
+
+int par_reformat(par_ctx *ctx, const char *text, size_t len,
+                 const char **pout, size_t *poutlen);
+
+  /* par_reformat(ctx,text,len,pout,poutlen) reformats the len chars  */
+  /* at text, which need not be '\0'-terminated, and sets *pout and   */
+  /* *poutlen to the output and its length. The output is owned by   */
+  /* ctx, and remains valid until the next call with ctx; the storage */
+  /* behind it is reused from call to call. Splitting the input after */
+  /* any blank line and reformatting the pieces in turn gives the     */
+  /* same output as reformatting it whole. Returns 0 on success. On   */
+  /* failure, returns -1, and *pout holds the output for the          */
+  /* paragraphs preceding the one that failed, as par would have      */
+  /* written before giving up.                                        */
+
+
+int par_reflow(par_ctx *ctx, const char *text, size_t len, size_t editend,
+               const char **pout, size_t *poutlen);
+
+  /* par_reflow(ctx,text,len,editend,pout,poutlen) is the same as        */
+  /* par_reformat(ctx,text,len,pout,poutlen), except that it keeps the   */
+  /* state of the line breaking in ctx, and reuses what was kept by the  */
+  /* previous call to par_reflow() with ctx for the words from text +    */
+  /* editend on. It is meant for reflowing a paragraph after each edit:  */
+  /* editend is the end of the edited region, after which text should    */
+  /* be the same as at the end of the text passed last time. The reused  */
+  /* state is checked, so the output is right even if it isn't, but the  */
+  /* time saved is then lost. State is kept for one paragraph only, the  */
+  /* last in text. The first call with ctx reuses nothing.               */
+
+
+void par_setopts(par_ctx *ctx, const struct par_opts *opts);
+
+  /* par_setopts(ctx,opts) makes ctx reformat according to *opts from */
+  /* now on, keeping the storage it has built up.                      */
+
+
+void par_lastopts(const par_ctx *ctx, struct par_opts *opts);
+
+  /* par_lastopts(ctx,opts) sets *opts to the values, defaults      */
+  /* included, used for the last paragraph reformatted with ctx, or */
+  /* to those passed to par_new() if there has been none.           */
+
+
+const char *par_error(const par_ctx *ctx);
+
+  /* par_error(ctx) returns the error message from the last call to */
+  /* par_reformat() with ctx, or NULL if that call succeeded. The   */
+  /* message ends with a newline.                                   */
+
+
+void par_free(par_ctx *ctx);
+
+  /* par_free(ctx) frees ctx and everything it owns. */
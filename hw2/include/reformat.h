@@ -8,13 +8,73 @@
 /* This is ANSI C code. */
 
 
-char **reformat(const char * const *inlines, int width,
-                int prefix, int suffix, int hang, int last, int min);
-
-  /* inlines is a NULL-terminated array of pointers to input lines. The     */
-  /* other parameters are the variables of the same name as described in    */
-  /* "par.doc". reformat(inlines,width,prefix,suffix,hang,last,min) returns */
-  /* a NULL-terminated array of pointers to output lines containing the     */
-  /* reformatted paragraph, according to the specification in "par.doc".    */
-  /* None of the integer parameters may be negative. reformat() uses errmsg */
-  /* (see "errmsg.h"), and returns NULL on failure.                         */
+#include "errmsg.h"
+
+struct buffer;
+struct par_quality;
+
+struct rfscratch {
+  void *wordblock;          /* Arrays for up to maxwords words, or NULL.  */
+  int maxwords;
+  const char **suffixes;    /* Pointers for up to maxlines lines, or NULL. */
+  int maxlines;
+  void *prev;               /* State kept for reflowing, or NULL.         */
+  void *nodes;              /* Nodes for up to maxnodes words, or NULL.   */
+  int maxnodes;
+};
+
+  /* A struct rfscratch holds storage that reformat() reuses from one */
+  /* paragraph to the next, and the state of the last paragraph that  */
+  /* was kept for reflowing. One whose members are all zero is empty. */
+  /* It may be passed to only one call of reformat() at a time.       */
+
+
+void reformat(struct buffer *out, struct rfscratch *scratch,
+              const char * const *inlines, const char * const *inends,
+              const char *unchanged, int width,
+              int prefix, int suffix, int hang, int last, int min,
+              const struct par_quality *quality, int utf8,
+              errmsg_t errmsg);
+
+  /* inlines is a NULL-terminated array of pointers to input lines, and   */
+  /* inends[i] points just past the last char of inlines[i], so the lines */
+  /* need not be '\0'-terminated. The integer parameters other than utf8  */
+  /* are the variables of the same name as described in "par.doc".        */
+  /* reformat(out,scratch,inlines,inends,unchanged,width,prefix,suffix,   */
+  /* hang,last,min,quality,utf8,errmsg) appends to *out, a buffer of     */
+  /* chars (see "buffer.h"), the lines of the reformatted paragraph,      */
+  /* each followed by '\n', according to the specification in            */
+  /* "par.doc". None of the integer parameters may be negative. errmsg    */
+  /* is set to "" on success, or to an error message on failure, in which */
+  /* case nothing is appended to *out. errmsg is not the global of        */
+  /* "errmsg.h", so reformat() may run in any number of threads at once.  */
+
+  /* If unchanged is not NULL, the paragraph is reflowed: its words, the   */
+  /* state of the line breaking, its text and its output are kept in       */
+  /* *scratch. Take the first line other than the first that starts at or  */
+  /* after unchanged: if it and the lines after it are the same as those   */
+  /* at the end of the last paragraph kept, they are not split into words  */
+  /* again, and their words reuse its state where it still holds, so that  */
+  /* only the words before them go through the passes of the line          */
+  /* breaking again. The output lines are then copied from the last        */
+  /* output, from the first one that starts at the same word as one of its */
+  /* lines, when their prefixes and suffixes are also the same. The cost   */
+  /* grows with the position of the edit rather than with the size of the  */
+  /* paragraph, apart from comparing the text with that kept and copying   */
+  /* the output. The output is the same either way.                        */
+
+  /* If quality is not NULL, the line breaks are chosen by total fit with */
+  /* the parameters in *quality (see "libpar.h") instead, min decides     */
+  /* only the width the lines are padded to, and nothing is reused or     */
+  /* kept for reflowing.                                                  */
+
+  /* If utf8 is nonzero, words and lines are measured by their width in   */
+  /* columns (see "width.h") rather than their length in chars. prefix    */
+  /* and suffix are still numbers of chars, each taken to be a column     */
+  /* wide.                                                                */
+
+
+void freescratch(struct rfscratch *scratch);
+
+  /* freescratch(scratch) frees the storage held by *scratch, */
+  /* leaving it empty.                                        */
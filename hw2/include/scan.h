@@ -0,0 +1,61 @@
+/*********************/
+/* scan.h            */
+/* for Par 3.20      */
+/*********************/
+
+/* This is ANSI C code. */
+
+
+/* These routines do the byte-by-byte scanning of the input: finding   */
+/* the white space between words, the text that is all ASCII, and the  */
+/* prefix and suffix common to the lines of a paragraph. Where the     */
+/* compiler targets SSE2 (or AVX2) they examine 16 (or 32) bytes at a  */
+/* time; otherwise, or if PAR_SCALAR is defined, they are the _scalar  */
+/* versions below, which are always available so that the two can be  */
+/* checked against each other. White space means what isspace() means */
+/* in the "C" locale, which par never changes. None of these routines  */
+/* reads outside the bytes it is given, and none uses errmsg.          */
+
+
+#include <stddef.h>
+
+
+const char *skipspace(const char *p, const char *end);
+
+  /* skipspace(p,end) returns a pointer to the first char in [p,end) */
+  /* that is not white space, or end if there is none.               */
+
+
+const char *skipword(const char *p, const char *end);
+
+  /* skipword(p,end) returns a pointer to the first char in [p,end) */
+  /* that is white space, or end if there is none.                  */
+
+
+const char *skipascii(const char *p, const char *end);
+
+  /* skipascii(p,end) returns a pointer to the first char in [p,end) */
+  /* that is not ASCII, that is, has its high bit set, or end if     */
+  /* there is none.                                                  */
+
+
+size_t commonprefix(const char *a, const char *b, size_t n);
+
+  /* commonprefix(a,b,n) returns the number of chars at the start of */
+  /* a[0..n) that are the same as those at the start of b[0..n).     */
+
+
+size_t commonsuffix(const char *a, const char *b, size_t n);
+
+  /* commonsuffix(a,b,n) returns the number of chars at the end of */
+  /* a[-n..0) that are the same as those at the end of b[-n..0);   */
+  /* that is, a and b point just past the chars compared.          */
+
+
+const char *skipspace_scalar(const char *p, const char *end);
+const char *skipword_scalar(const char *p, const char *end);
+const char *skipascii_scalar(const char *p, const char *end);
+size_t commonprefix_scalar(const char *a, const char *b, size_t n);
+size_t commonsuffix_scalar(const char *a, const char *b, size_t n);
+
+  /* The same, one byte at a time. */
@@ -0,0 +1,49 @@
+/*********************/
+/* serve.h           */
+/* for Par 3.20      */
+/*********************/
+
+
+/* parserve() makes par a daemon reformatting text for clients that */
+/* connect to a Unix domain socket, so that they need not start a   */
+/* process of their own for each piece of text.                     */
+/*                                                                  */
+/* A client may send any number of requests on a connection, each   */
+/* answered in turn on the same connection. All integers are 32     */
+/* bits, in network byte order. A request is the length of the text */
+/* to reformat, then the values of width, prefix, suffix, hang,     */
+/* last and min, then the text. A negative value stands for the one */
+/* the server was started with, which may itself be a default. The  */
+/* response is a status, 0 on success or 1 on failure, then the     */
+/* length of what follows, then the output, or on failure the error */
+/* message that par would have printed. A request must be sent in   */
+/* full within ten seconds of its first byte, and a response taken  */
+/* within ten seconds of when it is ready, or the connection is     */
+/* closed.                                                          */
+
+
+struct par_opts;
+
+
+#define MAXREQUEST (64 * 1024 * 1024)
+
+  /* The longest text a request may hold. A longer request gets */
+  /* an error response, after which the connection is closed.   */
+
+
+#define MAXHELD (4 * (size_t) MAXREQUEST)
+
+  /* The most chars of text and responses held for all clients at */
+  /* once. A request that would need more gets an error response, */
+  /* "Server busy.", after which the connection is closed.        */
+
+
+void parserve(const char *path, const struct par_opts *opts, int numworkers);
+
+  /* parserve(path,opts,numworkers) listens on a Unix domain socket  */
+  /* bound to path, and serves requests with numworkers threads,     */
+  /* each reusing a par_ctx of its own, until it is sent SIGINT or   */
+  /* SIGTERM. A stale socket at path is replaced, and path is        */
+  /* removed again on return. Connections with a request ready are   */
+  /* queued for the workers, and no more requests are read while the */
+  /* queue is full. Uses errmsg.                                     */
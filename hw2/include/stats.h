@@ -0,0 +1,96 @@
+/*********************/
+/* stats.h           */
+/* for Par 3.20      */
+/*********************/
+
+/* This is ANSI C code. */
+
+
+/* When par is compiled with PAR_STATS defined, it keeps a struct       */
+/* parstats for each thread, recording how long was spent in each phase */
+/* of reformatting and counting the work done, and par --stats prints   */
+/* the totals for all threads on exit. Otherwise the macros below       */
+/* expand to nothing, so that the ordinary build pays nothing for them. */
+
+
+enum parphase {
+  PHASE_READ,         /* Reading the input, and splitting it into       */
+                      /*   paragraphs and lines.                        */
+  PHASE_DEFAULTS,     /* setdefaults().                                 */
+  PHASE_WORDS,        /* Splitting the lines into words.                */
+  PHASE_BREAKS,       /* choosebreaks().                                */
+  PHASE_OUTPUT,       /* Constructing the output lines, and writing     */
+                      /*   them.                                        */
+  NUMPHASES
+};
+
+enum parpass {
+  PASS_SHORTEST,      /* maxshortestok(), per word examined.            */
+  PASS_LONGEST,       /* minlongestok(), per word examined.             */
+  PASS_SCORE,         /* The last pass, per tree node visited.          */
+  PASS_QUALITY,       /* qualitybreaks(), per line considered.          */
+  NUMPASSES
+};
+
+struct parstats {
+  double seconds[NUMPHASES];  /* Time spent in each phase.              */
+  double last;                /* When the phase under way began.        */
+  long paragraphs,            /* Paragraphs reformatted.                */
+       lines,                 /* Lines in those paragraphs.             */
+       words,                 /* Words in those paragraphs.             */
+       steps[NUMPASSES],      /* Inner-loop iterations of each pass     */
+                              /*   of choosing line breaks.             */
+       blocks,                /* Blocks allocated by struct buffers.    */
+       bytesin,               /* Chars passed to par_reformat() and     */
+       bytesout;              /*   par_reflow(), and chars returned.    */
+};
+
+
+#ifdef PAR_STATS
+
+#include <stdio.h>
+
+extern __thread struct parstats parstats;
+
+
+void statsstart(void);
+
+  /* statsstart() marks the start of a phase. */
+
+
+void statsphase(enum parphase phase);
+
+  /* statsphase(phase) charges the time since the start of the phase */
+  /* under way to phase, and marks the start of the next one.         */
+
+
+void statsmerge(void);
+
+  /* statsmerge() adds the calling thread's struct parstats to the */
+  /* totals for the process, and zeroes it. A thread must call it  */
+  /* before it exits, or its counts are lost. It is thread-safe.   */
+
+
+void statsreport(FILE *f);
+
+  /* statsreport(f) merges the calling thread's counts as statsmerge() */
+  /* does, and prints the totals to f, one per line. The times are     */
+  /* summed over threads, so with several workers they may add up to   */
+  /* more than the time par ran.                                       */
+
+
+#define STATS_START()         statsstart()
+#define STATS_PHASE(phase)    statsphase(phase)
+#define STATS_COUNT(field,n)  (parstats.field += (n))
+#define STATS_MERGE()         statsmerge()
+#define STATS_REPORT(f)       statsreport(f)
+
+#else
+
+#define STATS_START()         ((void) 0)
+#define STATS_PHASE(phase)    ((void) 0)
+#define STATS_COUNT(field,n)  ((void) 0)
+#define STATS_MERGE()         ((void) 0)
+#define STATS_REPORT(f)       ((void) 0)
+
+#endif
@@ -0,0 +1,37 @@
+/*********************/
+/* width.h           */
+/* for Par 3.20      */
+/*********************/
+
+
+/* With --utf8, words and lines are measured in the columns they take */
+/* on a terminal rather than in chars. The input is taken to be UTF-8: */
+/* a combining mark or other zero-width char takes no column, an East  */
+/* Asian wide or fullwidth char takes two, and any other char one, as */
+/* does each byte of an invalid sequence. So ASCII text is as wide as */
+/* it is long, just as without --utf8. None of these routines uses    */
+/* errmsg.                                                            */
+
+
+extern const unsigned char widthindex[1024], widthblocks[][64];
+
+  /* The table of widths, generated into "widthtab.c" by          */
+  /* tools/mkwidth.py. The width of code point c < 0x40000 is     */
+  /* held in bits 2(c%4) and 2(c%4)+1 of                          */
+  /* widthblocks[widthindex[c >> 8]][(c & 0xff) >> 2].            */
+
+
+int charwidth(long c);
+
+  /* charwidth(c) returns the width of code point c, which must be */
+  /* at most 0x10FFFF.                                             */
+
+
+const char *spanwidth(const char *p, const char *end, int max, int *pwidth);
+
+  /* spanwidth(p,end,max,pwidth) returns a pointer to the end of the   */
+  /* longest run of whole chars starting at p, and ending no later     */
+  /* than end, that is at most max columns wide, but always at least   */
+  /* one char if p < end. *pwidth is set to the width of the run. It   */
+  /* takes eight ASCII chars at a time, so a run of ASCII costs little */
+  /* more than finding its length. It never reads outside [p,end).     */
@@ -0,0 +1,46 @@
+/*********************/
+/* workqueue.h       */
+/* for Par 3.20      */
+/*********************/
+
+
+/* A struct workqueue runs a function on a sequence of items in a pool */
+/* of threads, and passes the items, in the order they were submitted, */
+/* to a second function running in a thread of its own.                */
+
+
+struct workqueue;
+
+
+struct workqueue *newworkqueue(int numworkers, int depth,
+                               void (*work)(void *item, int worker),
+                               int (*emit)(void *item, int failed));
+
+  /* newworkqueue(numworkers,depth,work,emit) returns a pointer to a    */
+  /* new struct workqueue with numworkers threads calling work() on     */
+  /* submitted items, and one thread calling emit() on each item after  */
+  /* work() has finished with it, in the order the items were           */
+  /* submitted. worker numbers the thread calling work() from 0 to      */
+  /* numworkers-1, so that work() can keep state for each thread. At    */
+  /* most depth items may be in the queue at once. emit returns nonzero */
+  /* to indicate failure; failed is nonzero if an earlier call to       */
+  /* emit() has failed, in which case emit() should merely dispose of   */
+  /* the item. emit may be NULL, in which case items are finished with  */
+  /* once work() returns, in any order, and depth bounds only the items */
+  /* not yet taken by a worker. numworkers and depth must be positive.  */
+  /* newworkqueue() uses errmsg, and returns NULL on failure.           */
+
+
+int submitwork(struct workqueue *wq, void *item);
+
+  /* submitwork(wq,item) adds item to the end of *wq, first waiting */
+  /* until there is room for it. Returns nonzero if a call to emit  */
+  /* has failed, in which case the caller may as well stop.         */
+
+
+int finishwork(struct workqueue *wq);
+
+  /* finishwork(wq) waits until every item submitted to *wq has been */
+  /* emitted, stops the threads, and frees the memory associated     */
+  /* with *wq, which may not be used after this call. Returns        */
+  /* nonzero if any call to emit() failed.                           */
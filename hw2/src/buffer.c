@@ -15,7 +15,7 @@
 
 #include "buffer.h"  /* Makes sure we're consistent with the */
                      /* prototypes. Also includes <stddef.h> */
-#include "errmsg.h"
+#include "stats.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -24,57 +24,47 @@
 #define NULL ((void *) 0)
 
 
-struct buffer {
-  struct block *firstblk, /* The first block.                    */
-               *current,  /* The last non-empty block, or        */
-                          /* firstblk if all are empty.          */
-               *nextblk;  /* The block containing the item to be */
-                          /* returned by nextitem(), or NULL.    */
-  int nextindex;          /* Index of item in nextblock->items.  */
-  size_t itemsize;        /* The size of an item.                */
-};
+/* The items are kept in a single contiguous region, which is */
+/* doubled in size whenever it fills up, so that adding n     */
+/* items costs O(n) time and O(log n) calls to realloc().     */
+/* The counts are size_t, so that a buffer can hold as many   */
+/* items as memory allows; growbuffer() fails rather than let */
+/* a count or a size in bytes overflow.                       */
 
-struct block {
-  struct block *next;  /* The next block, or NULL if none.              */
-  void *items;         /* Storage for the items in this block.          */
-  int maxhere,         /* Number of items that fit in *items.           */
-      numprevious,     /* Total of numhere for all previous blocks.     */
-      numhere;         /* The first numhere slots in *items are filled. */
+struct buffer {
+  void *items;        /* Storage for the items, or NULL if none.      */
+  size_t maxitems,    /* Number of items that fit in *items.          */
+         numitems,    /* The first numitems slots in *items are full. */
+         nextindex,   /* Index of the item to be returned by          */
+                      /* nextitem().                                  */
+         initmax,     /* Number of items to allocate room for first.  */
+         itemsize;    /* The size of an item.                         */
 };
 
 
 struct buffer *newbuffer(size_t itemsize)
 {
   struct buffer *buf;
-  struct block *blk;
   void *items;
-  int maxhere;
+  size_t maxitems;
 
-  maxhere = 124 / itemsize;
-  if (maxhere < 4) maxhere = 4;
+  maxitems = 124 / itemsize;
+  if (maxitems < 4) maxitems = 4;
 
   buf = (struct buffer *) malloc(sizeof (struct buffer));
-  blk = (struct block *) malloc(sizeof (struct block));
-  items = malloc(maxhere * itemsize);
-  if (!buf || !blk || !items) {
-    strcpy(err_msg,outofmem);
-    goto nberror;
-  }
+  items = malloc(maxitems * itemsize);
+  if (!buf || !items) goto nberror;
 
   buf->itemsize = itemsize;
-  buf->firstblk = buf->current = buf->nextblk = blk;
-  buf->nextindex = 0;
-  blk->next = NULL;
-  blk->numprevious = blk->numhere = 0;
-  blk->maxhere = maxhere;
-  blk->items = items;
+  buf->items = items;
+  buf->maxitems = buf->initmax = maxitems;
+  buf->numitems = buf->nextindex = 0;
+  STATS_COUNT(blocks, 1);
 
-  clear_error();
   return buf;
 
   nberror:
   if (buf) free(buf);
-  if (blk) free(blk);
   if (items) free(items);
   return NULL;
 }
@@ -82,128 +72,105 @@ struct buffer *newbuffer(size_t itemsize)
 
 void freebuffer(struct buffer *buf)
 {
-  struct block *blk, *tmp;
-
-  blk = buf->firstblk;
-  while (blk) {
-    tmp = blk;
-    blk = blk->next;
-    if (tmp->items) free(tmp->items);
-    free(tmp);
-  }
-
+  if (buf->items) free(buf->items);
   free(buf);
 }
 
 
 void clearbuffer(struct buffer *buf)
 {
-  struct block *blk;
-
-  for (blk = buf->firstblk;  blk;  blk = blk->next)
-    blk->numhere = 0;
-
-  buf->current = buf->firstblk;
+  buf->numitems = 0;
 }
 
 
-void additem(struct buffer *buf, const void *item)
+void *growbuffer(struct buffer *buf, size_t n)
 {
-  struct block *blk, *new;
   void *items;
-  int maxhere;
-  size_t itemsize = buf->itemsize;
-
-  blk = buf->current;
-
-  if (blk->numhere == blk->maxhere) {
-    new = blk->next;
-    if (!new) {
-      maxhere = 2 * blk->maxhere;
-      new = (struct block * ) malloc(sizeof (struct block));
-      items = malloc(maxhere * itemsize);
-      if (!new || !items) {
-        strcpy(err_msg,outofmem);
-        goto aierror;
-      }
-      blk->next = new;
-      new->next = NULL;
-      new->maxhere = maxhere;
-      new->numprevious = blk->numprevious + blk->numhere;
-      new->numhere = 0;
-      new->items = items;
-    }
-    blk = buf->current = new;
+  size_t maxitems, itemsize = buf->itemsize,
+         limit = (size_t) -1 / itemsize;  /* Most items whose size */
+                                          /* fits in a size_t.     */
+
+  if (n > buf->maxitems - buf->numitems) {
+    if (n > limit - buf->numitems) return NULL;
+    maxitems = buf->maxitems ? buf->maxitems : buf->initmax;
+    while (maxitems < buf->numitems + n)
+      maxitems = maxitems > limit / 2 ? limit : maxitems * 2;
+    items = realloc(buf->items, maxitems * itemsize);
+    if (!items) return NULL;
+    buf->items = items;
+    buf->maxitems = maxitems;
+    STATS_COUNT(blocks, 1);
   }
 
-  memcpy( ((char *) blk->items) + (blk->numhere * itemsize), item, itemsize );
+  items = ((char *) buf->items) + (buf->numitems * itemsize);
+  buf->numitems += n;
 
-  ++blk->numhere;
+  return items;
+}
 
-  clear_error();
-  return;
 
-  aierror:
-  if (new) free(new);
-  if (items) free(items);
+int additem(struct buffer *buf, const void *item)
+{
+  void *slot;
+
+  slot = growbuffer(buf, 1);
+  if (!slot) return -1;
+  memcpy(slot, item, buf->itemsize);
+  return 0;
+}
+
+
+void *bufferitems(struct buffer *buf)
+{
+  return buf->items;
 }
 
 
-int numitems(struct buffer *buf)
+size_t numitems(struct buffer *buf)
 {
-  struct block *blk = buf->current;
-  return blk->numprevious + blk->numhere;
+  return buf->numitems;
 }
 
 
 void *copyitems(struct buffer *buf)
 {
-  int n;
   void *r;
-  struct block *blk, *b;
-  size_t itemsize = buf->itemsize;
+  size_t size = buf->numitems * buf->itemsize;
 
-  b = buf->current;
-  n = b->numprevious + b->numhere;
-  if (!n) return NULL;
+  if (!size) return NULL;
 
-  r = malloc(n * itemsize);
-  if (!r) {
-    strcpy(err_msg,outofmem);
-    return NULL;
-  }
+  r = malloc(size);
+  if (!r) return NULL;
+
+  memcpy(r, buf->items, size);
+
+  return r;
+}
+
+
+void *detachitems(struct buffer *buf)
+{
+  void *r;
 
-  b = b->next;
+  if (!buf->numitems) return NULL;
 
-  for (blk = buf->firstblk;  blk != b;  blk = blk->next)
-    memcpy( ((char *) r) + (blk->numprevious * itemsize),
-            blk->items, blk->numhere * itemsize);
+  r = buf->items;
+  buf->items = NULL;
+  buf->maxitems = buf->numitems = buf->nextindex = 0;
 
-  clear_error();
   return r;
 }
 
 
 void rewindbuffer(struct buffer *buf)
 {
-  buf->nextblk = buf->firstblk;
   buf->nextindex = 0;
 }
 
 
 void *nextitem(struct buffer *buf)
 {
-  void *r;
-
-  if (!buf->nextblk || buf->nextindex >= buf->nextblk->numhere)
-    return NULL;
+  if (buf->nextindex >= buf->numitems) return NULL;
 
-  r = ((char *) buf->nextblk->items) + (buf->nextindex * buf->itemsize);
-
-  if (++buf->nextindex >= buf->nextblk->maxhere) {
-    buf->nextblk = buf->nextblk->next;
-    buf->nextindex = 0;
-  }
-
-  return r;
+  return ((char *) buf->items) + (buf->nextindex++ * buf->itemsize);
 }
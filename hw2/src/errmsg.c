@@ -13,9 +13,12 @@
 #include <stdlib.h>
 #include <string.h>
 
-static char* err_msg = NULL;
+static __thread char* err_msg = NULL;
 
-void clear_error() { free(err_msg); }
+void clear_error() {
+    free(err_msg);
+    err_msg = NULL;
+}
 
 void set_error(char * msg) { 
     clear_error();
@@ -27,6 +30,8 @@ int is_error() {
     else return 0;
 }
 
+const char *get_error() { return err_msg; }
+
 int report_error(FILE *file) {
     if(is_error() == 1) {
         fprintf(file, "%s", err_msg);
@@ -36,4 +41,4 @@ int report_error(FILE *file) {
     else return 1;
 }
 
-const char * const outofmem = "Out of memory.\n";
+const char * const outofmem = OUTOFMEM;
@@ -0,0 +1,249 @@
+/*********************/
+/* inplace.c         */
+/* for Par 3.20      */
+/*********************/
+
+
+#include "inplace.h"    /* Makes sure we're consistent with the prototypes. */
+#include "errmsg.h"
+#include "libpar.h"     /* Also includes <stddef.h>. */
+#include "workqueue.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#undef NULL
+#define NULL ((void *) 0)
+
+
+/* Each file is a struct ipjob handed to the workqueue. A worker does */
+/* all the work on a file, and the emitter only reports its error, if */
+/* any, so that errors come out in the order the files were given,    */
+/* whatever order the workers finish them in.                         */
+
+struct ipbatch {
+  par_ctx **ctxs;            /* ctxs[k] is the context for worker k.   */
+  int failures;              /* Files reported as not reformatted.     */
+};
+
+struct ipjob {
+  struct ipbatch *batch;
+  const char *path;          /* The file, as named by the caller.      */
+  char *err;                 /* Error message, or NULL if none.        */
+};
+
+
+static int writefull(int fd, const char *buf, size_t n)
+
+/* Writes the n chars at buf to fd. Returns 0 on success. */
+{
+  ssize_t r;
+
+  while (n) {
+    r = write(fd, buf, n);
+    if (r < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    buf += r;
+    n -= r;
+  }
+
+  return 0;
+}
+
+
+static void replacefile(const char *path, const struct stat *st,
+                        const char *text, size_t len)
+
+/* Replaces the contents of the file at path, whose status is *st,  */
+/* with the len chars at text, by writing them to a new file in the */
+/* same directory and renaming it to path. Uses errmsg.             */
+{
+  const char *base;
+  char *tmp, errbuf[96];
+  int fd, failed, err;
+
+  base = strrchr(path, '/');
+  base = base ? base + 1 : path;
+  tmp = malloc(strlen(path) + 12);
+  if (!tmp) {
+    set_error((char *) outofmem);
+    return;
+  }
+  sprintf(tmp, "%.*s.%s.parXXXXXX", (int) (base - path), path, base);
+
+  fd = mkstemp(tmp);
+  if (fd < 0) {
+    sprintf(errbuf, "Cannot create a file beside it: %.40s\n", strerror(errno));
+    set_error(errbuf);
+    free(tmp);
+    return;
+  }
+
+  failed = fchmod(fd, st->st_mode & 07777) || writefull(fd, text, len);
+  err = errno;
+  if (close(fd) && !failed) {
+    failed = 1;
+    err = errno;
+  }
+  if (!failed && rename(tmp, path)) {
+    failed = 1;
+    err = errno;
+  }
+
+  if (failed) {
+    unlink(tmp);
+    sprintf(errbuf, "Cannot write: %.40s\n", strerror(err));
+    set_error(errbuf);
+  }
+  else clear_error();
+
+  free(tmp);
+}
+
+
+static void reformatfile(void *item, int worker)
+
+/* Reformats the file of the struct ipjob item in place, */
+/* setting its err on failure.                           */
+{
+  struct ipjob *job = item;
+  par_ctx *ctx = job->batch->ctxs[worker];
+  struct stat st;
+  char *real, *text = NULL, errbuf[96];
+  const char *out;
+  size_t len = 0, outlen;
+  int fd = -1;
+
+/* Follow any symbolic link, so that the file */
+/* it names is replaced, and not the link:    */
+
+  real = realpath(job->path, NULL);
+  if (real) fd = open(real, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st)) {
+    sprintf(errbuf, "Cannot open: %.40s\n", strerror(errno));
+    set_error(errbuf);
+    goto rfcleanup;
+  }
+  if (!S_ISREG(st.st_mode)) {
+    set_error("Not a regular file.\n");
+    goto rfcleanup;
+  }
+
+/* An empty file reformats to nothing, so it is left alone: */
+
+  len = st.st_size;
+  if (!len) {
+    clear_error();
+    goto rfcleanup;
+  }
+  text = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (text == MAP_FAILED) {
+    text = NULL;
+    sprintf(errbuf, "Cannot read: %.40s\n", strerror(errno));
+    set_error(errbuf);
+    goto rfcleanup;
+  }
+
+  if (par_reformat(ctx, text, len, &out, &outlen))
+    set_error((char *) par_error(ctx));
+  else if (outlen != len || memcmp(out, text, len))
+    replacefile(real, &st, out, outlen);
+  else
+    clear_error();
+
+rfcleanup:
+
+  if (is_error()) {
+    job->err = strdup(get_error());
+    if (!job->err) job->err = (char *) outofmem;
+  }
+  if (text) munmap(text, len);
+  if (fd >= 0) close(fd);
+  free(real);
+}
+
+
+static int reportfile(void *item, int failed)
+
+/* Reports the error of the struct ipjob item, if */
+/* any, and frees it. Always returns 0.          */
+{
+  struct ipjob *job = item;
+
+  if (job->err) {
+    fprintf(stderr, "%.100s: %.163s", job->path, job->err);
+    ++job->batch->failures;
+    if (job->err != outofmem) free(job->err);
+  }
+
+  free(job);
+  return 0;
+}
+
+
+int parinplace(char * const *files, int numfiles,
+               const struct par_opts *opts, int numworkers)
+{
+  struct ipbatch batch;
+  struct workqueue *wq;
+  struct ipjob *job;
+  int k, i, nomem = 0;
+
+  if (numworkers > numfiles) numworkers = numfiles;
+  batch.failures = 0;
+  batch.ctxs = NULL;
+  if (!numworkers) goto ipdone;
+
+  batch.ctxs = calloc(numworkers, sizeof (par_ctx *));
+  if (!batch.ctxs) {
+    set_error((char *) outofmem);
+    return 0;
+  }
+  for (k = 0;  k < numworkers;  ++k) {
+    batch.ctxs[k] = par_new(opts);
+    if (!batch.ctxs[k]) {
+      set_error((char *) outofmem);
+      goto ipcleanup;
+    }
+  }
+
+  wq = newworkqueue(numworkers, 4 * numworkers, reformatfile, reportfile);
+  if (!wq) goto ipcleanup;
+
+  for (i = 0;  i < numfiles;  ++i) {
+    job = calloc(1, sizeof (struct ipjob));
+    if (!job) {
+      nomem = 1;
+      break;
+    }
+    job->batch = &batch;
+    job->path = files[i];
+    submitwork(wq, job);
+  }
+
+  finishwork(wq);
+
+  if (nomem) {
+    set_error((char *) outofmem);
+    goto ipcleanup;
+  }
+
+ipdone:
+
+  clear_error();
+
+ipcleanup:
+
+  if (batch.ctxs)
+    for (k = 0;  k < numworkers;  ++k) par_free(batch.ctxs[k]);
+  free(batch.ctxs);
+  return batch.failures;
+}
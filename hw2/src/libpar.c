@@ -0,0 +1,284 @@
+/*********************/
+/* libpar.c          */
+/* for Par 3.20      */
+/*********************/
+
+/* This is ANSI C code. */
+
+
+#include "libpar.h"    /* Makes sure we're consistent with the prototypes. */
+#include "buffer.h"
+#include "errmsg.h"
+#include "reformat.h"
+#include "scan.h"
+#include "stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#undef NULL
+#define NULL ((void *) 0)
+
+
+struct par_ctx {
+  struct par_opts opts;      /* As last passed to par_new() or         */
+                             /*   par_setopts().                       */
+  struct par_opts used;      /* As used for the last paragraph.        */
+  const char **lines;        /* Pointers to the starts and ends of the */
+  const char **ends;         /*   lines of a paragraph, with room for  */
+  int maxlines;              /*   maxlines of each.                    */
+  struct buffer *out;        /* The output, a buffer of chars.         */
+  struct rfscratch scratch;  /* Storage reused by reformat().          */
+  errmsg_t err;              /* Error message, or "" if none.          */
+};
+
+
+static void setdefaults(const char * const *inlines, const char * const *inends, int *pwidth, int *pprefix, int *psuffix, int *phang, int *plast, int *pmin) {
+ /* If any of *pwidth, *pprefix, *psuffix, *phang, *plast, *pmin are     */
+/* less than 0, sets them to default values based on inlines, which end */
+/* at inends, according to "par.doc". Always succeeds.                  */
+  int numlines;
+  size_t len, linelen;
+  const char *start, *end, * const *line, * const *lineend;
+
+  if (*pwidth < 0) *pwidth = 72;
+  if (*phang < 0) *phang = 0;
+  if (*plast < 0) *plast = 0;
+  if (*pmin < 0) *pmin = *plast;
+
+  for (line = inlines;  *line;  ++line);
+  numlines = line - inlines;
+
+  if (*pprefix < 0) {
+    if (numlines <= *phang + 1) {*pprefix = 0;}
+    else {
+      start = inlines[*phang];
+      len = inends[*phang] - start;
+      for (line = inlines + *phang + 1, lineend = inends + *phang + 1;  *line;  ++line, ++lineend) {
+        linelen = *lineend - *line;
+        len = commonprefix(start, *line, linelen < len ? linelen : len);
+      }
+      *pprefix = len;
+    }
+  }
+
+  if (*psuffix < 0) {
+    if (numlines <= 1) {*psuffix = 0;}
+    else {
+      end = *inends;
+      len = end - *inlines;
+      for (line = inlines + 1, lineend = inends + 1;  *line;  ++line, ++lineend) {
+        linelen = *lineend - *line;
+        len = commonsuffix(end, *lineend, linelen < len ? linelen : len);
+      }
+      start = end - len;
+      while (end - start >= 2 && isspace(*start) && isspace(start[1])) ++start;
+      *psuffix = end - start;
+    }
+  }
+}
+
+
+static void trimaffixes(const char * const *inlines,
+                        const char * const *inends, int hang,
+                        const struct par_opts *opts, int *pprefix,
+                        int *psuffix)
+/* Shortens the *pprefix and *psuffix chosen by setdefaults() for    */
+/* inlines, if they are defaults, so that neither splits a UTF-8     */
+/* char. The lines they are common to share the same bytes, so only  */
+/* one need be looked at.                                            */
+{
+  const char *end;
+
+  if (opts->prefix < 0 && *pprefix < inends[hang] - inlines[hang])
+    while (*pprefix && ((unsigned char) inlines[hang][*pprefix] & 0xC0) == 0x80)
+      --*pprefix;
+
+  if (opts->suffix < 0 && *psuffix) {
+    end = *inends;
+    while (*psuffix && ((unsigned char) end[-*psuffix] & 0xC0) == 0x80)
+      --*psuffix;
+  }
+}
+
+
+static int isblankline(const char *p, const char *end)
+/* Returns 1 if the chars from p up to end are all white. */
+{
+  return skipspace(p, end) == end;
+}
+
+
+static void reformatall(par_ctx *ctx, const char *text, size_t len,
+                        const char *unchanged)
+/* Reformats the len chars at text, appending the output to      */
+/* ctx->out. Each blank line is output as an empty line, and     */
+/* each run of other lines as a paragraph. The lines are passed  */
+/* to reformat() where they lie, by their starts and ends, so    */
+/* the text is never copied. unchanged is passed on to           */
+/* reformat() for the last paragraph, so that only it is kept.   */
+/* Sets ctx->err as reformat() sets errmsg.                      */
+{
+  const char *p = text, *end = p + len, *nl, *lineend, **lines, *final;
+  int numlines, maxlines, width, prefix, suffix, hang, last, min;
+  const struct par_opts *opts = &ctx->opts;
+
+  for (final = end;  final > text && isspace((unsigned char) final[-1]);  --final);
+
+  while (p < end) {
+    nl = memchr(p, '\n', end - p);
+    lineend = nl ? nl : end;
+
+    if (isblankline(p, lineend)) {
+      if (nl) {
+        if (additem(ctx->out, "\n")) {
+          strcpy(ctx->err, OUTOFMEM);
+          return;
+        }
+      }
+      p = nl ? nl + 1 : end;
+      continue;
+    }
+
+    for (numlines = 0;  ; ) {
+      if (numlines + 1 >= ctx->maxlines) {
+        maxlines = ctx->maxlines ? 2 * ctx->maxlines : 64;
+        lines = realloc(ctx->lines, maxlines * sizeof (char *));
+        if (!lines) {
+          strcpy(ctx->err, OUTOFMEM);
+          return;
+        }
+        ctx->lines = lines;
+        lines = realloc(ctx->ends, maxlines * sizeof (char *));
+        if (!lines) {
+          strcpy(ctx->err, OUTOFMEM);
+          return;
+        }
+        ctx->ends = lines;
+        ctx->maxlines = maxlines;
+      }
+      ctx->ends[numlines] = p + strnlen(p, lineend - p);  /* As if '\0' ended it. */
+      ctx->lines[numlines++] = p;
+      p = nl ? nl + 1 : end;
+      if (p == end) break;
+      nl = memchr(p, '\n', end - p);
+      lineend = nl ? nl : end;
+      if (isblankline(p, lineend)) break;
+    }
+    ctx->lines[numlines] = NULL;
+    STATS_COUNT(lines, numlines);
+    STATS_PHASE(PHASE_READ);
+
+    width = opts->width;  prefix = opts->prefix;  suffix = opts->suffix;
+    hang = opts->hang;  last = opts->last;  min = opts->min;
+    setdefaults(ctx->lines, ctx->ends, &width, &prefix, &suffix, &hang, &last, &min);
+    if (opts->utf8)
+      trimaffixes(ctx->lines, ctx->ends, hang, opts, &prefix, &suffix);
+    ctx->used.width = width;  ctx->used.prefix = prefix;  ctx->used.suffix = suffix;
+    ctx->used.hang = hang;  ctx->used.last = last;  ctx->used.min = min;
+    ctx->used.quality = opts->quality;
+    ctx->used.utf8 = opts->utf8;
+    STATS_PHASE(PHASE_DEFAULTS);
+
+    reformat(ctx->out, &ctx->scratch, ctx->lines, ctx->ends,
+             p >= final ? unchanged : NULL,
+             width, prefix, suffix, hang, last, min, opts->quality,
+             opts->utf8, ctx->err);
+    if (*ctx->err) return;
+    STATS_COUNT(paragraphs, 1);
+  }
+
+  STATS_PHASE(PHASE_READ);
+  *ctx->err = '\0';
+}
+
+
+par_ctx *par_new(const struct par_opts *opts)
+{
+  par_ctx *ctx;
+
+  ctx = calloc(1, sizeof (par_ctx));
+  if (!ctx) return NULL;
+
+  if (opts) ctx->opts = *opts;
+  else {
+    ctx->opts.width = ctx->opts.prefix = ctx->opts.suffix = -1;
+    ctx->opts.hang = ctx->opts.last = ctx->opts.min = -1;
+  }
+  ctx->used = ctx->opts;
+
+  ctx->out = newbuffer(sizeof (char));
+  if (!ctx->out) {
+    free(ctx);
+    return NULL;
+  }
+
+  return ctx;
+}
+
+
+static int reformattext(par_ctx *ctx, const char *text, size_t len,
+                        const size_t *editend,
+                        const char **pout, size_t *poutlen)
+/* Does the work of par_reformat() if editend is NULL, */
+/* or of par_reflow() with *editend otherwise.         */
+{
+  *ctx->err = '\0';
+  clearbuffer(ctx->out);
+  STATS_START();
+
+  reformatall(ctx, text, len,
+              editend ? text + (*editend < len ? *editend : len) : NULL);
+
+  *pout = bufferitems(ctx->out);
+  *poutlen = numitems(ctx->out);
+  STATS_COUNT(bytesin, len);
+  STATS_COUNT(bytesout, *poutlen);
+
+  return *ctx->err ? -1 : 0;
+}
+
+
+int par_reformat(par_ctx *ctx, const char *text, size_t len,
+                 const char **pout, size_t *poutlen)
+{
+  return reformattext(ctx, text, len, NULL, pout, poutlen);
+}
+
+
+int par_reflow(par_ctx *ctx, const char *text, size_t len, size_t editend,
+               const char **pout, size_t *poutlen)
+{
+  return reformattext(ctx, text, len, &editend, pout, poutlen);
+}
+
+
+void par_setopts(par_ctx *ctx, const struct par_opts *opts)
+{
+  ctx->opts = *opts;
+}
+
+
+void par_lastopts(const par_ctx *ctx, struct par_opts *opts)
+{
+  *opts = ctx->used;
+}
+
+
+const char *par_error(const par_ctx *ctx)
+{
+  return *ctx->err ? ctx->err : NULL;
+}
+
+
+void par_free(par_ctx *ctx)
+{
+  if (!ctx) return;
+
+  free(ctx->lines);
+  free(ctx->ends);
+  freebuffer(ctx->out);
+  freescratch(&ctx->scratch);
+  free(ctx);
+}
@@ -9,14 +9,21 @@
 
 
 #include "errmsg.h"
-#include "buffer.h"    /* Also includes <stddef.h>. */
-#include "reformat.h"
+#include "libpar.h"    /* Also includes <stddef.h>. */
+#include "workqueue.h"
+#include "scan.h"
+#include "inplace.h"
+#include "serve.h"
+#include "stats.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <errno.h>
 #include <getopt.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 #undef NULL
 #define NULL ((void *) 0)
@@ -70,9 +77,65 @@ static int strtoudec(const char *s, int *pn)
   return 1;
 }
 
-static void parse_opt_2(int *pwidth, int *pprefix, int *psuffix, int *phang, int *plast, int *pmin, int argc, char * const *argv) {
+static struct par_quality quality = { 10, -20, 150, 100, 1000, 25 };
 
-  const char* options = "w:p:s:h::l::m::";
+  /* The parameters for --quality, with their default values. */
+
+
+static void parsequality(const char *spec)
+
+/* Sets the members of quality named in spec, a comma-separated list */
+/* of name=value pairs. Uses errmsg.                                 */
+{
+  static const char * const names[] =
+    { "line", "punct", "widow", "short", "adjacent", "stretch", NULL };
+  int * const members[] = {
+    &quality.linepenalty, &quality.punctpenalty, &quality.widowpenalty,
+    &quality.shortpenalty, &quality.adjdemerits, &quality.stretch
+  };
+  const char *eq;
+  char *end, errbuf[176];
+  size_t len;
+  long value;
+  int k;
+
+  while (*spec) {
+    eq = strchr(spec, '=');
+    len = strcspn(spec, ",");
+    if (!eq || eq > spec + len) goto badspec;
+    for (k = 0;  names[k];  ++k)
+      if (eq - spec == (long) strlen(names[k])
+          && !strncmp(spec, names[k], eq - spec)) break;
+    if (!names[k]) goto badspec;
+    value = strtol(eq + 1, &end, 10);
+    if (end != spec + len || end == eq + 1 || value > 9999 || value < -9999
+        || (members[k] == &quality.stretch && value < 1)) goto badspec;
+    *members[k] = value;
+    spec += len;
+    if (*spec) ++spec;
+  }
+
+  clear_error();
+  return;
+
+badspec:
+
+  sprintf(errbuf, "Bad --quality setting: %.140s\n", spec);
+  set_error(errbuf);
+}
+
+
+static void parse_opt_2(int *pwidth, int *pprefix, int *psuffix, int *phang, int *plast, int *pmin, int *pjobs, int *pwindow, const char **pserve, const struct par_quality **pquality, int *putf8, int *pinplace, int *pstats, int *pfirstfile, int argc, char * const *argv)
+
+/* Parses the options in argv[1] through argv[argc-1], storing the values */
+/* given in the corresponding variables. Options given without their      */
+/* optional argument are taken to be 1, except --quality, which sets      */
+/* *pquality to point to quality, with any members its argument names     */
+/* changed. The arguments that are not options are left at the end of     */
+/* argv, from argv[*pfirstfile] on. There may be some only if             */
+/* pfirstfile is not NULL and --in-place has been given. Uses errmsg.     */
+{
+  const char* options = "w:p:s:h::l::m::j:W:";
 
   static struct option long_options[] = {
     {"version", no_argument, 0, 'v'},
@@ -84,42 +147,36 @@ static void parse_opt_2(int *pwidth, int *pprefix, int *psuffix, int *phang, int
     {"no-last", no_argument, 0, 'k'},
     {"min", no_argument, 0, 'M'},
     {"no-min", no_argument, 0, 'n'},
+    {"jobs", required_argument, 0, 'j'},
+    {"window", required_argument, 0, 'W'},
+    {"serve", required_argument, 0, 'S'},
+    {"quality", optional_argument, 0, 'Q'},
+    {"in-place", no_argument, 0, 'I'},
+    {"utf8", no_argument, 0, 'U'},
+    {"stats", no_argument, 0, 'T'},
     {0,0,0,0}
   };
 
-  int dummy = 0;
-  int option = getopt_long(argc, argv, options, long_options, NULL);
-  while (option != -1) {
+  int option, dummy = 0, *pn;
+  char errbuf[176];
+
+  optind = 0;
+  opterr = 0;
+  while ((option = getopt_long(argc, argv, options, long_options, NULL)) != -1) {
+      pn = NULL;
       switch(option) {
         case 'v':
-          sprintf("%s %s\n", progname, version);
+          printf("%s %s\n", progname, version);
           exit(EXIT_SUCCESS);
 
-        case 'w':
-          if(strtoudec(optarg, &dummy) == 0) {set_error("Bad option: %.149s\n");}
-          else *pwidth = dummy;
-          break;
-
-        case 'p':
-          if(strtoudec(optarg, &dummy) == 0) {set_error("Bad option: %.149s\n");}
-          else *pprefix = dummy;
-          break;
-        
-        case 's':
-          if(strtoudec(optarg, &dummy) == 0) {set_error("Bad option: %.149s\n");}
-          else *psuffix = dummy;
-          break;
-
-        case 'h':
-          if(strtoudec(optarg, &dummy) == 0) {set_error("Bad option: %.149s\n");}
-          else *phang = dummy;
-          break;
-
-        case 'l':
-          if(strtoudec(optarg, &dummy) == 0) {set_error("Bad option: %.149s\n");}
-          else *plast = dummy;
-          break;
-
+        case 'w':  pn = pwidth;   break;
+        case 'p':  pn = pprefix;  break;
+        case 's':  pn = psuffix;  break;
+        case 'h':  pn = phang;    break;
+        case 'l':  pn = plast;    break;
+        case 'm':  pn = pmin;     break;
+        case 'j':  pn = pjobs;    break;
+        case 'W':  pn = pwindow;  break;
 
         case 'L':
           *plast = 1;
@@ -129,11 +186,6 @@ static void parse_opt_2(int *pwidth, int *pprefix, int *psuffix, int *phang, int
           *plast = 0;
           break;
 
-        case 'm':
-          if(strtoudec(optarg, &dummy) == 0) {set_error("Bad option: %.149s\n");}
-          else *pmin = dummy;
-          break;
-
         case 'M':
           *pmin = 1;
           break;
@@ -141,212 +193,668 @@ static void parse_opt_2(int *pwidth, int *pprefix, int *psuffix, int *phang, int
         case 'n':
           *pmin = 0;
           break;
+
+        case 'S':
+          *pserve = optarg;
+          break;
+
+        case 'I':
+          *pinplace = 1;
+          break;
+
+        case 'U':
+          *putf8 = 1;
+          break;
+
+        case 'T':
+#ifdef PAR_STATS
+          *pstats = 1;
+          break;
+#else
+          set_error("--stats needs par compiled with PAR_STATS"
+                    " (make stats).\n");
+          return;
+#endif
+
+        case 'Q':
+          if (optarg) {
+            parsequality(optarg);
+            if (is_error()) return;
+          }
+          *pquality = &quality;
+          break;
+
+        default:
+          sprintf(errbuf, "Bad option: %.149s\n", argv[optind - 1]);
+          set_error(errbuf);
+          return;
       }
+      if (pn) {
+        if (!optarg) *pn = 1;
+        else if (strtoudec(optarg, &dummy)) *pn = dummy;
+        else {
+          sprintf(errbuf, "Bad option: %.149s\n", argv[optind - 1]);
+          set_error(errbuf);
+          return;
+        }
+      }
+  }
+
+  if (pfirstfile) *pfirstfile = optind;
+  if (optind < argc && (!pfirstfile || !*pinplace)) {
+    sprintf(errbuf, "Bad option: %.149s\n", argv[optind]);
+    set_error(errbuf);
+    return;
   }
+
+  clear_error();
 }
 
-static char **readlines(void) {
+/* The input is read with read() in large blocks into a struct input, */
+/* and handed to par_reformat() a chunk at a time. Each chunk ends    */
+/* just after a blank line (or at EOF), so reformatting the chunks in */
+/* turn gives the same output as reformatting the whole input. The    */
+/* block only needs to hold one chunk at a time; it is doubled when   */
+/* one doesn't fit.                                                   */
+
+#define INBUFSIZE 65536
+#define CHUNKSIZE 16384
 
-/* Reads lines from stdin until EOF, or until a blank line is encountered, */
-/* in which case the newline is pushed back onto the input stream. Returns */
-/* a NULL-terminated array of pointers to individual lines, stripped of    */
-/* their newline characters. Uses errmsg, and returns NULL on failure.     */
+struct input {
+  char *buf;        /* The input not yet consumed is in           */
+  size_t size,      /*   buf[start..end). buf has room for size   */
+         start,     /*   chars, and end < size always.            */
+         end;
+  int eof;          /* Nonzero once read() has returned 0.         */
+};
 
-  struct buffer *cbuf = NULL, *pbuf = NULL;
-  int c, blank;
-  char ch, *ln, *nullline = NULL, nullchar = '\0', **lines = NULL;
 
-  cbuf = newbuffer(sizeof (char));
-  if (is_error()) goto rlcleanup;
-  pbuf = newbuffer(sizeof (char *));
-  if (is_error()) goto rlcleanup;
+static size_t fillinput(struct input *in)
+
+/* Reads more input into in->buf, first moving the unconsumed input to  */
+/* the front, and doubling in->buf if it is still at least half full.   */
+/* Offsets from in->start remain valid. Returns the number of chars     */
+/* read, which is 0 at EOF. Uses errmsg, and returns 0 on failure.      */
+{
+  char *buf;
+  ssize_t n;
 
-  for (blank = 1;  ; ) {
-    c = getchar();
-    if (c == EOF) break;
-    if (c == '\n') {
-      if (blank) {
-        ungetc(c,stdin);
+  if (in->start) {
+    memmove(in->buf, in->buf + in->start, in->end - in->start);
+    in->end -= in->start;
+    in->start = 0;
+  }
+
+  if (2 * in->end >= in->size) {
+    buf = realloc(in->buf, 2 * in->size);
+    if (!buf) {
+      set_error((char *) outofmem);
+      return 0;
+    }
+    in->buf = buf;
+    in->size *= 2;
+  }
+
+  STATS_START();
+  do n = read(0, in->buf + in->end, in->size - in->end - 1);
+  while (n < 0 && errno == EINTR);
+  STATS_PHASE(PHASE_READ);
+
+  if (n < 0) {
+    set_error("Error reading input.\n");
+    return 0;
+  }
+
+  if (!n) in->eof = 1;
+  in->end += n;
+
+  clear_error();
+  return n;
+}
+
+
+static size_t cutpoint(const char *p, size_t avail, size_t maxlen)
+
+/* Returns the offset in p[0..avail) just after the last white space */
+/* char before p[maxlen], or else just after the first one after     */
+/* it, or 0 if there is none. maxlen < avail.                        */
+{
+  const char *q;
+
+  for (q = p + maxlen;  q > p;  --q)
+    if (isspace((unsigned char) q[-1])) return q - p;
+
+  q = skipword(p + maxlen, p + avail);
+  return q < p + avail ? q + 1 - p : 0;
+}
+
+
+static size_t nextchunk(struct input *in, size_t minlen, size_t maxlen,
+                        int *partial)
+
+/* Returns the length of the next chunk of input, which starts at       */
+/* in->buf + in->start and ends just after a blank line, or at EOF. The */
+/* chunk is at least minlen chars long if it can be made so without     */
+/* waiting for more input. Reads more input as needed, but consumes     */
+/* none. If maxlen is nonzero, the chunk is no longer than maxlen chars */
+/* if it can be made so by ending it after a blank line, or else after  */
+/* a line or word part way through the first paragraph, in which case   */
+/* *partial is set to 1 (and otherwise to 0). Uses errmsg, and returns  */
+/* 0 at EOF or on failure.                                              */
+{
+  size_t pos, scan, len = 0, avail;
+  char *p, *nl;
+
+  if (partial) *partial = 0;
+
+/* pos is the start of the current line, and scan is how far it */
+/* has been searched for a newline, both as offsets from        */
+/* in->start. len is the end of the last blank line so far:     */
+
+  for (pos = scan = 0;  ; ) {
+    p = in->buf + in->start;
+    avail = in->end - in->start;
+    nl = memchr(p + scan, '\n', avail - scan);
+    if (nl && skipspace(p + pos, nl) == nl) {
+      len = pos = scan = nl + 1 - p;
+      if (len >= minlen) break;
+      continue;
+    }
+    if (maxlen && (nl ? (size_t) (nl + 1 - p) : avail) > maxlen) {
+      if (len) break;
+      len = pos ? pos : cutpoint(p, avail, maxlen);
+      if (len) {
+        *partial = 1;
         break;
       }
-      additem(cbuf, &nullchar);
-      if(is_error()) goto rlcleanup;
-      ln = copyitems(cbuf);
-      if(is_error()) goto rlcleanup;
-      additem(pbuf, &ln);
-      if(is_error()) goto rlcleanup;
-      clearbuffer(cbuf);
-      blank = 1;
     }
-    else {
-      if (!isspace(c)) blank = 0;
-      ch = c;
-      additem(cbuf, &ch);
-      if (is_error()) goto rlcleanup;
+    if (!nl) {
+      if (in->eof || len) break;
+      scan = avail;
+      fillinput(in);
+      if (is_error()) return 0;
+      continue;
     }
+    pos = scan = nl + 1 - p;
   }
 
-  if (!blank) {
-    additem(cbuf, &nullchar);
-    if(is_error()) goto rlcleanup;
-    ln = copyitems(cbuf);
-    if(is_error()) goto rlcleanup;
-    additem(pbuf, &ln);
-    if(is_error()) goto rlcleanup;
+  clear_error();
+  return in->eof && !len ? in->end - in->start : len;
+}
+
+
+/* The output is written with writev(), bypassing stdio. A struct      */
+/* output queues the pieces to be written, and writes them all in one  */
+/* call once OUTVECS pieces or OUTBATCH chars are queued, or as soon   */
+/* as a piece is queued that won't stay where it is. A piece may be    */
+/* owned by the queue, and is then freed once written. When the output */
+/* is a terminal, each piece is written as soon as it's queued. Once a */
+/* write has failed, the rest of the output is discarded.              */
+
+#define OUTVECS  64
+#define OUTBATCH 262144
+
+struct output {
+  struct iovec vec[OUTVECS];  /* The pieces queued, numvecs of them,    */
+  void *owned[OUTVECS];       /*   and what to free once each is        */
+  int numvecs;                /*   written, or NULL.                    */
+  size_t pending;             /* The total length of the pieces.        */
+  int eager,                  /* Nonzero if the output is a terminal.   */
+      failed;                 /* Nonzero once a write has failed.       */
+};
+
+
+static int flushoutput(struct output *o)
+
+/* Writes the pieces queued in o, and frees those owned by it. */
+/* Returns 0 on success, -1 if this or any earlier write to o  */
+/* has failed.                                                 */
+{
+  struct iovec *v = o->vec;
+  int n = o->numvecs, k;
+  ssize_t r;
+
+  STATS_START();
+  while (n && !o->failed) {
+    r = writev(1, v, n);
+    if (r < 0) {
+      if (errno != EINTR) o->failed = 1;
+      continue;
+    }
+    for ( ;  n && (size_t) r >= v->iov_len;  --n, ++v) r -= v->iov_len;
+    if (n) {
+      v->iov_base = (char *) v->iov_base + r;
+      v->iov_len -= r;
+    }
   }
+  STATS_PHASE(PHASE_OUTPUT);
+
+  for (k = 0;  k < o->numvecs;  ++k) free(o->owned[k]);
+  o->numvecs = 0;
+  o->pending = 0;
 
-  additem(pbuf, &nullline);
-  if(is_error()) goto rlcleanup;
-  lines = copyitems(pbuf);
+  return o->failed ? -1 : 0;
+}
 
-rlcleanup:
 
-  if (cbuf) freebuffer(cbuf);
-  if (pbuf) {
-    if (!lines) {
-      for (;;) {
-        lines = nextitem(pbuf);
-        if (!lines) break;
-        free(*lines);
-      }
+static int putoutput(struct output *o, const char *p, size_t len,
+                     void *owned)
+
+/* Queues the len chars at p to be written to o. If owned is not  */
+/* NULL, o frees it once they are written, and p must stay valid  */
+/* until then. Otherwise p need only stay valid until putoutput() */
+/* returns, so everything queued is written before it does.       */
+/* Returns as flushoutput() does.                                 */
+{
+  o->vec[o->numvecs].iov_base = (char *) p;
+  o->vec[o->numvecs].iov_len = len;
+  o->owned[o->numvecs++] = owned;
+  o->pending += len;
+
+  if (!owned || o->eager || o->numvecs == OUTVECS || o->pending >= OUTBATCH)
+    return flushoutput(o);
+  return o->failed ? -1 : 0;
+}
+
+
+/* With W<window>, a paragraph longer than the window is reformatted  */
+/* a window at a time. The last lines of the output for each window,  */
+/* amounting to about a quarter of it, are not written but carried    */
+/* back to the front of the next window, and reformatted again along  */
+/* with the input that follows them. So every line written was chosen */
+/* looking at least that far ahead, but no further: the line breaks   */
+/* are no longer the best for the paragraph as a whole, and defaults  */
+/* are computed from the first window alone, which may hold just one  */
+/* line, or only part of one. In return, only a window of input and   */
+/* output is held at a time, and output begins before the end of the  */
+/* paragraph is read.                                                 */
+
+static size_t carrypoint(const char *out, size_t outlen, size_t lookahead)
+
+/* Returns the offset in out of the first line to be carried into the */
+/* next window: the last lines of out that fit in lookahead chars are */
+/* carried, but always at least one, and all of them only if there is */
+/* just one.                                                          */
+{
+  size_t cut = outlen, start;
+
+  while (cut) {
+    start = cut - 1;
+    while (start && out[start - 1] != '\n') --start;
+    if (cut < outlen && (!start || outlen - start > lookahead)) break;
+    cut = start;
+  }
+
+  return cut;
+}
+
+
+static int reserve(char **pbuf, size_t *psize, size_t n)
+
+/* Makes *pbuf, which has room for *psize chars, big enough */
+/* for n chars. Returns 1 on success. Uses errmsg.          */
+{
+  char *buf;
+
+  if (n > *psize) {
+    buf = realloc(*pbuf, 2 * n);
+    if (!buf) {
+      set_error((char *) outofmem);
+      return 0;
     }
-      freebuffer(pbuf);
+    *pbuf = buf;
+    *psize = 2 * n;
   }
 
-  return lines;
+  clear_error();
+  return 1;
 }
 
 
-static void setdefaults(const char * const *inlines, int *pwidth, int *pprefix, int *psuffix, int *phang, int *plast, int *pmin) {
- /* If any of *pwidth, *pprefix, *psuffix, *phang, *plast, *pmin are     */
-/* less than 0, sets them to default values based on inlines, according */
-/* to "par.doc". Does not use errmsg because it always succeeds.        */
-  int numlines;
-  const char *start, *end, * const *line, *p1, *p2;
-
-  if (*pwidth < 0) *pwidth = 72;
-  if (*phang < 0) *phang = 0;
-  if (*plast < 0) *plast = 0;
-  if (*pmin < 0) *pmin = *plast;
-
-  for (line = inlines;  *line;  ++line);
-  numlines = line - inlines;
-
-  if (*pprefix < 0) {
-    if (numlines <= *phang + 1) {*pprefix = 0;}
-    else {
-      start = inlines[*phang];
-      for (end = start;  *end;  ++end);
-      for (line = inlines + *phang + 1;  *line;  ++line) {
-        for (p1 = start, p2 = *line;  p1 < end && *p1 == *p2;  ++p1, ++p2);
-        end = p1;
+static void windowed(struct input *in, struct output *o,
+                     const struct par_opts *opts, size_t window)
+
+/* Reformats the input from in to o according to opts, a window of */
+/* about window chars at a time, as described above. Uses errmsg.  */
+{
+  par_ctx *ctx, *wctx = NULL, *cur;
+  struct par_opts wopts;
+  char *carry = NULL, *suf = NULL;
+  const char *text, *out;
+  size_t len, outlen, carrylen = 0, carrysize = 0, sufsize = 0, cut, pad;
+  int partial, midline;
+
+  ctx = par_new(opts);
+  if (!ctx) {
+    set_error((char *) outofmem);
+    return;
+  }
+
+/* While a paragraph is being reformatted a window at a time, wctx */
+/* is a context reformatting with the values found for its first   */
+/* window, so that the prefix and suffix stay the same throughout, */
+/* and the next chunk ends at the end of the paragraph if it can:  */
+
+  for (;;) {
+    len = nextchunk(in, wctx ? 1 : CHUNKSIZE, window, &partial);
+    if (is_error() || !len) break;
+
+    text = in->buf + in->start;
+    in->start += len;
+    midline = partial && text[len - 1] != '\n';
+    pad = wctx ? wopts.suffix : opts->suffix > 0 ? opts->suffix : 0;
+    if (carrylen || midline) {
+      if (!reserve(&carry, &carrysize, carrylen + len + pad + 1)) break;
+      memcpy(carry + carrylen, text, len);
+      text = carry;
+      len += carrylen;
+    }
+
+/* A line cut short by the window has no suffix of its own, so it */
+/* is given the one kept from the last line carried (or in the    */
+/* first window, spaces), lest its last chars be taken for one:   */
+
+    if (midline) {
+      if (wctx) memcpy(carry + len, suf, pad);
+      else memset(carry + len, ' ', pad);
+      len += pad;
+      carry[len++] = '\n';
+    }
+
+    cur = wctx ? wctx : ctx;
+    if (par_reformat(cur, text, len, &out, &outlen)) {
+      putoutput(o, out, outlen, NULL);
+      set_error((char *) par_error(cur));
+      break;
+    }
+
+    cut = partial ? carrypoint(out, outlen, window / 4) : outlen;
+    if (putoutput(o, out, cut, NULL)) break;
+    carrylen = outlen - cut;
+    if (!reserve(&carry, &carrysize, carrylen)) break;
+    memcpy(carry, out + cut, carrylen);
+
+    if (partial && !wctx) {
+      par_lastopts(ctx, &wopts);
+      wctx = par_new(&wopts);
+      if (!wctx) {
+        set_error((char *) outofmem);
+        break;
       }
-      *pprefix = end - start;
     }
-  }
+    else if (!partial && wctx) {
+      par_free(wctx);
+      wctx = NULL;
+    }
+
+/* The suffix of the last line carried is kept for a line cut short  */
+/* by the next window. If this window ended part way through a line, */
+/* the rest of the line is joined to that line, minus its suffix:    */
 
-  if (*psuffix < 0) {
-    if (numlines <= 1) {*psuffix = 0;}
-    else {
-      start = *inlines;
-      for (end = start;  *end;  ++end);
-      for (line = inlines + 1;  *line;  ++line) {
-        for (p2 = *line;  *p2;  ++p2);
-        for (p1 = end;
-             p1 > start && p2 > *line && p1[-1] == p2[-1];
-             --p1, --p2);
-        start = p1;
+    if (wctx && carrylen) {
+      if (!reserve(&suf, &sufsize, wopts.suffix)) break;
+      memcpy(suf, carry + carrylen - 1 - wopts.suffix, wopts.suffix);
+      if (midline) {
+        carrylen -= 1 + wopts.suffix;
+        carry[carrylen++] = ' ';
       }
-      while (end - start >= 2 && isspace(*start) && isspace(start[1])) ++start;
-      *psuffix = end - start;
     }
   }
+
+  par_free(ctx);
+  par_free(wctx);
+  free(carry);
+  free(suf);
 }
 
 
-static void freelines(char **lines)
-/* Frees the strings pointed to in the NULL-terminated array lines, then */
-/* frees the array. Does not use errmsg because it always succeeds.      */
+/* With -j N, chunks are reformatted by N worker threads, each with a */
+/* par_ctx of its own, while the main thread reads ahead. Each chunk  */
+/* is copied out of the input block into a struct parjob, and the     */
+/* jobs are written out in input order by the workqueue's emitter     */
+/* thread, so the output is the same as without -j. The emitter hands */
+/* the output of each job over to the struct output, so that the      */
+/* output of many jobs is written by one writev().                    */
+
+struct parjob {
+  par_ctx * const *ctxs;  /* ctxs[k] is the context for worker k.      */
+  struct output *output;  /* Where the output is to be written.        */
+  char *text;             /* The chunk to reformat.                    */
+  size_t len;             /* Length of *text.                          */
+  char *out;              /* The output, or NULL if there is none.     */
+  size_t outlen;          /* Length of *out.                           */
+  char *err;              /* Error message, or NULL if none.           */
+};
+
+
+static void freejob(struct parjob *job)
+/* Frees *job and everything it points to. */
 {
-  char **line;
+  free(job->text);
+  free(job->out);
+  free(job->err);
+  free(job);
+}
+
 
-  for (line = lines;  *line;  ++line)
-    free(*line);
+static void reformatjob(void *item, int worker)
+/* Reformats the chunk of the struct parjob item, setting its */
+/* out and outlen, and err on failure.                        */
+{
+  struct parjob *job = item;
+  par_ctx *ctx = job->ctxs[worker];
+  const char *out;
+  int failed;
+
+  failed = par_reformat(ctx, job->text, job->len, &out, &job->outlen);
+
+  if (job->outlen) {
+    job->out = malloc(job->outlen);
+    if (!job->out) {
+      job->err = strdup(outofmem);
+      return;
+    }
+    memcpy(job->out, out, job->outlen);
+  }
 
-  free(lines);
+  if (failed) {
+    job->err = strdup(par_error(ctx));
+    if (!job->err) job->err = strdup(outofmem);
+  }
+}
+
+
+static int emitjob(void *item, int failed)
+/* Writes out the struct parjob item and frees it. Returns  */
+/* nonzero if it holds an error, which is then reported.    */
+/* If failed is nonzero, the item is freed without writing. */
+{
+  struct parjob *job = item;
+
+  if (!failed) {
+    if (job->out) putoutput(job->output, job->out, job->outlen, job->out);
+    job->out = NULL;
+    if (job->err) {
+      flushoutput(job->output);
+      fprintf(stderr, "%.163s", job->err);
+      failed = 1;
+    }
+  }
+
+  freejob(job);
+  return failed;
+}
+
+
+static int pipelined(struct input *in, struct output *o,
+                     const struct par_opts *opts, int jobs)
+
+/* Reformats the input from in to o according to opts using the    */
+/* given number of worker threads. Returns nonzero if an error has */
+/* been reported already. Uses errmsg.                             */
+{
+  struct workqueue *wq;
+  struct parjob *job;
+  par_ctx **ctxs;
+  size_t len;
+  int k, reported;
+
+  ctxs = calloc(jobs, sizeof (par_ctx *));
+  if (!ctxs) {
+    set_error((char *) outofmem);
+    return 0;
+  }
+  for (k = 0;  k < jobs;  ++k) {
+    ctxs[k] = par_new(opts);
+    if (!ctxs[k]) {
+      set_error((char *) outofmem);
+      goto plcleanup;
+    }
+  }
+
+  wq = newworkqueue(jobs, 4 * jobs, reformatjob, emitjob);
+  if (!wq) goto plcleanup;
+
+  for (;;) {
+    len = nextchunk(in, CHUNKSIZE, 0, NULL);
+    if (is_error() || !len) break;
+
+    job = calloc(1, sizeof (struct parjob));
+    if (job) job->text = malloc(len);
+    if (!job || !job->text) {
+      free(job);
+      set_error((char *) outofmem);
+      break;
+    }
+    memcpy(job->text, in->buf + in->start, len);
+    job->len = len;
+    job->ctxs = ctxs;
+    job->output = o;
+    in->start += len;
+    if (submitwork(wq, job)) break;
+  }
+
+  reported = finishwork(wq);
+
+  for (k = 0;  k < jobs;  ++k) par_free(ctxs[k]);
+  free(ctxs);
+  return reported;
+
+plcleanup:
+
+  for (k = 0;  k < jobs;  ++k) par_free(ctxs[k]);
+  free(ctxs);
+  return 0;
 }
 
 
 int original_main(int argc, char * const *argv) {
-  int width, widthbak = -1, prefix, prefixbak = -1, suffix, suffixbak = -1, hang, hangbak = -1, last, lastbak = -1, min, minbak = -1, c;
-  char *parinit, *picopy = NULL, *opt, **inlines = NULL, **outlines = NULL, **line;
+  int jobs = 0, window = 0, inplace = 0, stats = 0, firstfile, piargc, reported = 0;
+  char *parinit, *picopy = NULL, **piargv = NULL;
+  const char *serve = NULL;
+  struct par_opts opts = { -1, -1, -1, -1, -1, -1, NULL, 0 };
+  par_ctx *ctx = NULL;
+  struct input in;
+  struct output output;
+  const char *out;
+  size_t len, outlen;
   const char * const whitechars = " \f\n\r\t\v";
 
+  in.buf = NULL;
+  output.numvecs = output.failed = 0;
+  output.pending = 0;
+  output.eager = isatty(1);
+
   parinit = getenv("PARINIT");
   if (parinit) {
     picopy = malloc((strlen(parinit) + 1) * sizeof (char));
-    if (!picopy) {
-      strcpy(err_msg,outofmem);
+    piargv = malloc((strlen(parinit) / 2 + 3) * sizeof (char *));
+    if (!picopy || !piargv) {
+      set_error((char *) outofmem);
       goto parcleanup;
     }
     strcpy(picopy,parinit);
-    opt = strtok(picopy,whitechars);
-    while (opt) {
-      parse_opt_2(&widthbak, &prefixbak, &suffixbak, &hangbak, &lastbak, &minbak, argc, argv);
-      if(is_error()) goto parcleanup;
-      opt = strtok(NULL,whitechars);
-    }
+    piargv[0] = (char *) progname;
+    piargc = 1;
+    for (piargv[piargc] = strtok(picopy,whitechars);  piargv[piargc];
+         piargv[piargc] = strtok(NULL,whitechars))
+      ++piargc;
+    parse_opt_2(&opts.width, &opts.prefix, &opts.suffix, &opts.hang, &opts.last, &opts.min, &jobs, &window, &serve, &opts.quality, &opts.utf8, &inplace, &stats, NULL, piargc, piargv);
+    if(is_error()) goto parcleanup;
     free(picopy);
+    free(piargv);
     picopy = NULL;
+    piargv = NULL;
   }
 
-  while (*++argv) {
-    parse_opt_2(&widthbak, &prefixbak, &suffixbak, &hangbak, &lastbak, &minbak, argc, argv);
-    if(is_error()) goto parcleanup;
+  parse_opt_2(&opts.width, &opts.prefix, &opts.suffix, &opts.hang, &opts.last, &opts.min, &jobs, &window, &serve, &opts.quality, &opts.utf8, &inplace, &stats, &firstfile, argc, argv);
+  if(is_error()) goto parcleanup;
+
+  if (serve) {
+    parserve(serve, &opts, jobs ? jobs : 4);
+    goto parcleanup;
   }
 
-  for (;;) {
-    for (;;) {
-      c = getchar();
-      if (c != '\n') break;
-      putchar(c);
-    }
-    if (c == EOF) break;
-    ungetc(c,stdin);
+  if (inplace) {
+    reported = parinplace(argv + firstfile, argc - firstfile, &opts,
+                          jobs ? jobs : 4);
+    goto parcleanup;
+  }
 
-    inlines = readlines();
-    if(is_error()) goto parcleanup;
-    if (!*inlines) {
-      free(inlines);
-      inlines = NULL;
-      continue;
-    }
+  in.buf = malloc(INBUFSIZE);
+  if (!in.buf) {
+    set_error((char *) outofmem);
+    goto parcleanup;
+  }
+  in.size = INBUFSIZE;
+  in.start = in.end = 0;
+  in.eof = 0;
 
-    width = widthbak;  prefix = prefixbak;  suffix = suffixbak;
-    hang = hangbak;  last = lastbak;  min = minbak;
-    setdefaults((const char * const *) inlines, &width, &prefix, &suffix, &hang, &last, &min);
+  if (window) {
+    windowed(&in, &output, &opts, window * 1024);
+    goto parcleanup;
+  }
 
-    outlines = reformat((const char * const *) inlines, width, prefix, suffix, hang, last, min);
-    if(is_error()) goto parcleanup;
+  if (jobs > 1) {
+    reported = pipelined(&in, &output, &opts, jobs);
+    goto parcleanup;
+  }
 
-    freelines(inlines);
-    inlines = NULL;
+  ctx = par_new(&opts);
+  if (!ctx) {
+    set_error((char *) outofmem);
+    goto parcleanup;
+  }
 
-    for (line = outlines;  *line;  ++line)
-      puts(*line);
+  for (;;) {
+    len = nextchunk(&in, CHUNKSIZE, 0, NULL);
+    if (is_error() || !len) break;
 
-    freelines(outlines);
-    outlines = NULL;
+    if (par_reformat(ctx, in.buf + in.start, len, &out, &outlen)) {
+      putoutput(&output, out, outlen, NULL);
+      set_error((char *) par_error(ctx));
+      break;
+    }
+    if (putoutput(&output, out, outlen, NULL)) break;
+    in.start += len;
   }
 
 parcleanup:
 
   if (picopy) free(picopy);
-  if (inlines) freelines(inlines);
-  if (outlines) freelines(outlines);
+  if (piargv) free(piargv);
+  if (in.buf) free(in.buf);
+  par_free(ctx);
+
+  if (flushoutput(&output) && !is_error() && !reported)
+    set_error("Error writing output.\n");
+
+  if (stats) STATS_REPORT(stderr);
+
+  if (reported) exit(EXIT_FAILURE);
 
   if(is_error()) {
-    fprintf(stderr, "%.163s", err_msg);
+    report_error(stderr);
     exit(EXIT_FAILURE);
   }
 
@@ -11,6 +11,10 @@
 #include "reformat.h"  /* Makes sure we're consistent with the prototype. */
 #include "buffer.h"    /* Also includes <stddef.h>.                       */
 #include "errmsg.h"
+#include "libpar.h"    /* For struct par_quality.                         */
+#include "scan.h"
+#include "stats.h"
+#include "width.h"
 
 #include <stdlib.h>
 #include <ctype.h>
@@ -21,288 +25,1161 @@
 #define NULL ((void *) 0)
 
 
-struct word {
-  const char *chrs;       /* Pointer to the characters in the word */
-                          /* (NOT terminated by '\0').             */
-  struct word *prev,      /* Pointer to previous word.             */
-              *next,      /* Pointer to next word.                 */
-                          /* Supposing this word were the first... */
-              *nextline;  /*   Pointer to first word in next line. */
-  int linelen,            /*   Length of the first line.           */
-      score,              /*   Value of objective function.        */
-      length;             /* Length of this word.                  */
+struct words {
+  int n;                  /* Number of words.                        */
+  const char *end;        /* End of the last line of the paragraph.  */
+  long *back;             /* back[k] is the number of chars from the */
+                          /* start of word k to end.                 */
+  int *length;            /* length[k] is the length of word k, or   */
+                          /* with utf8, its width.                   */
+  int *size;              /* size[k] is the number of chars in it.   */
+  long *pos;              /* pos[k] is described below.              */
+                          /* Supposing word k were the first...      */
+  int *linewords,         /*   Number of words in the first line.    */
+      *linelen;           /*   Length of the first line.             */
+  long *score;            /*   Value of objective function.          */
+  int *good,              /* Scratch space for choosebreaks().       */
+      *instack, *outstack, *incand, *outcand;
+  long *outlog;
+  int *shortgood[2],      /* The good[] arrays of the feasibility    */
+      *longgood[2];       /*   tests, kept for reflowing (below).    */
+  int L, last, min,       /* Parameters the words were broken with,  */
+      shortest, newL;     /*   and the results of the first passes.  */
 };
 
+/* All the arrays of a struct words are carved out of one block,  */
+/* which is kept in a struct rfscratch and reused by the next     */
+/* paragraph if it is big enough. pos[k] is minus the number of   */
+/* characters from word k to the end when the words are           */
+/* separated by single spaces, less one, so that a line holding   */
+/* words i through j-1 has length pos[j] - pos[i] - 1, and pos[n] */
+/* is 0. Every window of words that can start the line after      */
+/* word i is then a range of indices whose ends move toward the   */
+/* front as i does, which lets each pass of choosebreaks() run    */
+/* in a single sweep.                                             */
 
-static int choosebreaks(
-  struct word *head, struct word *tail, int L, int last, int min
+/* Each sweep runs from the last word toward the first, and what */
+/* it computes for word k depends only on the lengths of words k */
+/* through n-1. So when a paragraph is reflowed after an edit,   */
+/* the results for the words following the edit still hold, and  */
+/* only the words up to the edit need to be swept again. Nothing */
+/* kept for word k depends on k itself, only on the words after  */
+/* it, and each array ends at the end of its part of the block   */
+/* whatever n is, so the results for the words after the edit    */
+/* stay where they are, and are neither copied nor moved.        */
+
+/* A struct rfprev keeps the last paragraph reformatted with      */
+/* unchanged set: its words, and copies of its text and its       */
+/* output, with the bounds of its input and output lines. Each is */
+/* kept at the end of its struct rfarea, and measured from the    */
+/* end, so the part following an edit stays in place as well.     */
+/* The lines following the edit are not split into words again    */
+/* if their text is the same as before, and the output lines from */
+/* the first one whose words are broken as before on are copied   */
+/* from the last output.                                          */
+
+struct rfarea {
+  void *block;            /* Room for max elements, or NULL.         */
+  size_t max;
+};
+
+struct rfline {
+  long start, end;        /* Bounds of an input line, measured back  */
+                          /*   from the end of the last line.        */
+  int words;              /* Number of words in it and those after.  */
+};
+
+struct rfoutline {
+  long start;             /* Start of an output line, measured back  */
+                          /*   from the end of the output.           */
+  int words;              /* Number of words in it and those after.  */
+};
+
+struct rfprev {
+  void *wordblock;        /* Block holding the arrays of w.          */
+  int maxwords;
+  struct words w;         /* The words, valid only if w.n >= 0.      */
+  int prefix, suffix,     /* Other parameters the paragraph was      */
+      utf8;               /*   reformatted with.                     */
+  struct rfarea text;     /* The chars from the first line to end.   */
+  size_t textlen;
+  struct rfarea lines;    /* numin struct rflines.                   */
+  int numin;
+  struct rfarea out;      /* The output lines.                       */
+  size_t outlen;
+  struct rfarea outlines; /* numout struct rfoutlines.               */
+  int numout;
+};
+
+
+static void *rfroom(struct rfarea *a, size_t n, size_t keep, size_t size)
+/* Makes room in *a for n elements of the given size, keeping the */
+/* last keep of those already there at the end. Returns the first */
+/* of the n, or NULL if out of memory, in which case *a is left   */
+/* as it was.                                                     */
+{
+  char *block;
+  size_t max;
+
+  if (n > a->max || !a->block) {
+    max = a->max ? a->max : 64;
+    while (max < n) max *= 2;
+    block = malloc(max * size);
+    if (!block) return NULL;
+    if (keep)
+      memcpy(block + (max - keep) * size,
+             (char *) a->block + (a->max - keep) * size, keep * size);
+    free(a->block);
+    a->block = block;
+    a->max = max;
+  }
+
+  return (char *) a->block + (a->max - n) * size;
+}
+
+
+static void layoutwords(struct words *w, char *block, int maxwords, int n)
+/* Sets the arrays of w for n words in block, which has room  */
+/* for maxwords, and sets w->n to n. The arrays that are kept */
+/* for reflowing end where their parts of block end.          */
+{
+  int m = maxwords - n;
+
+  w->n = n;
+  w->pos = (long *) block + m;
+  w->score = (long *) block + maxwords + 1 + m;
+  w->back = (long *) block + 2 * maxwords + 2 + m;
+  w->outlog = (long *) block + 3 * maxwords + 2;
+  block = (char *) ((long *) block + 4 * maxwords + 2);
+  w->length = (int *) block + m;
+  w->size = (int *) block + maxwords + m;
+  w->linewords = (int *) block + 2 * maxwords + m;
+  w->linelen = (int *) block + 3 * maxwords + m;
+  w->shortgood[0] = (int *) block + 4 * maxwords + m;
+  w->shortgood[1] = (int *) block + 5 * maxwords + 1 + m;
+  w->longgood[0] = (int *) block + 6 * maxwords + 2 + m;
+  w->longgood[1] = (int *) block + 7 * maxwords + 3 + m;
+  w->good = (int *) block + 8 * maxwords + 4;
+  w->instack = w->good + maxwords + 1;
+  w->outstack = w->instack + maxwords;
+  w->incand = w->outstack + maxwords;
+  w->outcand = w->incand + 4 * maxwords;
+}
+
+
+static int allocwords(struct words *w, void **pblock, int *pmaxwords,
+                      int n, int keep)
+/* Allocates the arrays of w for n words in *pblock, which has    */
+/* room for *pmaxwords, enlarging it if necessary, and sets w->n  */
+/* to n. What is kept for the last keep words, which the arrays   */
+/* of w must hold, stays. Returns 0 on success, -1 if out of      */
+/* memory, in which case w and *pblock are left as they were.     */
+{
+  char *block;
+  int maxwords;
+  struct words from, to;
+
+  if (n > *pmaxwords || !*pblock) {
+    maxwords = *pmaxwords ? *pmaxwords : 64;
+    while (maxwords < n) maxwords *= 2;
+    block = malloc((4 * (size_t) maxwords + 2) * sizeof (long)
+                   + (19 * (size_t) maxwords + 5) * sizeof (int));
+    if (!block) return -1;
+    if (keep) {
+      layoutwords(&from, *pblock, *pmaxwords, keep);
+      layoutwords(&to, block, maxwords, keep);
+      memcpy(to.pos, from.pos, (keep + 1) * sizeof (long));
+      memcpy(to.score, from.score, (keep + 1) * sizeof (long));
+      memcpy(to.back, from.back, keep * sizeof (long));
+      memcpy(to.length, from.length, keep * sizeof (int));
+      memcpy(to.size, from.size, keep * sizeof (int));
+      memcpy(to.linewords, from.linewords, keep * sizeof (int));
+      memcpy(to.linelen, from.linelen, keep * sizeof (int));
+      memcpy(to.shortgood[0], from.shortgood[0], (keep + 1) * sizeof (int));
+      memcpy(to.shortgood[1], from.shortgood[1], (keep + 1) * sizeof (int));
+      memcpy(to.longgood[0], from.longgood[0], (keep + 1) * sizeof (int));
+      memcpy(to.longgood[1], from.longgood[1], (keep + 1) * sizeof (int));
+    }
+    free(*pblock);
+    *pblock = block;
+    *pmaxwords = maxwords;
+  }
+
+  layoutwords(w, *pblock, *pmaxwords, n);
+  return 0;
+}
+
+
+static void setpos(struct words *w, int from)
+/* Sets w->pos[k] for the words k before word from, */
+/* given w->pos[from].                              */
+{
+  long *pos = w->pos;
+  int k;
+
+  if (from == w->n) pos[from] = 0;
+  for (k = from - 1;  k >= 0;  --k)
+    pos[k] = pos[k+1] - w->length[k] - 1;
+}
+
+
+static int pastwindow(const long *pos, int n, int i, long len)
+/* Returns the first word after word i that cannot end a line */
+/* of at most len characters starting at word i, or n if      */
+/* every word after word i can.                               */
+{
+  int m;
+
+  for (m = i + 1;  m < n && pos[m] - pos[i] - 1 <= len;  ++m);
+  return m;
+}
+
+
+static int maxshortestok(
+  const long *pos, int n, int t0, int L, int last, int T, int *good, int from
 )
-/* Chooses linebreaks in a list of struct words according to */
-/* the policy in "par.doc" (L is <L>, last is <last>, and    */
-/* min is <min>). head must point to a dummy word, and tail  */
-/* must point to the last word. Returns <newL>. Uses errmsg. */
+/* Returns 1 if the words can be broken into lines of at most L  */
+/* characters whose shortest line (excluding the last line, if   */
+/* last is 0) has at least T characters, 0 otherwise. t0 is the  */
+/* first word that fits on the last line. good must have room    */
+/* for n + 1 ints; good[k] is left holding the number of words   */
+/* at or after word k that can start such a set of lines. good[] */
+/* must already be filled in from good[from] on. T <= L + 1.     */
 {
-  struct word *w1, *w2;
-  int linelen, shortest, newL, score, minlen, diff, sumsqdiff;
+  int i, lo, hi, ok;
+
+  STATS_COUNT(steps[PASS_SHORTEST], from);
+  if (from == n) good[n] = 0;
+  for (i = from - 1;  i >= t0;  --i)
+    good[i] = good[i+1] + ((last ? pos[n] - pos[i] - 1 : L) >= T);
+
+  for (lo = hi = i >= 0 ? pastwindow(pos,n,i,L) : n;  i >= 0;  --i) {
+    while (lo > i + 1 && pos[lo-1] - pos[i] - 1 >= T) --lo;
+    while (hi > i + 1 && pos[hi-1] - pos[i] - 1 > L) --hi;
+    ok = lo < hi && good[lo] > good[hi];
+    good[i] = good[i+1] + ok;
+  }
+
+  return good[0] > good[1];
+}
+
+
+static int minlongestok(
+  const long *pos, int n, int shortest, int lastmin, int M, int *good,
+  int from
+)
+/* Returns 1 if the words can be broken into lines of at most M  */
+/* characters, each at least shortest characters long except the */
+/* last, which must be at least lastmin characters long, and 0   */
+/* otherwise. good and from are used as in maxshortestok().      */
+{
+  int i, lo, hi, ok;
+  long linelen;
+
+  STATS_COUNT(steps[PASS_LONGEST], from);
+  if (from == n) good[n] = 0;
+  i = from - 1;
+  for (lo = hi = i >= 0 ? pastwindow(pos,n,i,M > shortest ? M : shortest) : n;
+       i >= 0;  --i) {
+    linelen = pos[n] - pos[i] - 1;
+    ok = linelen <= M && linelen >= lastmin;
+    while (lo > i + 1 && pos[lo-1] - pos[i] - 1 >= shortest) --lo;
+    while (hi > i + 1 && pos[hi-1] - pos[i] - 1 > M) --hi;
+    if (!ok) ok = lo < hi && good[lo] > good[hi];
+    good[i] = good[i+1] + ok;
+  }
+
+  return good[0] > good[1];
+}
+
+
+/* The last pass minimizes score[i] = min over j of score[j] +   */
+/* (newL - linelen(i,j))^2. Since pos[] is increasing, any two   */
+/* candidates j differ by an amount linear in pos[i], so the     */
+/* candidates currently in the window can be kept in a Li Chao   */
+/* tree indexed by word number. Words enter the window at one    */
+/* end and leave it at the other, so the window is a queue, kept */
+/* as two stacks each with its own tree. The tree of the stack   */
+/* that is popped is restored from an undo log.                  */
+
+struct lctree {
+  int *cand;           /* cand[x] is the candidate at node x, or -1. */
+  int *lognode,        /* Undo log: node lognode[k] held candidate   */
+      *logcand;        /*   logcand[k] before the k'th change.       */
+  long loglen, logsize;
+};
+
+struct breaker {
+  const long *pos;     /* As described above.                        */
+  const long *score;   /* Scores of the words already processed.     */
+  long newL;           /* <newL>.                                    */
+  int n;               /* Number of words.                           */
+  struct lctree in,    /* Tree for the stack that is pushed.         */
+                out;   /* Tree for the stack that is popped.         */
+};
+
+
+static long cost(const struct breaker *b, int j, int i)
+/* Returns the score word i would get if the line */
+/* it starts were followed by one starting at j.  */
+{
+  long diff = b->newL - (b->pos[j] - b->pos[i] - 1);
+
+  return b->score[j] + diff * diff;
+}
+
+
+static int better(const struct breaker *b, int j1, int j2, int i)
+/* Returns 1 if candidate j1 beats candidate j2 for word i. Ties */
+/* go to the later candidate, as in a search that tries breaks   */
+/* from left to right and keeps the last one of least cost.      */
+{
+  long c1 = cost(b,j1,i), c2 = cost(b,j2,i);
+
+  return c1 < c2 || (c1 == c2 && j1 > j2);
+}
+
+
+static int lcset(struct lctree *t, int x, int j)
+/* Stores candidate j in node x of t, logging the old    */
+/* candidate. Returns 0 on success, -1 if out of memory. */
+{
+  int *p;
+
+  if (t->loglen == t->logsize) {
+    t->logsize = t->logsize ? 2 * t->logsize : 64;
+    p = realloc(t->lognode, t->logsize * sizeof (int));
+    if (!p) return -1;
+    t->lognode = p;
+    p = realloc(t->logcand, t->logsize * sizeof (int));
+    if (!p) return -1;
+    t->logcand = p;
+  }
+  t->lognode[t->loglen] = x;
+  t->logcand[t->loglen++] = t->cand[x];
+  t->cand[x] = j;
+  return 0;
+}
+
+
+static void lcundo(struct lctree *t, long loglen)
+/* Undoes the changes to t made since its log had length loglen. */
+{
+  while (t->loglen > loglen) {
+    --t->loglen;
+    t->cand[t->lognode[t->loglen]] = t->logcand[t->loglen];
+  }
+}
+
+
+static int lcinsert(const struct breaker *b, struct lctree *t, int j)
+/* Adds candidate j to t. Returns 0 on success, -1 if out of memory. */
+{
+  int x = 1, lo = 0, hi = b->n - 1, mid, cur;
+
+  for (;;) {
+    STATS_COUNT(steps[PASS_SCORE], 1);
+    cur = t->cand[x];
+    if (cur < 0) return lcset(t,x,j);
+    mid = (lo + hi) / 2;
+    if (better(b,j,cur,mid)) {
+      if (lcset(t,x,j)) return -1;
+      j = cur;
+      cur = t->cand[x];
+    }
+    if (lo == hi) return 0;
+    if (better(b,j,cur,lo)) {
+      x = 2 * x;
+      hi = mid;
+    }
+    else if (better(b,j,cur,hi)) {
+      x = 2 * x + 1;
+      lo = mid + 1;
+    }
+    else return 0;
+  }
+}
+
+
+static int lcquery(const struct breaker *b, const struct lctree *t, int i, int best)
+/* Returns the better of best and the best candidate in t for */
+/* word i, or -1 if best is -1 and t is empty.                */
+{
+  int x = 1, lo = 0, hi = b->n - 1, mid, cur;
+
+  for (;;) {
+    STATS_COUNT(steps[PASS_SCORE], 1);
+    cur = t->cand[x];
+    if (cur < 0) return best;
+    if (best < 0 || better(b,cur,best,i)) best = cur;
+    if (lo == hi) return best;
+    mid = (lo + hi) / 2;
+    if (i <= mid) {
+      x = 2 * x;
+      hi = mid;
+    }
+    else {
+      x = 2 * x + 1;
+      lo = mid + 1;
+    }
+  }
+}
+
+
+static int choosebreaks(struct words *w, int L, int last, int min,
+                        int *reuse, int keep, errmsg_t errmsg)
+/* Chooses linebreaks in w according to the policy in "par.doc"  */
+/* (L is <L>, last is <last>, and min is <min>), setting         */
+/* w->linewords[], w->linelen[] and w->score[]. Returns <newL>.  */
+/* w->pos[] must be set. If keep is nonzero, also fills in the   */
+/* rest of w needed to reflow it. If *reuse is nonzero, w holds  */
+/* what was kept for its last *reuse words when they were        */
+/* broken with keep set and the same L, last, and min, along     */
+/* with the results of the first passes; it is then reused where */
+/* it still holds, and *reuse is set to 0 if it did not. Sets    */
+/* errmsg as described in "errmsg.h".                            */
+{
+  struct breaker b;
+  int n = w->n, i, j, t0, lo, hi, mid, shortest, newL = 0, best, from,
+      ok1, ok2, ins = 0, outs = 0, *good = w->good, *instack = w->instack,
+      *outstack = w->outstack;
+  long *pos = w->pos, *score = w->score, *outlog = w->outlog,
+       linelen, diff, c;
   const char * const impossibility =
     "Impossibility #%d has occurred. Please report it.\n";
 
+  b.in.cand = w->incand;
+  b.out.cand = w->outcand;
+  b.in.lognode = b.in.logcand = b.out.lognode = b.out.logcand = NULL;
+  b.in.loglen = b.in.logsize = b.out.loglen = b.out.logsize = 0;
+
+  w->L = L;
+  w->last = last;
+  w->min = min;
+
+  if (!n) {
+    *errmsg = '\0';
+    *reuse = 0;
+    return w->shortest = w->newL = min ? 0 : L;
+  }
+
+  from = n - *reuse;
+
 /* Determine maximum length of the shortest line: */
 
-  /* Initialize words that could fit on the last line: */
+  /* Find the words that could fit on the last line. Every other */
+  /* word must fit on a line by itself:                          */
+
+  for (t0 = n;  t0 > 0 && pos[n] - pos[t0-1] - 1 <= L;  --t0);
+
+  for (i = 0;  i < t0;  ++i)
+    if (w->length[i] > L) {
+      sprintf(errmsg,impossibility,1);
+      goto cbcleanup;
+    }
 
-  for (w1 = tail,  linelen = w1->length;
-       w1 != head && linelen <= L;
-       w1 = w1->prev,  linelen += 1 + w1->length) {
-    w1->nextline = NULL;
-    w1->score = last ? linelen : L;
+  /* If the previous shortest line is still the largest attainable */
+  /* one, only the words before the reused ones need be checked:   */
+
+  shortest = -1;
+  if (*reuse) {
+    shortest = w->shortest;
+    ok1 = maxshortestok(pos,n,t0,L,last,shortest,w->shortgood[0],from);
+    ok2 = maxshortestok(pos,n,t0,L,last,shortest + 1,w->shortgood[1],from);
+    if (!ok1 || (ok2 && shortest < L)) shortest = -1;
   }
 
-  /* Then choose line breaks: */
+  /* Otherwise find the largest attainable shortest line: */
 
-  for ( ;  w1 != head;  w1 = w1->prev) {
-    w1->score = -1;
-    for (linelen = w1->length,  w2 = w1->next;
-         linelen <= L;
-         linelen += 1 + w2->length,  w2 = w2->next) {
-      shortest = linelen <= w2->score ? linelen : w2->score;
-      if (shortest > w1->score) {
-        w1->nextline = w2;
-        w1->score = shortest;
-      }
+  if (shortest < 0) {
+    *reuse = 0;
+    from = n;
+    for (lo = 0, hi = L;  lo < hi; ) {
+      mid = hi - (hi - lo) / 2;
+      if (maxshortestok(pos,n,t0,L,last,mid,good,n)) lo = mid;
+      else hi = mid - 1;
     }
-    if (w1->score < 0) {
-      sprintf(err_msg,impossibility,1);
-      return 0;
+    shortest = lo;
+    if (keep) {
+      maxshortestok(pos,n,t0,L,last,shortest,w->shortgood[0],n);
+      maxshortestok(pos,n,t0,L,last,shortest + 1,w->shortgood[1],n);
     }
   }
 
-  shortest = head->next ? head->next->score : L;
-
   if (!min)
     newL = L;
   else {
 
-  /* Determine the minimum possible longest line: */
+  /* Determine the minimum possible longest line, checking the */
+  /* previous one first in the same way:                       */
 
-    for (w1 = tail;  w1 != head;  w1 = w1->prev) {
-      w1->score = L + 1;
-      for (linelen = w1->length, w2 = w1->next;
-           linelen < w1->score;
-           linelen += 1 + w2->length, w2 = w2->next) {
-        if (w2) {
-          score = w2->score;
-          minlen = shortest;
-        }
-        else {
-          score = 0;
-          minlen = last ? shortest : 0;
-        }
-        if (linelen >= minlen) {
-          newL = linelen >= score ? linelen : score;
-          if (newL < w1->score) {
-            w1->nextline = w2;
-            w1->score = newL;
-          }
-        }
-        if (!w2) break;
+    newL = -1;
+    if (*reuse) {
+      newL = w->newL;
+      ok1 = minlongestok(pos,n,shortest,last ? shortest : 0,newL,
+                         w->longgood[0],from);
+      ok2 = newL > 0 && minlongestok(pos,n,shortest,last ? shortest : 0,
+                                     newL - 1,w->longgood[1],from);
+      if (!ok1 || ok2) newL = -1;
+    }
+
+    if (newL < 0) {
+      *reuse = 0;
+      from = n;
+      for (lo = 0, hi = L + 1;  lo < hi; ) {
+        mid = lo + (hi - lo) / 2;
+        if (minlongestok(pos,n,shortest,last ? shortest : 0,mid,good,n)) hi = mid;
+        else lo = mid + 1;
+      }
+      newL = lo;
+      if (keep) {
+        minlongestok(pos,n,shortest,last ? shortest : 0,newL,w->longgood[0],n);
+        if (newL > 0)
+          minlongestok(pos,n,shortest,last ? shortest : 0,newL - 1,
+                       w->longgood[1],n);
       }
     }
 
-    newL = head->next ? head->next->score : 0;
     if (newL > L) {
-      sprintf(err_msg,impossibility,2);
-      return 0;
+      sprintf(errmsg,impossibility,2);
+      goto cbcleanup;
     }
   }
 
+  w->shortest = shortest;
+  w->newL = newL;
+
 /* Minimize the sum of the squares of the differences */
 /* between newL and the lengths of the lines:         */
 
-  for (w1 = tail;  w1 != head;  w1 = w1->prev) {
-    w1->score = -1;
-    for (linelen = w1->length,  w2 = w1->next;
-         linelen <= newL;
-         linelen += 1 + w2->length,  w2 = w2->next) {
-      diff = newL - linelen;
-      minlen = shortest;
-      if (w2)
-        score = w2->score;
-      else {
-        score = 0;
-        if (!last) diff = minlen = 0;
+  /* The scores of the reused words carry over, and the window  */
+  /* of the word before them starts out empty. Every candidate  */
+  /* and every word scored is then before hi, so the trees need */
+  /* only cover the words before hi:                            */
+
+  i = from - 1;
+  lo = hi = i >= 0 ? pastwindow(pos,n,i,newL) : n;
+
+  b.pos = pos;
+  b.score = score;
+  b.newL = newL;
+  b.n = hi;
+  for (j = 0;  j < 4 * hi;  ++j) b.in.cand[j] = b.out.cand[j] = -1;
+
+  for ( ;  i >= 0;  --i) {
+
+    /* Drop the breaks that would make the line too long: */
+
+    while (hi > i + 1 && pos[hi-1] - pos[i] - 1 > newL) --hi;
+    while (outs || ins) {
+      if (!outs) {
+        lcundo(&b.in,0);
+        while (ins) {
+          outlog[outs] = b.out.loglen;
+          outstack[outs++] = instack[--ins];
+          if (lcinsert(&b,&b.out,outstack[outs-1])) {
+            strcpy(errmsg,OUTOFMEM);
+            goto cbcleanup;
+          }
+        }
       }
-      if (linelen >= minlen  &&  score >= 0) {
-        sumsqdiff = score + diff * diff;
-        if (w1->score < 0  ||  sumsqdiff <= w1->score) {
-          w1->nextline = w2;
-          w1->score = sumsqdiff;
-          w1->linelen = linelen;
+      if (outstack[outs-1] < hi) break;
+      lcundo(&b.out,outlog[--outs]);
+    }
+
+    /* Add the breaks that make the line long enough: */
+
+    while (lo > i + 1 && pos[lo-1] - pos[i] - 1 >= shortest) {
+      --lo;
+      if (lo < hi && score[lo] >= 0) {
+        instack[ins++] = lo;
+        if (lcinsert(&b,&b.in,lo)) {
+          strcpy(errmsg,OUTOFMEM);
+          goto cbcleanup;
         }
       }
-      if (!w2) break;
     }
+
+    best = lcquery(&b,&b.in,i,lcquery(&b,&b.out,i,-1));
+    score[i] = best < 0 ? -1 : cost(&b,best,i);
+
+    /* Breaking after the last word is tried last: */
+
+    linelen = pos[n] - pos[i] - 1;
+    if (linelen <= newL && (!last || linelen >= shortest)) {
+      diff = last ? newL - linelen : 0;
+      c = diff * diff;
+      if (best < 0 || c <= score[i]) {
+        best = n;
+        score[i] = c;
+      }
+    }
+    w->linewords[i] = best < 0 ? -1 : best - i;
   }
 
-  if (head->next && head->next->score < 0) {
-    sprintf(err_msg,impossibility,3);
-    return 0;
+  if (score[0] < 0) {
+    sprintf(errmsg,impossibility,3);
+    goto cbcleanup;
   }
 
-  clear_error();
+  for (i = 0;  i < from;  ++i)
+    if (score[i] >= 0) {
+      j = i + w->linewords[i];
+      w->linelen[i] = pos[j] - pos[i] - 1;
+    }
+
+  *errmsg = '\0';
+
+cbcleanup:
+
+  free(b.in.lognode);
+  free(b.in.logcand);
+  free(b.out.lognode);
+  free(b.out.logcand);
+
   return newL;
 }
 
 
-char **reformat(const char * const *inlines, int width,
-                int prefix, int suffix, int hang, int last, int min)
+/* With --quality, line breaks are chosen as by Knuth and Plass's     */
+/* total-fit algorithm, adapted to ragged-right text. A line i..j-1   */
+/* short of L by s chars has badness 100 (s/S)^3, capped at 10000,    */
+/* where S is the stretch percentage of L, and a fitness class by its */
+/* badness. The break after it has a penalty p, and the line costs    */
+/* demerits (l + badness)^2 + p^2, or minus p^2 if p is negative,     */
+/* plus the adjacent-line demerits if its class and that of the line  */
+/* before it are more than one apart. The last line has no badness    */
+/* unless <last> is 1. The breaks minimizing the total demerits are   */
+/* found by dynamic programming over the words, with a node for each  */
+/* word and class. Every line that fits is allowed, however short,    */
+/* so nothing is pruned: each word is reached from every word that    */
+/* starts a line ending with it and no longer than L. The time is     */
+/* therefore proportional to the number of words times the number     */
+/* that fit on a line, which grows with L.                            */
+
+#define NUMCLASSES 3
+
+struct qnode {
+  double total;   /* Least total demerits of the lines up to here.    */
+  int from;       /* The node of the break before, or -1 if none.     */
+};
+
+
+static int fitclass(double badness)
+/* Returns the fitness class of a line with the given badness: */
+/* 0 for decent, 1 for loose, and 2 for very loose.            */
+{
+  return badness < 13 ? 0 : badness < 100 ? 1 : 2;
+}
+
+
+static int breakpenalty(const struct words *w, int j,
+                        const struct par_quality *q)
+/* Returns the penalty for breaking the line before word j, */
+/* 0 < j < w->n.                                            */
+{
+  const char *p = w->end - w->back[j-1] + w->size[j-1];
+  int pen = 0, k = w->size[j-1];
+
+  if (k > 1 && strchr(")]'\"", p[-1])) --p, --k;
+  if (strchr(".,;:!?", p[-1])) pen += q->punctpenalty;
+  if (j == w->n - 1) pen += q->widowpenalty;
+
+  return pen;
+}
+
+
+static int qualitybreaks(struct words *w, struct rfscratch *scratch, int L,
+                         int last, int min, const struct par_quality *q,
+                         errmsg_t errmsg)
+/* Chooses linebreaks in w by total fit with the parameters in *q,  */
+/* setting w->linewords[] and w->linelen[] for the words that begin */
+/* lines. Returns <newL>, which is L unless min is 1, and then the  */
+/* length of the longest line. Fails as choosebreaks() does if a    */
+/* word is longer than L. Sets errmsg as choosebreaks() does.       */
+{
+  struct qnode *node, *nj;
+  int n = w->n, i, j, c, ci, lo, cl, newL, maxnodes;
+  long *pos = w->pos, len;
+  double S, s, badness, d, pd, t;
+
+  if (!n) {
+    *errmsg = '\0';
+    return min ? 0 : L;
+  }
+
+  if (n + 1 > scratch->maxnodes || !scratch->nodes) {
+    maxnodes = scratch->maxnodes ? scratch->maxnodes : 64;
+    while (maxnodes < n + 1) maxnodes *= 2;
+    node = malloc(maxnodes * NUMCLASSES * sizeof (struct qnode));
+    if (!node) {
+      strcpy(errmsg, OUTOFMEM);
+      return 0;
+    }
+    free(scratch->nodes);
+    scratch->nodes = node;
+    scratch->maxnodes = maxnodes;
+  }
+  node = scratch->nodes;
+
+  S = L * (double) q->stretch / 100;
+  if (S < 1) S = 1;
+
+  node[0].total = 0;
+  node[0].from = 0;
+  node[1].from = node[2].from = -1;
+
+  for (j = 1, lo = 0;  j <= n;  ++j) {
+    nj = node + j * NUMCLASSES;
+    for (c = 0;  c < NUMCLASSES;  ++c) nj[c].from = -1;
+    while (pos[j] - pos[lo] - 1 > L) ++lo;
+    if (lo == j) {
+      sprintf(errmsg, "Impossibility #%d has occurred. Please report it.\n", 1);
+      return 0;
+    }
+
+    STATS_COUNT(steps[PASS_QUALITY], j - lo);
+    pd = j < n ? breakpenalty(w,j,q) : 0;
+    pd = pd < 0 ? -pd * pd : pd * pd;
+
+    for (i = lo;  i < j;  ++i) {
+      len = pos[j] - pos[i] - 1;
+      if (j == n && !last)
+        badness = 0;
+      else {
+        s = (L - len) / S;
+        badness = 100 * s * s * s;
+        if (badness > 10000) badness = 10000;
+      }
+      cl = fitclass(badness);
+      d = q->linepenalty + badness;
+      d = d * d + pd;
+      if (j == n && 4 * len < L)
+        d += (double) q->shortpenalty * q->shortpenalty;
+
+      for (ci = 0;  ci < NUMCLASSES;  ++ci) {
+        if (node[i * NUMCLASSES + ci].from < 0) continue;
+        t = node[i * NUMCLASSES + ci].total + d;
+        if (ci - cl > 1 || cl - ci > 1) t += q->adjdemerits;
+        if (nj[cl].from < 0 || t < nj[cl].total) {
+          nj[cl].total = t;
+          nj[cl].from = i * NUMCLASSES + ci;
+        }
+      }
+    }
+  }
+
+/* Follow the best path back from the end: */
+
+  nj = node + n * NUMCLASSES;
+  for (cl = 0, c = 1;  c < NUMCLASSES;  ++c)
+    if (nj[c].from >= 0 && (nj[cl].from < 0 || nj[c].total < nj[cl].total))
+      cl = c;
+
+  newL = 0;
+  for (j = n, c = n * NUMCLASSES + cl;  j > 0;  j = i) {
+    c = node[c].from;
+    i = c / NUMCLASSES;
+    w->linewords[i] = j - i;
+    w->linelen[i] = pos[j] - pos[i] - 1;
+    if (w->linelen[i] > newL) newL = w->linelen[i];
+  }
+
+  *errmsg = '\0';
+  return min ? newL : L;
+}
+
+
+static int unchangedlines(const struct rfprev *kept,
+                          const char * const *inlines,
+                          const char * const *inends, int numin,
+                          const char *unchanged)
+/* Returns the first of the numin lines at inlines, other than the */
+/* first, that starts at or after unchanged and from which on the  */
+/* lines are the same as the last ones kept, or numin if there is  */
+/* none. They must have the same chars in the same places.         */
+{
+  const char *end = inends[numin - 1];
+  const struct rfline *lines;
+  int s, k, d = kept->numin - numin;
+  size_t len;
+
+  for (s = 1;  s < numin && inlines[s] < unchanged;  ++s);
+  if (s == numin || s + d < 1) return numin;
+
+  len = end - inlines[s];
+  if (len > kept->textlen
+      || memcmp(inlines[s], (char *) kept->text.block + kept->text.max - len, len))
+    return numin;
+
+  lines = (struct rfline *) kept->lines.block + kept->lines.max - kept->numin;
+  for (k = s;  k < numin;  ++k)
+    if (lines[k + d].start != end - inlines[k]
+        || lines[k + d].end != end - inends[k])
+      return numin;
+
+  return s;
+}
+
+
+static int sameaffix(const char *q, const char *p, int len)
+/* Returns 1 if the len chars at q are those at p, or are */
+/* all spaces if p is NULL, and 0 otherwise.              */
+{
+  if (p) return !memcmp(q, p, len);
+  while (len && *q == ' ') ++q, --len;
+  return !len;
+}
+
+
+static int sameaffixes(const struct rfprev *kept, int oi, int numout,
+                       const char * const *inlines,
+                       const char * const *suffixes, int numin,
+                       int prefix, int suffix, int hang)
+/* Returns 1 if the kept output lines from line oi on have the   */
+/* prefixes and suffixes they would get as lines numout + 1 on   */
+/* of the output for the numin lines at inlines, whose suffixes  */
+/* start at suffixes, and 0 otherwise.                           */
 {
-  int numin, numout, affix, L, linelen, newL;
-  const char * const *line, **suffixes = NULL, **suf, *end, *p1, *p2;
-  char *q1, *q2, **outlines = NULL;
-  struct word dummy, *head, *tail, *w1, *w2;
-  struct buffer *pbuf = NULL;
+  const struct rfoutline *ko;
+  const char *outend;
+
+  ko = (struct rfoutline *) kept->outlines.block + kept->outlines.max - kept->numout;
+  outend = (char *) kept->out.block + kept->out.max;
+
+  for ( ;  oi < kept->numout;  ++oi) {
+    ++numout;
+    if (!sameaffix(outend - ko[oi].start,
+                   numout <= numin ? inlines[numout - 1] :
+                   numin > hang    ? inlines[numin - 1]  : NULL, prefix)
+        || !sameaffix((oi + 1 < kept->numout ? outend - ko[oi+1].start : outend)
+                        - 1 - suffix,
+                      numout <= numin ? suffixes[numout - 1] :
+                      numin           ? suffixes[numin - 1]  : NULL, suffix))
+      return 0;
+  }
+
+  return 1;
+}
+
+
+void reformat(struct buffer *out, struct rfscratch *scratch,
+              const char * const *inlines, const char * const *inends,
+              const char *unchanged, int width,
+              int prefix, int suffix, int hang, int last, int min,
+              const struct par_quality *quality, int utf8,
+              errmsg_t errmsg)
+{
+  int numin, numout, affix, L, linelen, newL, n, pass, w1, w2, maxlines,
+      wordlen, bytewise, split, tail = 0, reuse, oi = 0, taillines = 0;
+  long textlen = 0;
+  const char * const *line, **suffixes, **suf, *end, *p1, *p2;
+  char *q1, *q2, *start = NULL;
+  struct words words = { 0 };
+  struct rfprev *kept = NULL;
+  struct rfline *lines = NULL;
+  struct rfoutline *outlines = NULL;
+  size_t outlen, taillen = 0, extra = 0;
 
 /* Initialization: */
 
-  clear_error();
-  dummy.next = dummy.prev = NULL;
-  head = tail = &dummy;
+  *errmsg = '\0';
 
 /* Count the input lines: */
 
   for (line = inlines;  *line;  ++line);
   numin = line - inlines;
 
-/* Allocate space for pointers to the suffixes: */
+/* Make room for pointers to the suffixes: */
 
-  if (numin) {
-    suffixes = malloc(numin * sizeof (const char *));
+  if (numin > scratch->maxlines || !scratch->suffixes) {
+    maxlines = scratch->maxlines ? scratch->maxlines : 64;
+    while (maxlines < numin) maxlines *= 2;
+    suffixes = malloc(maxlines * sizeof (const char *));
     if (!suffixes) {
-      strcpy(err_msg,outofmem);
-      goto rfcleanup;
+      strcpy(errmsg, OUTOFMEM);
+      return;
     }
+    free(scratch->suffixes);
+    scratch->suffixes = suffixes;
+    scratch->maxlines = maxlines;
   }
+  suffixes = scratch->suffixes;
 
-/* Set the pointers to the suffixes, and create the words: */
+/* Set the pointers to the suffixes: */
 
   affix = prefix + suffix;
   L = width - prefix - suffix;
 
+  if (L <= 0) {
+    sprintf(errmsg, "<width> (%d) <= <prefix> (%d) + <suffix> (%d)\n",
+            width, prefix, suffix);
+    return;
+  }
+
   for (line = inlines, suf = suffixes;  *line;  ++line, ++suf) {
-    for (end = *line;  *end;  ++end);
+    end = inends[line - inlines];
     if (end - *line < affix) {
-      sprintf(err_msg,
+      sprintf(errmsg,
               "Line %ld shorter than <prefix> + <suffix> = %d + %d = %d\n",
               line - inlines + 1, prefix, suffix, affix);
-      goto rfcleanup;
-    }
-    end -= suffix;
-    *suf = end;
-    p1 = *line + prefix;
-    for (;;) {
-      while (p1 < end && isspace(*p1)) ++p1;
-      if (p1 == end) break;
-      p2 = p1;
-      while (p2 < end && !isspace(*p2)) ++p2;
-      if (p2 - p1 > L) p2 = p1 + L;
-      w1 = malloc(sizeof (struct word));
-      if (!w1) {
-        strcpy(err_msg,outofmem);
-        goto rfcleanup;
+      return;
+    }
+    *suf = end - suffix;
+  }
+
+  words.end = numin ? inends[numin - 1] : NULL;
+
+/* If this paragraph is to be kept, find the first line from which */
+/* on it is the same as the last one kept. The words of the lines  */
+/* from there on need not be found again:                          */
+
+  split = numin;
+  if (unchanged && (quality || !numin)) {
+    if (scratch->prev) ((struct rfprev *) scratch->prev)->w.n = -1;
+  }
+  else if (unchanged) {
+    if (!scratch->prev) {
+      scratch->prev = calloc(1, sizeof (struct rfprev));
+      if (!scratch->prev) {
+        strcpy(errmsg, OUTOFMEM);
+        return;
+      }
+      ((struct rfprev *) scratch->prev)->w.n = -1;
+    }
+    kept = scratch->prev;
+    if (kept->w.n >= 0 && kept->w.L == L && kept->w.last == last
+        && kept->w.min == min && kept->prefix == prefix
+        && kept->suffix == suffix && kept->utf8 == utf8) {
+      split = unchangedlines(kept, inlines, inends, numin, unchanged);
+      if (split < numin) {
+        lines = (struct rfline *) kept->lines.block + kept->lines.max - kept->numin;
+        tail = lines[split + kept->numin - numin].words;
+      }
+    }
+    words = kept->w;
+    words.end = inends[numin - 1];
+    kept->w.n = -1;
+    textlen = split < numin ? words.end - inlines[split] : 0;
+  }
+
+/* Find the words of the lines before split. The first pass counts */
+/* them, and the second fills in their arrays. With utf8, a line   */
+/* that is all ASCII is measured as it would be without, and only  */
+/* the others char by char:                                        */
+
+  for (pass = 0;  pass < 2;  ++pass) {
+    n = 0;
+    for (line = inlines, suf = suffixes;  line < inlines + split;  ++line, ++suf) {
+      if (pass && kept) {
+        lines[line - inlines].start = words.end - *line;
+        lines[line - inlines].end = words.end - inends[line - inlines];
+        lines[line - inlines].words = words.n - n;
+      }
+      end = *suf;
+      p1 = *line + prefix;
+      bytewise = !utf8 || skipascii(p1,end) == end;
+      for (;;) {
+        p1 = skipspace(p1,end);
+        if (p1 == end) break;
+        p2 = skipword(p1,end);
+        if (!bytewise) p2 = spanwidth(p1,p2,L,&wordlen);
+        else {
+          if (p2 - p1 > L) p2 = p1 + L;
+          wordlen = p2 - p1;
+        }
+        if (pass) {
+          words.back[n] = words.end - p1;
+          words.length[n] = wordlen;
+          words.size[n] = p2 - p1;
+        }
+        ++n;
+        p1 = p2;
+      }
+    }
+    if (pass) break;
+    if (!kept) {
+      if (allocwords(&words,&scratch->wordblock,&scratch->maxwords,n,0)) {
+        strcpy(errmsg, OUTOFMEM);
+        return;
       }
-      w1->next = NULL;
-      w1->prev = tail;
-      tail = tail->next = w1;
-      w1->chrs = p1;
-      w1->length = p2 - p1;
-      p1 = p2;
+    }
+    else {
+      lines = rfroom(&kept->lines, numin, numin - split, sizeof (struct rfline));
+      start = rfroom(&kept->text, words.end - *inlines, textlen, 1);
+      if (!lines || !start
+          || allocwords(&words,&kept->wordblock,&kept->maxwords,n + tail,tail)) {
+        strcpy(errmsg, OUTOFMEM);
+        return;
+      }
+      memcpy(start, *inlines, words.end - *inlines - textlen);
+      kept->textlen = words.end - *inlines;
+      kept->numin = numin;
     }
   }
 
 /* Expand first word if preceeded only by spaces: */
 
-  w1 = head->next;
-  if (w1) {
+  if (words.n) {
     p1 = *inlines + prefix;
-    for (p2 = p1;  isspace(*p2);  ++p2);
-    if (w1->chrs == p2) {
-      w1->chrs = p1;
-      w1->length += p2 - p1;
+    for (p2 = p1;  p2 < *inends && isspace(*p2);  ++p2);
+    if (words.end - words.back[0] == p2) {
+      words.back[0] = words.end - p1;
+      words.length[0] += p2 - p1;
+      words.size[0] += p2 - p1;
     }
   }
 
+  setpos(&words, words.n - tail);
+
+  STATS_COUNT(words, words.n);
+  STATS_PHASE(PHASE_WORDS);
+
 /* Choose line breaks according to policy in "par.doc": */
 
-  newL = choosebreaks(head,tail,L,last,min);
-  if (is_error()) goto rfcleanup;
+  reuse = tail;
+  newL = quality ? qualitybreaks(&words,scratch,L,last,min,quality,errmsg)
+                 : choosebreaks(&words,L,last,min,&reuse,kept != NULL,errmsg);
+  if (*errmsg) return;
+  STATS_PHASE(PHASE_BREAKS);
 
-/* Construct the lines: */
+/* If the words after the edit were broken as before, find the */
+/* first line they start that the last output had too. The     */
+/* lines from there on are copied from it if their prefixes    */
+/* and suffixes are the same:                                  */
+
+  w1 = numout = 0;
+  if (reuse) {
+    outlines = (struct rfoutline *) kept->outlines.block + kept->outlines.max
+               - kept->numout;
+    for ( ;  w1 < words.n;  w1 += words.linewords[w1], ++numout) {
+      if (w1 < words.n - reuse) continue;
+      while (oi < kept->numout && outlines[oi].words > words.n - w1) ++oi;
+      if (oi < kept->numout && outlines[oi].words == words.n - w1) break;
+    }
+    if (w1 < words.n && outlines[kept->numout - 1].words
+        && numout + kept->numout - oi >= hang
+        && (!affix || sameaffixes(kept, oi, numout, inlines, suffixes,
+                                  numin, prefix, suffix, hang))) {
+      taillines = kept->numout - oi;
+      taillen = outlines[oi].start;
+    }
+  }
+  if (!taillines) w1 = words.n;
 
-  pbuf = newbuffer(sizeof (char *));
-  if (is_error()) goto rfcleanup;
+/* Make room for the lines, so that either all of them */
+/* are appended to out or none of them is. The lengths */
+/* of the lines are widths, which extra makes up for:  */
 
+  for (n = 0;  n < w1;  ++n)
+    extra += words.size[n] - words.length[n];
+
+  outlen = extra;
   numout = 0;
-  w1 = head->next;
-  while (numout < hang || w1) {
-    linelen = suffix ? newL + affix :
-                  w1 ? w1->linelen + prefix :
-                       prefix;
-    q1 = malloc((linelen + 1) * sizeof (char));
+  n = w1;
+  w1 = 0;
+  while (w1 < n || (!taillines && numout < hang)) {
+    outlen += (suffix ? newL + affix :
+                  w1 < words.n ? words.linelen[w1] + prefix :
+                                 prefix) + 1;
+    ++numout;
+    if (w1 < words.n) w1 += words.linewords[w1];
+  }
+
+  if (kept) {
+    start = q1 = rfroom(&kept->out, outlen + taillen, taillen, 1);
+    outlines = rfroom(&kept->outlines, numout + taillines, taillines,
+                      sizeof (struct rfoutline));
+    if (!q1 || !outlines) {
+      strcpy(errmsg, OUTOFMEM);
+      return;
+    }
+  }
+  else {
+    q1 = growbuffer(out, outlen);
     if (!q1) {
-      strcpy(err_msg,outofmem);
-      goto rfcleanup;
+      strcpy(errmsg, OUTOFMEM);
+      return;
     }
-    additem(pbuf, &q1);
-    if (is_error()) goto rfcleanup;
+  }
+
+/* Construct the lines: */
+
+  numout = 0;
+  w1 = 0;
+  while (w1 < n || (!taillines && numout < hang)) {
+    if (kept) {
+      outlines[numout].start = outlen + taillen - (q1 - start);
+      outlines[numout].words = w1 < words.n ? words.n - w1 : 0;
+    }
+    linelen = suffix ? newL + affix :
+                  w1 < words.n ? words.linelen[w1] + prefix :
+                                 prefix;
     ++numout;
     q2 = q1 + prefix;
     if      (numout <= numin) memcpy(q1, inlines[numout - 1], prefix);
     else if (numin > hang)    memcpy(q1, inlines[numin - 1], prefix);
     else                      while (q1 < q2) *q1++ = ' ';
     q1 = q2;
-    if (w1)
+    if (w1 < words.n)
       for (w2 = w1;  ; ) {
-        memcpy(q1, w2->chrs, w2->length);
-        q1 += w2->length;
-        w2 = w2->next;
-        if (w2 == w1->nextline) break;
+        memcpy(q1, words.end - words.back[w2], words.size[w2]);
+        q1 += words.size[w2];
+        ++w2;
+        if (w2 == w1 + words.linewords[w1]) break;
         *q1++ = ' ';
       }
-    q2 += linelen - affix;
+    q2 = q1 + linelen - affix;
+    if (w1 < words.n) q2 -= words.linelen[w1];
     while (q1 < q2) *q1++ = ' ';
     q2 = q1 + suffix;
     if      (numout <= numin) memcpy(q1, suffixes[numout - 1], suffix);
     else if (numin)           memcpy(q1, suffixes[numin - 1], suffix);
     else                      while(q1 < q2) *q1++ = ' ';
-    *q2 = '\0';
-    if (w1) w1 = w1->nextline;
+    *q2 = '\n';
+    q1 = q2 + 1;
+    if (w1 < words.n) w1 += words.linewords[w1];
   }
 
-  q1 = NULL;
-  additem(pbuf, &q1);
-  if (is_error()) goto rfcleanup;
+/* Append the lines, and those copied from the last output, */
+/* to out, and keep them for the next paragraph to reuse:   */
 
-  outlines = copyitems(pbuf);
+  if (kept) {
+    q1 = growbuffer(out, outlen + taillen);
+    if (!q1) {
+      strcpy(errmsg, OUTOFMEM);
+      return;
+    }
+    memcpy(q1, start, outlen + taillen);
+    kept->numout = numout + taillines;
+    kept->prefix = prefix;
+    kept->suffix = suffix;
+    kept->utf8 = utf8;
+    kept->w = words;
+  }
 
-rfcleanup:
+  STATS_PHASE(PHASE_OUTPUT);
+}
 
-  if (suffixes) free(suffixes);
 
-  while (tail != head) {
-    tail = tail->prev;
-    free(tail->next);
-  }
+void freescratch(struct rfscratch *scratch)
+{
+  struct rfprev *kept = scratch->prev;
 
-  if (pbuf) {
-    if (!outlines)
-      for (;;) {
-        outlines = nextitem(pbuf);
-        if (!outlines) break;
-        free(*outlines);
-      }
-    freebuffer(pbuf);
+  if (kept) {
+    free(kept->wordblock);
+    free(kept->text.block);
+    free(kept->lines.block);
+    free(kept->out.block);
+    free(kept->outlines.block);
   }
-
-  return outlines;
+  free(kept);
+  free(scratch->wordblock);
+  free(scratch->suffixes);
+  free(scratch->nodes);
+  scratch->wordblock = NULL;
+  scratch->suffixes = NULL;
+  scratch->prev = NULL;
+  scratch->nodes = NULL;
+  scratch->maxwords = scratch->maxlines = scratch->maxnodes = 0;
 }
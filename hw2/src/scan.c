@@ -0,0 +1,231 @@
+/*********************/
+/* scan.c            */
+/* for Par 3.20      */
+/*********************/
+
+/* This is ANSI C code, except for the SIMD intrinsics, */
+/* which are only compiled where the target has them.  */
+
+
+#include "scan.h"  /* Makes sure we're consistent with the prototypes. */
+
+#include <ctype.h>
+#include <string.h>
+
+#if !defined(PAR_SCALAR) && defined(__AVX2__)
+#include <immintrin.h>
+#define SCANBLOCK 32
+#elif !defined(PAR_SCALAR) && defined(__SSE2__)
+#include <emmintrin.h>
+#define SCANBLOCK 16
+#endif
+
+#undef NULL
+#define NULL ((void *) 0)
+
+
+const char *skipspace_scalar(const char *p, const char *end)
+{
+  while (p < end && isspace((unsigned char) *p)) ++p;
+  return p;
+}
+
+
+const char *skipword_scalar(const char *p, const char *end)
+{
+  while (p < end && !isspace((unsigned char) *p)) ++p;
+  return p;
+}
+
+
+const char *skipascii_scalar(const char *p, const char *end)
+{
+  while (p < end && !(*p & 0x80)) ++p;
+  return p;
+}
+
+
+size_t commonprefix_scalar(const char *a, const char *b, size_t n)
+{
+  size_t k;
+
+  for (k = 0;  k < n && a[k] == b[k];  ++k);
+  return k;
+}
+
+
+size_t commonsuffix_scalar(const char *a, const char *b, size_t n)
+{
+  size_t k;
+
+  for (k = 0;  k < n && a[-1-(long)k] == b[-1-(long)k];  ++k);
+  return k;
+}
+
+
+#ifndef SCANBLOCK
+
+const char *skipspace(const char *p, const char *end)
+{
+  return skipspace_scalar(p,end);
+}
+
+
+const char *skipword(const char *p, const char *end)
+{
+  return skipword_scalar(p,end);
+}
+
+
+const char *skipascii(const char *p, const char *end)
+{
+  return skipascii_scalar(p,end);
+}
+
+
+size_t commonprefix(const char *a, const char *b, size_t n)
+{
+  return commonprefix_scalar(a,b,n);
+}
+
+
+size_t commonsuffix(const char *a, const char *b, size_t n)
+{
+  return commonsuffix_scalar(a,b,n);
+}
+
+#else
+
+/* A block of SCANBLOCK bytes is classified at once into a bitmap, */
+/* bit k of which is set if byte k is white space (or, for the     */
+/* affix routines, differs between the two strings, and for        */
+/* skipascii(), has its high bit set, which is what the movemask   */
+/* gives directly). The first boundary is then the lowest (or      */
+/* highest) set bit. The white space chars are ' ' and '\t'        */
+/* through '\r'; the latter are found by biasing the bytes so that */
+/* that range falls at the bottom of the signed range, where a     */
+/* single compare picks it out.                                    */
+
+#if SCANBLOCK == 32
+
+typedef __m256i block;
+typedef unsigned long bitmap;
+#define LOAD(p)       _mm256_loadu_si256((const __m256i *) (p))
+#define SPLAT(c)      _mm256_set1_epi8(c)
+#define EQ(x,y)       _mm256_cmpeq_epi8(x,y)
+#define LT(x,y)       _mm256_cmpgt_epi8(y,x)
+#define ADD(x,y)      _mm256_add_epi8(x,y)
+#define OR(x,y)       _mm256_or_si256(x,y)
+#define MASK(x)       ((bitmap) (unsigned) _mm256_movemask_epi8(x))
+#define ALLBITS       0xffffffffUL
+
+#else
+
+typedef __m128i block;
+typedef unsigned long bitmap;
+#define LOAD(p)       _mm_loadu_si128((const __m128i *) (p))
+#define SPLAT(c)      _mm_set1_epi8(c)
+#define EQ(x,y)       _mm_cmpeq_epi8(x,y)
+#define LT(x,y)       _mm_cmplt_epi8(x,y)
+#define ADD(x,y)      _mm_add_epi8(x,y)
+#define OR(x,y)       _mm_or_si128(x,y)
+#define MASK(x)       ((bitmap) (unsigned) _mm_movemask_epi8(x))
+#define ALLBITS       0xffffUL
+
+#endif
+
+
+static bitmap spacebits(const char *p)
+/* Returns the bitmap of the white space in p[0..SCANBLOCK). */
+{
+  block x = LOAD(p);
+
+  return MASK(OR(EQ(x, SPLAT(' ')),
+                 LT(ADD(x, SPLAT(0x80 - '\t')), SPLAT(0x80 - 256 + ('\r' - '\t' + 1)))));
+}
+
+
+static bitmap diffbits(const char *a, const char *b)
+/* Returns the bitmap of the bytes that differ */
+/* between a and b in [0..SCANBLOCK).          */
+{
+  return ~MASK(EQ(LOAD(a), LOAD(b))) & ALLBITS;
+}
+
+
+static int lowbit(bitmap m)
+/* Returns the index of the lowest set bit of m, which is nonzero. */
+{
+  return __builtin_ctzl(m);
+}
+
+
+static int highbit(bitmap m)
+/* Returns the index of the highest set bit of m, which is nonzero. */
+{
+  return 8 * (int) sizeof (bitmap) - 1 - __builtin_clzl(m);
+}
+
+
+const char *skipspace(const char *p, const char *end)
+{
+  bitmap m;
+
+  for ( ;  end - p >= SCANBLOCK;  p += SCANBLOCK) {
+    m = ~spacebits(p) & ALLBITS;
+    if (m) return p + lowbit(m);
+  }
+  return skipspace_scalar(p,end);
+}
+
+
+const char *skipword(const char *p, const char *end)
+{
+  bitmap m;
+
+  for ( ;  end - p >= SCANBLOCK;  p += SCANBLOCK) {
+    m = spacebits(p);
+    if (m) return p + lowbit(m);
+  }
+  return skipword_scalar(p,end);
+}
+
+
+const char *skipascii(const char *p, const char *end)
+{
+  bitmap m;
+
+  for ( ;  end - p >= SCANBLOCK;  p += SCANBLOCK) {
+    m = MASK(LOAD(p));
+    if (m) return p + lowbit(m);
+  }
+  return skipascii_scalar(p,end);
+}
+
+
+size_t commonprefix(const char *a, const char *b, size_t n)
+{
+  size_t k;
+  bitmap m;
+
+  for (k = 0;  n - k >= SCANBLOCK;  k += SCANBLOCK) {
+    m = diffbits(a + k, b + k);
+    if (m) return k + lowbit(m);
+  }
+  return k + commonprefix_scalar(a + k, b + k, n - k);
+}
+
+
+size_t commonsuffix(const char *a, const char *b, size_t n)
+{
+  size_t k;
+  bitmap m;
+
+  for (k = 0;  n - k >= SCANBLOCK;  k += SCANBLOCK) {
+    m = diffbits(a - k - SCANBLOCK, b - k - SCANBLOCK);
+    if (m) return k + SCANBLOCK - 1 - highbit(m);
+  }
+  return k + commonsuffix_scalar(a - k, b - k, n - k);
+}
+
+#endif
@@ -0,0 +1,655 @@
+/*********************/
+/* serve.c           */
+/* for Par 3.20      */
+/*********************/
+
+
+#define _GNU_SOURCE     /* For accept4(). */
+
+#include "serve.h"      /* Makes sure we're consistent with the prototypes. */
+#include "errmsg.h"
+#include "libpar.h"     /* Also includes <stddef.h>. */
+#include "workqueue.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#undef NULL
+#define NULL ((void *) 0)
+
+
+#define HEADERLEN 28   /* The length of a request before the text.     */
+#define TIMEOUT   10   /* Seconds a client may take to send a request, */
+                       /*   from its first byte, or to take a response. */
+#define KEEPTEXT  (64 * 1024)  /* The most text kept between requests. */
+#define MINTEXT   4096         /* The least room made for text at once. */
+#define MAXEVENTS 64
+
+
+/* The main thread waits on an epoll set for the listening socket and */
+/* the connections, and reads each request, without waiting, as its   */
+/* bytes arrive. A connection is registered with EPOLLONESHOT, and    */
+/* re-armed after each read until its request is all in; it is then   */
+/* handed to the workqueue, and not watched again until a worker has  */
+/* answered the request and re-armed it. So the requests on a         */
+/* connection are answered in order, never by two workers at once,    */
+/* and no worker waits on a client that is slow to send. A request    */
+/* not all in TIMEOUT seconds after its first byte gets its           */
+/* connection closed. The text of a request is read into a buffer     */
+/* grown as it arrives, so a client can make par hold no more than it */
+/* has sent, and the text and unsent responses held for all clients   */
+/* together are kept within MAXHELD chars. A worker sends a response  */
+/* without waiting either: what the client hasn't room for is copied  */
+/* and handed back to the main thread, which sends the rest as the    */
+/* client takes it, and closes the connection if that takes longer    */
+/* than TIMEOUT seconds. Only the main thread closes connections: a   */
+/* worker done with one shuts it down and re-arms it, and the main    */
+/* thread then reads its EOF. The workqueue has no emitter, so a slow */
+/* request holds up no others, and its depth bounds the number of     */
+/* connections waiting for a worker.                                  */
+
+struct worker {
+  par_ctx *ctx;              /* Reused for every request.              */
+};
+
+struct conn {
+  int fd;
+  struct server *srv;
+  struct conn *prev, *next;  /* In srv->conns.                         */
+  unsigned char hdr[HEADERLEN];
+  size_t got;                /* Chars of the request read so far.      */
+  size_t len;                /* The length of its text, once known.    */
+  char *text;                /* The text of the request, with room     */
+  size_t textsize;           /*   for textsize chars.                  */
+  const char *reject;        /* The error to answer with instead, or   */
+                             /*   NULL.                                */
+  char *reply;               /* The rest of the response, for the main */
+                             /*   thread to send, or NULL.             */
+  size_t replylen;           /* Its length, and the chars of it sent   */
+  size_t replysent;          /*   so far.                              */
+  int shut;                  /* Shut down once the response is sent.   */
+  struct conn *nextback;     /* In srv->handback.                      */
+  time_t deadline;           /* When the request must be all in, or    */
+                             /*   the response all taken, or 0.        */
+};
+
+struct server {
+  int epfd;                  /* The epoll set.                         */
+  int wakefd;                /* An eventfd in it, for the workers to   */
+                             /*   wake the main thread.                */
+  struct par_opts opts;      /* The values par was started with.       */
+  struct worker *workers;    /* workers[k] belongs to worker k.        */
+  struct conn conns;         /* Sentinel of the list of connections.   */
+  int numwaiting;            /* Connections with a deadline.           */
+  pthread_mutex_t lock;      /* Protects the fields below.             */
+  size_t held;               /* Chars of text and replies allocated.   */
+  struct conn *handback;     /* Connections with responses left for    */
+                             /*   the main thread to send.             */
+};
+
+
+static volatile sig_atomic_t stopping;
+
+
+static void onsignal(int sig)
+{
+  stopping = 1;
+}
+
+
+static time_t now(void)
+/* Returns the seconds on a clock that is never set back. */
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec;
+}
+
+
+static int charge(struct server *srv, size_t n)
+
+/* Counts n more chars as held for clients, unless that would make */
+/* more than MAXHELD. Returns 1 on success.                        */
+{
+  int ok;
+
+  pthread_mutex_lock(&srv->lock);
+  ok = n <= MAXHELD - srv->held;
+  if (ok) srv->held += n;
+  pthread_mutex_unlock(&srv->lock);
+  return ok;
+}
+
+
+static void discharge(struct server *srv, size_t n)
+
+/* Counts n chars held for clients as released. */
+{
+  pthread_mutex_lock(&srv->lock);
+  srv->held -= n;
+  pthread_mutex_unlock(&srv->lock);
+}
+
+
+static int readpart(int fd, char *buf, size_t n, size_t *pgot)
+
+/* Reads into buf what has arrived on fd, without waiting, until */
+/* *pgot of the n chars are in. Returns 1 once they are, 0 if    */
+/* more are still to come, and -1 at EOF or on error.            */
+{
+  ssize_t r;
+
+  while (*pgot < n) {
+    r = recv(fd, buf + *pgot, n - *pgot, MSG_DONTWAIT);
+    if (r < 0 && errno == EINTR) continue;
+    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+    if (r <= 0) return -1;
+    *pgot += r;
+  }
+
+  return 1;
+}
+
+
+static int readrequest(struct conn *conn)
+
+/* Reads what has arrived of the request on conn. Returns as     */
+/* readpart() does, except that it returns 1 as soon as the      */
+/* request is to be rejected, for its length or for want of room */
+/* for its text.                                                 */
+{
+  uint32_t field;
+  size_t got, size;
+  char *text;
+  int r;
+
+  if (conn->got < HEADERLEN) {
+    r = readpart(conn->fd, (char *) conn->hdr, HEADERLEN, &conn->got);
+    if (r <= 0) return r;
+    memcpy(&field, conn->hdr, 4);
+    conn->len = ntohl(field);
+    if (conn->len > MAXREQUEST) {
+      conn->reject = "Request too long.\n";
+      return 1;
+    }
+  }
+
+/* Room for the text is made as it fills, doubling each time: */
+
+  for (;;) {
+    got = conn->got - HEADERLEN;
+    if (got == conn->textsize && got < conn->len) {
+      size = conn->textsize ? 2 * conn->textsize : MINTEXT;
+      if (size > conn->len) size = conn->len;
+      if (!charge(conn->srv, size - conn->textsize)) {
+        conn->reject = "Server busy.\n";
+        return 1;
+      }
+      text = realloc(conn->text, size);
+      if (!text) {
+        discharge(conn->srv, size - conn->textsize);
+        conn->reject = outofmem;
+        return 1;
+      }
+      conn->text = text;
+      conn->textsize = size;
+    }
+    r = readpart(conn->fd, conn->text,
+                 conn->len < conn->textsize ? conn->len : conn->textsize, &got);
+    conn->got = HEADERLEN + got;
+    if (r <= 0 || got == conn->len) return r;
+  }
+}
+
+
+static int sendpart(int fd, const char *buf, size_t n, size_t *psent)
+
+/* Sends on fd what it has room for, without waiting, until *psent */
+/* of the n chars at buf are sent. Returns 1 once they are, 0 if   */
+/* more are still to send, and -1 on error.                        */
+{
+  ssize_t r;
+
+  while (*psent < n) {
+    r = send(fd, buf + *psent, n - *psent, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (r < 0 && errno == EINTR) continue;
+    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+    if (r < 0) return -1;
+    *psent += r;
+  }
+
+  return 1;
+}
+
+
+static int respond(struct conn *conn, int status, const char *data,
+                   size_t len)
+
+/* Sends a response with the given status and the len chars at data  */
+/* on conn, as far as the client has room for it. The rest is copied */
+/* to conn->reply. Returns 0 on success, and -1 if the client has    */
+/* gone away or the rest can't be held.                              */
+{
+  uint32_t hdr[2];
+  struct iovec iov[2];
+  struct msghdr msg;
+  ssize_t r;
+  size_t rest, i;
+  char *p;
+
+  hdr[0] = htonl(status);
+  hdr[1] = htonl(len);
+  iov[0].iov_base = hdr;
+  iov[0].iov_len = sizeof hdr;
+  iov[1].iov_base = (char *) data;
+  iov[1].iov_len = len;
+  memset(&msg, 0, sizeof msg);
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 2;
+
+  while (msg.msg_iovlen) {
+    r = sendmsg(conn->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (r < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+      return -1;
+    }
+    for ( ;  msg.msg_iovlen && (size_t) r >= msg.msg_iov->iov_len;
+          ++msg.msg_iov, --msg.msg_iovlen)
+      r -= msg.msg_iov->iov_len;
+    if (msg.msg_iovlen) {
+      msg.msg_iov->iov_base = (char *) msg.msg_iov->iov_base + r;
+      msg.msg_iov->iov_len -= r;
+    }
+  }
+
+  if (!msg.msg_iovlen) return 0;
+  for (rest = 0, i = 0;  i < msg.msg_iovlen;  ++i)
+    rest += msg.msg_iov[i].iov_len;
+  if (!charge(conn->srv, rest)) return -1;
+  conn->reply = malloc(rest);
+  if (!conn->reply) {
+    discharge(conn->srv, rest);
+    return -1;
+  }
+  for (p = conn->reply;  msg.msg_iovlen;  ++msg.msg_iov, --msg.msg_iovlen) {
+    memcpy(p, msg.msg_iov->iov_base, msg.msg_iov->iov_len);
+    p += msg.msg_iov->iov_len;
+  }
+  conn->replylen = rest;
+  conn->replysent = 0;
+  return 0;
+}
+
+
+static void rearm(struct server *srv, struct conn *conn)
+
+/* Watches conn for its next request, first shutting it down, for */
+/* the main thread to close, if it is to be.                      */
+{
+  struct epoll_event ev;
+
+  if (conn->shut) shutdown(conn->fd, SHUT_RDWR);
+
+/* conn may be handed to another worker as soon as it is re-armed. */
+/* If it can't be, it is closed with the rest when par stops:      */
+
+  ev.events = EPOLLIN | EPOLLONESHOT;
+  ev.data.ptr = conn;
+  epoll_ctl(srv->epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+
+static void serveconn(void *item, int worker)
+
+/* Answers the request read on the struct conn item, then re-arms */
+/* it, to be shut down if the client has gone away or the request */
+/* was rejected. If the response is not all sent, conn is handed  */
+/* back to the main thread to send the rest instead.              */
+{
+  struct conn *conn = item;
+  struct server *srv = conn->srv;
+  struct worker *w = &srv->workers[worker];
+  struct par_opts opts;
+  uint32_t field;
+  uint64_t one = 1;
+  int vals[6], k, bad = 0;
+  size_t outlen;
+  const char *out;
+
+  if (conn->reject) {
+    conn->shut = 1;
+    respond(conn, 1, conn->reject, strlen(conn->reject));
+    goto done;
+  }
+
+  for (k = 0;  k < 6;  ++k) {
+    memcpy(&field, conn->hdr + 4 + 4 * k, 4);
+    vals[k] = (int32_t) ntohl(field);
+    if (vals[k] > 9999) bad = 1;
+  }
+
+  opts = srv->opts;
+  if (vals[0] >= 0) opts.width  = vals[0];
+  if (vals[1] >= 0) opts.prefix = vals[1];
+  if (vals[2] >= 0) opts.suffix = vals[2];
+  if (vals[3] >= 0) opts.hang   = vals[3];
+  if (vals[4] >= 0) opts.last   = vals[4];
+  if (vals[5] >= 0) opts.min    = vals[5];
+
+  if (bad) k = respond(conn, 1, "Bad option value.\n", 18);
+  else {
+    par_setopts(w->ctx, &opts);
+    if (par_reformat(w->ctx, conn->text ? conn->text : "", conn->len, &out, &outlen)) {
+      out = par_error(w->ctx);
+      k = respond(conn, 1, out, strlen(out));
+    }
+    else k = respond(conn, 0, out, outlen);
+  }
+  if (k) conn->shut = 1;
+
+done:
+
+  conn->got = 0;
+  if (conn->textsize > KEEPTEXT) {
+    free(conn->text);
+    discharge(srv, conn->textsize);
+    conn->text = NULL;
+    conn->textsize = 0;
+  }
+
+  if (!conn->reply) {
+    rearm(srv, conn);
+    return;
+  }
+
+  pthread_mutex_lock(&srv->lock);
+  conn->nextback = srv->handback;
+  srv->handback = conn;
+  pthread_mutex_unlock(&srv->lock);
+  write(srv->wakefd, &one, sizeof one);
+}
+
+
+static void setdeadline(struct server *srv, struct conn *conn, time_t deadline)
+
+/* Sets conn->deadline, keeping count of the connections with one. */
+{
+  srv->numwaiting += !!deadline - !!conn->deadline;
+  conn->deadline = deadline;
+}
+
+
+static void closeconn(struct server *srv, struct conn *conn)
+
+/* Closes conn, which is not with a worker, and frees it. */
+{
+  setdeadline(srv, conn, 0);
+  conn->prev->next = conn->next;
+  conn->next->prev = conn->prev;
+  close(conn->fd);
+  discharge(srv, conn->textsize + (conn->reply ? conn->replylen : 0));
+  free(conn->text);
+  free(conn->reply);
+  free(conn);
+}
+
+
+static void addconn(struct server *srv, int fd)
+
+/* Registers the newly accepted connection fd with srv, */
+/* or closes it if that can't be done.                  */
+{
+  struct conn *conn;
+  struct epoll_event ev;
+
+  conn = calloc(1, sizeof (struct conn));
+  if (conn) {
+    conn->fd = fd;
+    conn->srv = srv;
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.ptr = conn;
+    if (!epoll_ctl(srv->epfd, EPOLL_CTL_ADD, fd, &ev)) {
+      conn->next = srv->conns.next;
+      conn->prev = &srv->conns;
+      conn->next->prev = conn;
+      srv->conns.next = conn;
+      return;
+    }
+    free(conn);
+  }
+  close(fd);
+}
+
+
+static void onreadable(struct server *srv, struct workqueue *wq,
+                       struct conn *conn)
+
+/* Reads what has arrived on conn, then hands it to a worker if */
+/* its request is all in, watches it again if not, or closes it */
+/* at EOF or on error.                                          */
+{
+  struct epoll_event ev;
+  int r;
+
+  r = readrequest(conn);
+  if (r > 0) {
+    setdeadline(srv, conn, 0);
+    submitwork(wq, conn);
+    return;
+  }
+
+  if (r == 0) {
+    if (conn->got && !conn->deadline) setdeadline(srv, conn, now() + TIMEOUT);
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.ptr = conn;
+    if (!epoll_ctl(srv->epfd, EPOLL_CTL_MOD, conn->fd, &ev)) return;
+  }
+
+  closeconn(srv, conn);
+}
+
+
+static void onwritable(struct server *srv, struct conn *conn)
+
+/* Sends what conn has room for of the rest of its response, then */
+/* watches it for the next request once that is all sent, or for  */
+/* room to send more if not, or closes it on error.               */
+{
+  struct epoll_event ev;
+  int r;
+
+  r = sendpart(conn->fd, conn->reply, conn->replylen, &conn->replysent);
+  if (r > 0) {
+    setdeadline(srv, conn, 0);
+    discharge(srv, conn->replylen);
+    free(conn->reply);
+    conn->reply = NULL;
+    rearm(srv, conn);
+    return;
+  }
+
+  if (r == 0) {
+    ev.events = EPOLLOUT | EPOLLONESHOT;
+    ev.data.ptr = conn;
+    if (!epoll_ctl(srv->epfd, EPOLL_CTL_MOD, conn->fd, &ev)) return;
+  }
+
+  closeconn(srv, conn);
+}
+
+
+static void takeback(struct server *srv)
+
+/* Takes back from the workers the connections with responses */
+/* left to send, giving each TIMEOUT seconds to be taken.     */
+{
+  struct conn *conn, *next;
+  uint64_t n;
+
+  read(srv->wakefd, &n, sizeof n);
+  pthread_mutex_lock(&srv->lock);
+  conn = srv->handback;
+  srv->handback = NULL;
+  pthread_mutex_unlock(&srv->lock);
+
+  for ( ;  conn;  conn = next) {
+    next = conn->nextback;
+    setdeadline(srv, conn, now() + TIMEOUT);
+    onwritable(srv, conn);
+  }
+}
+
+
+static void closelate(struct server *srv)
+
+/* Closes the connections that are past their deadlines. */
+{
+  struct conn *conn, *next;
+  time_t t = now();
+
+  for (conn = srv->conns.next;  conn != &srv->conns;  conn = next) {
+    next = conn->next;
+    if (conn->deadline && conn->deadline <= t) closeconn(srv, conn);
+  }
+}
+
+
+void parserve(const char *path, const struct par_opts *opts, int numworkers)
+{
+  struct server srv;
+  struct sockaddr_un addr;
+  struct epoll_event ev, wev, events[MAXEVENTS];
+  struct sigaction sa;
+  struct stat st;
+  struct workqueue *wq;
+  struct conn *conn;
+  sigset_t sigs, oldsigs;
+  int lfd = -1, fd, n, i, k, bound = 0;
+  char errbuf[176];
+
+  srv.epfd = srv.wakefd = -1;
+  srv.opts = *opts;
+  srv.conns.next = srv.conns.prev = &srv.conns;
+  srv.numwaiting = 0;
+  pthread_mutex_init(&srv.lock, NULL);
+  srv.held = 0;
+  srv.handback = NULL;
+  srv.workers = calloc(numworkers, sizeof (struct worker));
+  if (!srv.workers) {
+    set_error((char *) outofmem);
+    return;
+  }
+  for (k = 0;  k < numworkers;  ++k) {
+    srv.workers[k].ctx = par_new(NULL);
+    if (!srv.workers[k].ctx) {
+      set_error((char *) outofmem);
+      goto pscleanup;
+    }
+  }
+
+  if (strlen(path) >= sizeof addr.sun_path) {
+    sprintf(errbuf, "Socket path too long: %.100s\n", path);
+    set_error(errbuf);
+    goto pscleanup;
+  }
+  memset(&addr, 0, sizeof addr);
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  if (!lstat(path, &st) && S_ISSOCK(st.st_mode)) unlink(path);
+
+  lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (lfd < 0 || bind(lfd, (struct sockaddr *) &addr, sizeof addr)) {
+    sprintf(errbuf, "Cannot bind %.100s: %.40s\n", path, strerror(errno));
+    set_error(errbuf);
+    goto pscleanup;
+  }
+  bound = 1;
+
+/* The listening socket is known in the epoll set by a NULL */
+/* pointer, and the eventfd by a pointer to it:             */
+
+  srv.epfd = epoll_create1(EPOLL_CLOEXEC);
+  srv.wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  ev.events = wev.events = EPOLLIN;
+  ev.data.ptr = NULL;
+  wev.data.ptr = &srv.wakefd;
+  if (listen(lfd, SOMAXCONN) || srv.epfd < 0 || srv.wakefd < 0
+      || epoll_ctl(srv.epfd, EPOLL_CTL_ADD, lfd, &ev)
+      || epoll_ctl(srv.epfd, EPOLL_CTL_ADD, srv.wakefd, &wev)) {
+    sprintf(errbuf, "Cannot listen on %.100s: %.40s\n", path, strerror(errno));
+    set_error(errbuf);
+    goto pscleanup;
+  }
+
+/* SIGINT and SIGTERM are blocked, and so never interrupt the      */
+/* workers, which inherit the mask, except while epoll_pwait()     */
+/* waits here. So one that arrives after stopping is tested is not */
+/* lost, but ends the wait that follows:                           */
+
+  memset(&sa, 0, sizeof sa);
+  sa.sa_handler = onsignal;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  sigemptyset(&sigs);
+  sigaddset(&sigs, SIGINT);
+  sigaddset(&sigs, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &sigs, &oldsigs);
+  wq = newworkqueue(numworkers, 4 * numworkers, serveconn, NULL);
+  if (!wq) {
+    pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+    goto pscleanup;
+  }
+
+  while (!stopping) {
+    n = epoll_pwait(srv.epfd, events, MAXEVENTS, srv.numwaiting ? 1000 : -1,
+                    &oldsigs);
+    if (n < 0 && errno != EINTR) {
+      sprintf(errbuf, "epoll_pwait() failed: %.40s\n", strerror(errno));
+      set_error(errbuf);
+      break;
+    }
+    for (i = 0;  i < n;  ++i) {
+      conn = events[i].data.ptr;
+      if (conn == (struct conn *) &srv.wakefd) takeback(&srv);
+      else if (!conn)
+        while ((fd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC)) >= 0)
+          addconn(&srv, fd);
+      else if (conn->reply) onwritable(&srv, conn);
+      else onreadable(&srv, wq, conn);
+    }
+    if (srv.numwaiting) closelate(&srv);
+  }
+
+  finishwork(wq);
+  pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+  while (srv.conns.next != &srv.conns) closeconn(&srv, srv.conns.next);
+
+pscleanup:
+
+  if (lfd >= 0) close(lfd);
+  if (srv.epfd >= 0) close(srv.epfd);
+  if (srv.wakefd >= 0) close(srv.wakefd);
+  if (bound) unlink(path);
+  for (k = 0;  k < numworkers;  ++k) {
+    par_free(srv.workers[k].ctx);
+  }
+  free(srv.workers);
+  pthread_mutex_destroy(&srv.lock);
+}
@@ -0,0 +1,99 @@
+/*********************/
+/* stats.c           */
+/* for Par 3.20      */
+/*********************/
+
+/* This is ANSI C code. */
+
+
+#include "stats.h"  /* Makes sure we're consistent with the prototypes. */
+
+#ifdef PAR_STATS
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+
+__thread struct parstats parstats;
+
+/* The counts merged so far, protected by totallock: */
+
+static struct parstats total;
+static pthread_mutex_t totallock = PTHREAD_MUTEX_INITIALIZER;
+
+
+static double now(void)
+/* Returns the time in seconds from a fixed point. */
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+void statsstart(void)
+{
+  parstats.last = now();
+}
+
+
+void statsphase(enum parphase phase)
+{
+  double t = now();
+
+  parstats.seconds[phase] += t - parstats.last;
+  parstats.last = t;
+}
+
+
+void statsmerge(void)
+{
+  int k;
+
+  pthread_mutex_lock(&totallock);
+  for (k = 0;  k < NUMPHASES;  ++k) total.seconds[k] += parstats.seconds[k];
+  for (k = 0;  k < NUMPASSES;  ++k) total.steps[k] += parstats.steps[k];
+  total.paragraphs += parstats.paragraphs;
+  total.lines += parstats.lines;
+  total.words += parstats.words;
+  total.blocks += parstats.blocks;
+  total.bytesin += parstats.bytesin;
+  total.bytesout += parstats.bytesout;
+  pthread_mutex_unlock(&totallock);
+
+  memset(&parstats, 0, sizeof parstats);
+}
+
+
+void statsreport(FILE *f)
+{
+  static const char * const phases[NUMPHASES] =
+    { "read", "defaults", "words", "breaks", "output" };
+  static const char * const passes[NUMPASSES] =
+    { "shortest", "longest", "score", "quality" };
+  double sum = 0;
+  int k;
+
+  statsmerge();
+
+  pthread_mutex_lock(&totallock);
+  fprintf(f, "paragraphs %ld\n", total.paragraphs);
+  fprintf(f, "lines %ld\n", total.lines);
+  fprintf(f, "words %ld\n", total.words);
+  for (k = 0;  k < NUMPASSES;  ++k)
+    fprintf(f, "steps.%s %ld\n", passes[k], total.steps[k]);
+  fprintf(f, "blocks %ld\n", total.blocks);
+  fprintf(f, "bytes.in %ld\n", total.bytesin);
+  fprintf(f, "bytes.out %ld\n", total.bytesout);
+  for (k = 0;  k < NUMPHASES;  ++k) {
+    fprintf(f, "ms.%s %.3f\n", phases[k], total.seconds[k] * 1e3);
+    sum += total.seconds[k];
+  }
+  fprintf(f, "ms.total %.3f\n", sum * 1e3);
+  pthread_mutex_unlock(&totallock);
+}
+
+#endif
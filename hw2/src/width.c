@@ -0,0 +1,103 @@
+/*********************/
+/* width.c           */
+/* for Par 3.20      */
+/*********************/
+
+
+#include "width.h"  /* Makes sure we're consistent with the prototypes. */
+
+#include <stdint.h>
+#include <string.h>
+
+#define HIGHBITS 0x8080808080808080ULL
+
+
+int charwidth(long c)
+{
+  if (c >= 0x40000) return c >= 0xE0000 && c <= 0xE0FFF ? 0 : 1;
+
+  return widthblocks[widthindex[c >> 8]][(c & 0xff) >> 2] >> 2 * (c & 3) & 3;
+}
+
+
+static int decode(const unsigned char *p, const unsigned char *end, long *pc)
+
+/* Decodes the UTF-8 sequence starting at p, which must end no later */
+/* than end, setting *pc to its code point. Returns its length, or 0 */
+/* if it is not a valid sequence. *p must be at least 0x80.          */
+{
+  long c = *p, least;
+  int len, k;
+
+  if (c < 0xC2 || c >= 0xF5) return 0;
+  if (c < 0xE0) {
+    c &= 0x1F;
+    len = 2;
+    least = 0x80;
+  }
+  else if (c < 0xF0) {
+    c &= 0x0F;
+    len = 3;
+    least = 0x800;
+  }
+  else {
+    c &= 0x07;
+    len = 4;
+    least = 0x10000;
+  }
+
+  if (end - p < len) return 0;
+  for (k = 1;  k < len;  ++k) {
+    if ((p[k] & 0xC0) != 0x80) return 0;
+    c = c << 6 | (p[k] & 0x3F);
+  }
+  if (c < least || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) return 0;
+
+  *pc = c;
+  return len;
+}
+
+
+const char *spanwidth(const char *p, const char *end, int max, int *pwidth)
+{
+  const unsigned char *q = (const unsigned char *) p,
+                      *e = (const unsigned char *) end;
+  uint64_t block;
+  long c;
+  int width = 0, len, cw;
+
+/* Take eight chars at a time while none has its high bit set: */
+
+  while (e - q >= 8 && width + 8 <= max) {
+    memcpy(&block, q, 8);
+    if (block & HIGHBITS) break;
+    q += 8;
+    width += 8;
+  }
+
+/* And the few left over, which for most words are all of them: */
+
+  if (e - q < 8 && width + (e - q) <= max) {
+    block = 0;
+    memcpy(&block, q, e - q);
+    if (!(block & HIGHBITS)) {
+      width += e - q;
+      q = e;
+    }
+  }
+
+  while (q < e) {
+    len = cw = 1;
+    if (*q >= 0x80) {
+      len = decode(q, e, &c);
+      if (len) cw = charwidth(c);
+      else len = 1;
+    }
+    if (width + cw > max && q > (const unsigned char *) p) break;
+    q += len;
+    width += cw;
+  }
+
+  *pwidth = width;
+  return (const char *) q;
+}
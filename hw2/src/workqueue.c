@@ -0,0 +1,208 @@
+/*********************/
+/* workqueue.c       */
+/* for Par 3.20      */
+/*********************/
+
+
+#include "workqueue.h"  /* Makes sure we're consistent with the prototypes. */
+#include "errmsg.h"
+#include "stats.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#undef NULL
+#define NULL ((void *) 0)
+
+
+/* Items live in a ring of depth slots. The items numbered head     */
+/* through tail-1 are in the queue; those before next have been     */
+/* taken by a worker, and done[k % depth] tells whether item k is   */
+/* finished. Without an emitter, head is kept equal to next, so a   */
+/* slot is free as soon as its item is taken. Every field is        */
+/* protected by lock.                                               */
+
+struct workqueue {
+  pthread_mutex_t lock;
+  pthread_cond_t workready,   /* Signaled when next < tail or stopping. */
+                 workdone,    /* Signaled when an item is finished.     */
+                 spaceready;  /* Signaled when an item is emitted.      */
+  void **items;
+  int *done, depth, numworkers, numstarted, numrunning, stopping, failed;
+  long head, next, tail;
+  pthread_t *workers, emitter;
+  void (*work)(void *item, int worker);
+  int (*emit)(void *item, int failed);
+};
+
+
+static void *workerthread(void *arg)
+{
+  struct workqueue *wq = arg;
+  void *item;
+  long k;
+  int worker;
+
+  pthread_mutex_lock(&wq->lock);
+  worker = wq->numrunning++;
+  for (;;) {
+    while (wq->next == wq->tail && !wq->stopping)
+      pthread_cond_wait(&wq->workready, &wq->lock);
+    if (wq->next == wq->tail) break;
+    k = wq->next++;
+    item = wq->items[k % wq->depth];
+    if (!wq->emit) {
+      wq->head = wq->next;
+      pthread_cond_signal(&wq->spaceready);
+    }
+    pthread_mutex_unlock(&wq->lock);
+    wq->work(item, worker);
+    pthread_mutex_lock(&wq->lock);
+    if (wq->emit) {
+      wq->done[k % wq->depth] = 1;
+      pthread_cond_signal(&wq->workdone);
+    }
+  }
+  pthread_mutex_unlock(&wq->lock);
+
+  STATS_MERGE();
+  return NULL;
+}
+
+
+static void *emitterthread(void *arg)
+{
+  struct workqueue *wq = arg;
+  void *item;
+  int failed;
+
+  pthread_mutex_lock(&wq->lock);
+  for (;;) {
+    while (wq->head == wq->tail ? !wq->stopping
+                                : !wq->done[wq->head % wq->depth])
+      pthread_cond_wait(&wq->workdone, &wq->lock);
+    if (wq->head == wq->tail) break;
+    item = wq->items[wq->head % wq->depth];
+    failed = wq->failed;
+    pthread_mutex_unlock(&wq->lock);
+    failed = wq->emit(item, failed) || failed;
+    pthread_mutex_lock(&wq->lock);
+    wq->failed = failed;
+    wq->done[wq->head++ % wq->depth] = 0;
+    pthread_cond_signal(&wq->spaceready);
+  }
+  pthread_mutex_unlock(&wq->lock);
+
+  STATS_MERGE();
+  return NULL;
+}
+
+
+static void stopthreads(struct workqueue *wq, int emitting)
+/* Stops the wq->numstarted workers, and also the emitter */
+/* if emitting is nonzero, and waits for them to finish.  */
+{
+  int i;
+
+  pthread_mutex_lock(&wq->lock);
+  wq->stopping = 1;
+  pthread_cond_broadcast(&wq->workready);
+  pthread_cond_broadcast(&wq->workdone);
+  pthread_mutex_unlock(&wq->lock);
+
+  for (i = 0;  i < wq->numstarted;  ++i)
+    pthread_join(wq->workers[i], NULL);
+  if (emitting) pthread_join(wq->emitter, NULL);
+}
+
+
+static void freeworkqueue(struct workqueue *wq)
+{
+  pthread_mutex_destroy(&wq->lock);
+  pthread_cond_destroy(&wq->workready);
+  pthread_cond_destroy(&wq->workdone);
+  pthread_cond_destroy(&wq->spaceready);
+  free(wq->items);
+  free(wq->done);
+  free(wq->workers);
+  free(wq);
+}
+
+
+struct workqueue *newworkqueue(int numworkers, int depth,
+                               void (*work)(void *item, int worker),
+                               int (*emit)(void *item, int failed))
+{
+  struct workqueue *wq;
+  int i;
+
+  wq = malloc(sizeof (struct workqueue));
+  if (!wq) {
+    set_error((char *) outofmem);
+    return NULL;
+  }
+
+  wq->items = malloc(depth * sizeof (void *));
+  wq->done = calloc(depth, sizeof (int));
+  wq->workers = malloc(numworkers * sizeof (pthread_t));
+  pthread_mutex_init(&wq->lock, NULL);
+  pthread_cond_init(&wq->workready, NULL);
+  pthread_cond_init(&wq->workdone, NULL);
+  pthread_cond_init(&wq->spaceready, NULL);
+  wq->depth = depth;
+  wq->numworkers = numworkers;
+  wq->numstarted = wq->numrunning = wq->stopping = wq->failed = 0;
+  wq->head = wq->next = wq->tail = 0;
+  wq->work = work;
+  wq->emit = emit;
+
+  if (!wq->items || !wq->done || !wq->workers) {
+    set_error((char *) outofmem);
+    freeworkqueue(wq);
+    return NULL;
+  }
+
+  for (i = 0;  i < numworkers;  ++i) {
+    if (pthread_create(&wq->workers[i], NULL, workerthread, wq)) break;
+    ++wq->numstarted;
+  }
+
+  if (i < numworkers ||
+      (emit && pthread_create(&wq->emitter, NULL, emitterthread, wq))) {
+    set_error("Cannot create threads.\n");
+    stopthreads(wq,0);
+    freeworkqueue(wq);
+    return NULL;
+  }
+
+  clear_error();
+  return wq;
+}
+
+
+int submitwork(struct workqueue *wq, void *item)
+{
+  int failed;
+
+  pthread_mutex_lock(&wq->lock);
+  while (wq->tail - wq->head == wq->depth)
+    pthread_cond_wait(&wq->spaceready, &wq->lock);
+  wq->items[wq->tail++ % wq->depth] = item;
+  pthread_cond_signal(&wq->workready);
+  failed = wq->failed;
+  pthread_mutex_unlock(&wq->lock);
+
+  return failed;
+}
+
+
+int finishwork(struct workqueue *wq)
+{
+  int failed;
+
+  stopthreads(wq, wq->emit != NULL);
+  failed = wq->failed;
+  freeworkqueue(wq);
+
+  return failed;
+}
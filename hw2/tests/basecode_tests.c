@@ -1,9 +1,21 @@
+#include <ctype.h>
 #include <stdio.h>
+#include <signal.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <utime.h>
 
 #include <criterion/criterion.h>
 #include <criterion/logging.h>
 
 #include "test_common.h"
+#include "buffer.h"
+#include "libpar.h"
+#include "scan.h"
 
 #define STANDARD_LIMITS "ulimit -t 10; ulimit -f 2000"
 
@@ -43,6 +55,502 @@ Test(base_suite, prefix_suffix_test) {
     assert_outfile_matches(name, NULL);
 }
 
+/*
+ * Run the program with default options on a single paragraph of
+ * many lines and check that the line breaks chosen are unchanged.
+ */
+Test(base_suite, long_paragraph_test) {
+    char *name = "long_paragraph";
+    sprintf(program_options, "%s", "");
+    int err = run_using_system(name, "", "", STANDARD_LIMITS);
+    assert_expected_status(EXIT_SUCCESS, err);
+    assert_outfile_matches(name, NULL);
+}
+
+/*
+ * Run the program with four worker threads on an input file with
+ * many paragraphs and check that the results are the same, and in
+ * the same order, as when it is run without -j.
+ */
+Test(base_suite, jobs_test) {
+    char *name = "jobs";
+    sprintf(program_options, "%s", "-j 4");
+    int err = run_using_system(name, "", "", STANDARD_LIMITS);
+    assert_expected_status(EXIT_SUCCESS, err);
+    assert_outfile_matches(name, NULL);
+}
+
+/*
+ * Run the program with a 1 kilobyte window on a quoted paragraph of
+ * several kilobytes followed by a short one, and check that the
+ * prefix is kept on every line of the windowed paragraph.
+ */
+Test(base_suite, window_test) {
+    char *name = "window";
+    sprintf(program_options, "%s", "-W 1");
+    int err = run_using_system(name, "", "", STANDARD_LIMITS);
+    assert_expected_status(EXIT_SUCCESS, err);
+    assert_outfile_matches(name, NULL);
+}
+
+/*
+ * Run the program with a 1 kilobyte window on a quoted paragraph with
+ * a line longer than the window, so that a window ends part way
+ * through it, and check that the suffix is kept on every line and not
+ * taken from the end of the line cut short.
+ */
+Test(base_suite, window_midline_test) {
+    char *name = "window_midline";
+    sprintf(program_options, "%s", "-W 1");
+    int err = run_using_system(name, "", "", STANDARD_LIMITS);
+    assert_expected_status(EXIT_SUCCESS, err);
+    assert_outfile_matches(name, NULL);
+}
+
+/*
+ * Run the program with total-fit line breaking on a long sentence and
+ * a quoted paragraph, and check that it breaks after punctuation where
+ * it can, and leaves no word alone on a last line.
+ */
+Test(base_suite, quality_test) {
+    char *name = "quality";
+    sprintf(program_options, "%s", "--quality -w 40");
+    int err = run_using_system(name, "", "", STANDARD_LIMITS);
+    assert_expected_status(EXIT_SUCCESS, err);
+    assert_outfile_matches(name, NULL);
+}
+
+/*
+ * Run the program in UTF-8 mode on a boxed paragraph of accented,
+ * combining, wide and emoji chars, and check that the lines are
+ * broken and padded by their width in columns.
+ */
+Test(base_suite, utf8_test) {
+    char *name = "utf8";
+    sprintf(program_options, "%s", "--utf8 -w 40");
+    int err = run_using_system(name, "", "", STANDARD_LIMITS);
+    assert_expected_status(EXIT_SUCCESS, err);
+    assert_outfile_matches(name, NULL);
+}
+
+/*
+ * Run the program with --stats, which the ordinary build leaves out so
+ * as to pay nothing for the counters, and check that it is refused.
+ */
+Test(base_suite, stats_test) {
+    char *name = "stats";
+    sprintf(program_options, "%s", "--stats");
+    int err = run_using_system(name, "", "", STANDARD_LIMITS);
+    assert_expected_status(EXIT_FAILURE, err);
+}
+
+/*
+ * Run the PAR_STATS build with --stats on a fixed input, and check the
+ * paragraph, line and word counts it reports, and that the times of
+ * reading and writing are reported.
+ */
+Test(base_suite, stats_counts_test) {
+    const char *in = "test_output/stats_in.txt", *err = "test_output/stats_err.txt";
+    const char *names[3] = { "paragraphs", "lines", "words" };
+    long exp[3] = { 3, 4, 8 }, got[3] = { -1, -1, -1 };
+    int timed = 0;
+    char cmd[200], name[40];
+    double value;
+
+    mkdir("test_output", 0777);
+    FILE *f = fopen(in, "w");
+    cr_assert_not_null(f, "Could not create %s", in);
+    fputs("one two three\nfour five\n\nsix seven\n\n\neight\n", f);
+    fclose(f);
+
+    sprintf(cmd, "%s_stats --stats < %s > /dev/null 2> %s", PROGNAME, in, err);
+    int status = system(cmd);
+    assert_normal_exit(status);
+
+    f = fopen(err, "r");
+    cr_assert_not_null(f, "No statistics");
+    while (fscanf(f, "%39s %lf", name, &value) == 2) {
+        for (int i = 0;  i < 3;  ++i)
+            if (!strcmp(name, names[i])) got[i] = value;
+        if (!strcmp(name, "ms.read") || !strcmp(name, "ms.output")) ++timed;
+    }
+    fclose(f);
+    for (int i = 0;  i < 3;  ++i)
+        cr_assert_eq(got[i], exp[i], "%s is %ld, not %ld", names[i], got[i], exp[i]);
+    cr_assert_eq(timed, 2, "Times of reading and writing not reported");
+}
+
+/*
+ * Reformat text in-process through libpar, using one context for
+ * several calls, and check the output and the error reporting.
+ */
+Test(base_suite, libpar_test) {
+    struct par_opts opts = { 20, -1, -1, -1, -1, -1 };
+    const char *out;
+    size_t outlen;
+    par_ctx *ctx = par_new(&opts);
+    cr_assert_not_null(ctx, "par_new() failed");
+
+    const char *in1 = "The quick brown fox jumps over the lazy dog.\n\n  \nlast";
+    const char *exp1 = "The quick brown fox\njumps over the lazy\ndog.\n\n\nlast\n";
+    int err = par_reformat(ctx, in1, strlen(in1), &out, &outlen);
+    cr_assert_eq(err, 0, "par_reformat() failed: %s", par_error(ctx));
+    cr_assert(outlen == strlen(exp1) && !memcmp(out, exp1, outlen),
+              "Unexpected output: '%.*s'", (int)outlen, out);
+
+    const char *in2 = "> one two\n> three\n";
+    const char *exp2 = "> one two three\n";
+    err = par_reformat(ctx, in2, strlen(in2), &out, &outlen);
+    cr_assert_eq(err, 0, "par_reformat() failed: %s", par_error(ctx));
+    cr_assert(outlen == strlen(exp2) && !memcmp(out, exp2, outlen),
+              "Unexpected output: '%.*s'", (int)outlen, out);
+
+    const char *in3 = "one two\nthree four five";     /* Only "one two\nthree". */
+    const char *exp3 = "one two three\n";
+    err = par_reformat(ctx, in3, 13, &out, &outlen);
+    cr_assert_eq(err, 0, "par_reformat() failed: %s", par_error(ctx));
+    cr_assert(outlen == strlen(exp3) && !memcmp(out, exp3, outlen),
+              "Unexpected output: '%.*s'", (int)outlen, out);
+    par_free(ctx);
+
+    opts.width = 4;
+    opts.prefix = 5;
+    ctx = par_new(&opts);
+    cr_assert_not_null(ctx, "par_new() failed");
+    err = par_reformat(ctx, "abc\n", 4, &out, &outlen);
+    cr_assert_eq(err, -1, "par_reformat() should have failed");
+    cr_assert_not_null(par_error(ctx), "No error message");
+    cr_assert_eq(outlen, 0, "Output produced for a failed paragraph");
+    par_free(ctx);
+}
+
+/*
+ * Edit a long paragraph at several places, reflowing it after each
+ * edit, and check that the output is the same as reformatting it
+ * from scratch.
+ */
+Test(base_suite, reflow_test) {
+    struct par_opts opts = { 60, -1, -1, -1, 1, 1 };
+    const char *out1, *out2;
+    size_t len = 0, outlen1, outlen2, edits[] = { 5000, 9000, 100, 5001, 0 };
+    char text[10000];
+    par_ctx *ctx1 = par_new(&opts), *ctx2 = par_new(&opts);
+    cr_assert(ctx1 && ctx2, "par_new() failed");
+
+    for (int i = 0;  len < sizeof(text) - 20;  ++i)
+        len += sprintf(text + len, "%.*s%c", 1 + i * 7 % 9, "paragraphs", i % 10 == 9 ? '\n' : ' ');
+
+    for (int e = 0;  e < sizeof(edits) / sizeof(edits[0]);  ++e) {
+        size_t at = edits[e] < len ? edits[e] : len - 1;
+        if (text[at] != '\n') text[at] = e % 2 ? ' ' : 'x';
+        int err1 = par_reflow(ctx1, text, len, at + 1, &out1, &outlen1);
+        int err2 = par_reformat(ctx2, text, len, &out2, &outlen2);
+        cr_assert(err1 == 0 && err2 == 0, "Reformatting failed");
+        cr_assert(outlen1 == outlen2 && !memcmp(out1, out2, outlen1),
+                  "Reflowed output differs after edit at %zu", at);
+    }
+    par_free(ctx1);
+    par_free(ctx2);
+}
+
+/*
+ * Reflow a quoted paragraph after inserting and deleting text, which
+ * moves the words after the edit and the output lines copied from the
+ * last output, and check it against reformatting from scratch.
+ */
+Test(base_suite, reflow_splice_test) {
+    struct par_opts opts = { 50, -1, -1, -1, -1, -1 };
+    const char *out1, *out2;
+    size_t len = 0, outlen1, outlen2, edits[] = { 3000, 40, 6000, 41, 7000 };
+    char text[8000];
+    par_ctx *ctx1 = par_new(&opts), *ctx2 = par_new(&opts);
+    cr_assert(ctx1 && ctx2, "par_new() failed");
+
+    for (int i = 0;  len < sizeof(text) - 100;  ++i)
+        len += sprintf(text + len, "%s%.*s%c", i % 8 ? "" : "> ", 1 + i * 5 % 9,
+                       "abcdefghijklmnopqrstuvwxyz" + i * 7 % 17, i % 8 == 7 ? '\n' : ' ');
+
+    for (int e = 0;  e < sizeof(edits) / sizeof(edits[0]);  ++e) {
+        size_t at = edits[e];
+        while (!islower(text[at]) || !islower(text[at+1]) || !islower(text[at+2])) ++at;
+        if (e % 2) {
+            memmove(text + at + 4, text + at, len - at);
+            memcpy(text + at, "new ", 4);
+            len += 4;
+        }
+        else {
+            memmove(text + at, text + at + 3, len - at - 3);
+            len -= 3;
+        }
+        int err1 = par_reflow(ctx1, text, len, at + (e % 2 ? 4 : 0), &out1, &outlen1);
+        int err2 = par_reformat(ctx2, text, len, &out2, &outlen2);
+        cr_assert(err1 == 0 && err2 == 0, "Reformatting failed");
+        cr_assert(outlen1 == outlen2 && !memcmp(out1, out2, outlen1),
+                  "Reflowed output differs after edit at %zu", at);
+    }
+    par_free(ctx1);
+    par_free(ctx2);
+}
+
+/*
+ * Start the program as a daemon on a Unix domain socket, send it two
+ * requests with different options on one connection, and check the
+ * responses. Then stop it and check that it removes the socket.
+ */
+Test(base_suite, serve_test) {
+    const char *path = "test_output/serve.sock";
+    const char *text = "one two three four five six\n";
+    const char *exp[2] = { "one two three\nfour five six\n", "one two three four five six\n" };
+    int32_t req[7];
+    uint32_t resp[2];
+    char out[100];
+    struct sockaddr_un addr = { AF_UNIX };
+
+    mkdir("test_output", 0777);
+    unlink(path);
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl(PROGNAME, PROGNAME, "--serve", path, "-j", "2", (char *)NULL);
+        _exit(127);
+    }
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    int tries = 0;
+    while (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) && ++tries < 100) usleep(20000);
+    cr_assert_lt(tries, 100, "Could not connect to the daemon");
+
+    for (int i = 0;  i < 2;  ++i) {
+        req[0] = htonl(strlen(text));
+        req[1] = htonl(i ? -1 : 15);
+        for (int k = 2;  k < 7;  ++k) req[k] = htonl(-1);
+        cr_assert(write(fd, req, sizeof(req)) == sizeof(req) && write(fd, text, strlen(text)) == strlen(text));
+        cr_assert(read(fd, resp, sizeof(resp)) == sizeof(resp), "No response");
+        cr_assert_eq(ntohl(resp[0]), 0, "Request failed");
+        size_t len = ntohl(resp[1]), got = 0;
+        cr_assert(len < sizeof(out));
+        while (got < len) got += read(fd, out + got, len - got);
+        cr_assert(len == strlen(exp[i]) && !memcmp(out, exp[i], len),
+                  "Unexpected output: '%.*s'", (int)len, out);
+    }
+    close(fd);
+
+    int status;
+    kill(pid, SIGTERM);
+    waitpid(pid, &status, 0);
+    assert_normal_exit(status);
+    cr_assert(access(path, F_OK) != 0, "Socket not removed");
+}
+
+/*
+ * Start the daemon with one worker, and have one client send part of
+ * a request and stall. Another client must still be answered at once,
+ * since requests are read in full before a worker takes them, and the
+ * daemon must still stop cleanly with the stalled connection open.
+ */
+Test(base_suite, serve_stalled_client_test) {
+    const char *path = "test_output/serve_stalled.sock";
+    const char *text = "one two\n";
+    int32_t req[7];
+    uint32_t resp[2];
+    struct sockaddr_un addr = { AF_UNIX };
+    struct timeval tv = { 3, 0 };
+
+    mkdir("test_output", 0777);
+    unlink(path);
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl(PROGNAME, PROGNAME, "--serve", path, "-j", "1", (char *)NULL);
+        _exit(127);
+    }
+    strcpy(addr.sun_path, path);
+    int slow = socket(AF_UNIX, SOCK_STREAM, 0), fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    int tries = 0;
+    while (connect(slow, (struct sockaddr *)&addr, sizeof(addr)) && ++tries < 100) usleep(20000);
+    cr_assert_lt(tries, 100, "Could not connect to the daemon");
+    cr_assert_eq(connect(fd, (struct sockaddr *)&addr, sizeof(addr)), 0, "Could not connect twice");
+
+    req[0] = htonl(strlen(text));
+    for (int k = 1;  k < 7;  ++k) req[k] = htonl(-1);
+    cr_assert(write(slow, req, 10) == 10);
+    usleep(100000);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    cr_assert(write(fd, req, sizeof(req)) == sizeof(req) && write(fd, text, strlen(text)) == strlen(text));
+    cr_assert(read(fd, resp, sizeof(resp)) == sizeof(resp), "No response while another client stalls");
+    cr_assert_eq(ntohl(resp[0]), 0, "Request failed");
+    close(fd);
+
+    int status;
+    kill(pid, SIGTERM);
+    waitpid(pid, &status, 0);
+    assert_normal_exit(status);
+    cr_assert(access(path, F_OK) != 0, "Socket not removed");
+    close(slow);
+}
+
+/*
+ * Start the daemon with one worker, and have one client send a request
+ * of several megabytes and never read the response. Another client
+ * must still be answered at once, since the worker leaves the rest of
+ * a response to the main thread rather than wait for the client to
+ * take it.
+ */
+Test(base_suite, serve_slow_reader_test) {
+    const char *path = "test_output/serve_slow_reader.sock";
+    const char *text = "one two\n";
+    size_t biglen = 4 * 1024 * 1024;
+    char *big = malloc(biglen);
+    int32_t req[7];
+    uint32_t resp[2];
+    struct sockaddr_un addr = { AF_UNIX };
+    struct timeval tv = { 3, 0 };
+
+    cr_assert_not_null(big);
+    for (size_t i = 0;  i < biglen;  ++i) big[i] = i % 8 == 7 ? ' ' : 'a' + i % 26;
+    mkdir("test_output", 0777);
+    unlink(path);
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl(PROGNAME, PROGNAME, "--serve", path, "-j", "1", (char *)NULL);
+        _exit(127);
+    }
+    strcpy(addr.sun_path, path);
+    int slow = socket(AF_UNIX, SOCK_STREAM, 0), fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    int tries = 0;
+    while (connect(slow, (struct sockaddr *)&addr, sizeof(addr)) && ++tries < 100) usleep(20000);
+    cr_assert_lt(tries, 100, "Could not connect to the daemon");
+    cr_assert_eq(connect(fd, (struct sockaddr *)&addr, sizeof(addr)), 0, "Could not connect twice");
+
+    req[0] = htonl(biglen);
+    for (int k = 1;  k < 7;  ++k) req[k] = htonl(-1);
+    cr_assert(write(slow, req, sizeof(req)) == sizeof(req));
+    for (size_t sent = 0;  sent < biglen;  ) {
+        ssize_t r = write(slow, big + sent, biglen - sent);
+        cr_assert(r > 0, "Could not send the large request");
+        sent += r;
+    }
+    usleep(200000);
+    req[0] = htonl(strlen(text));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    cr_assert(write(fd, req, sizeof(req)) == sizeof(req) && write(fd, text, strlen(text)) == strlen(text));
+    cr_assert(read(fd, resp, sizeof(resp)) == sizeof(resp), "No response while another client reads slowly");
+    cr_assert_eq(ntohl(resp[0]), 0, "Request failed");
+    close(fd);
+
+    int status;
+    kill(pid, SIGTERM);
+    waitpid(pid, &status, 0);
+    assert_normal_exit(status);
+    cr_assert(access(path, F_OK) != 0, "Socket not removed");
+    close(slow);
+    free(big);
+}
+
+/*
+ * Reformat three files in place, all dated in the past, one already
+ * formatted and one empty, and check that the first is rewritten while
+ * the other two keep their contents and modification times.
+ */
+Test(base_suite, in_place_test) {
+    const char *paths[3] = { "test_output/in_place_1.txt", "test_output/in_place_2.txt",
+                             "test_output/in_place_3.txt" };
+    const char *texts[3] = { "one two three\nfour five six\n", "one two three four five six\n", "" };
+    const char *exps[3] = { "one two three four five six\n", "one two three four five six\n", "" };
+    struct utimbuf past = { 1000000000, 1000000000 };
+    struct stat st;
+    char cmd[200], out[100];
+
+    mkdir("test_output", 0777);
+    for (int i = 0;  i < 3;  ++i) {
+        FILE *f = fopen(paths[i], "w");
+        cr_assert_not_null(f, "Could not create %s", paths[i]);
+        fputs(texts[i], f);
+        fclose(f);
+        utime(paths[i], &past);
+    }
+
+    sprintf(cmd, "%s --in-place -j 2 %s %s %s", PROGNAME, paths[0], paths[1], paths[2]);
+    int err = system(cmd);
+    assert_normal_exit(err);
+
+    for (int i = 0;  i < 3;  ++i) {
+        FILE *f = fopen(paths[i], "r");
+        cr_assert_not_null(f, "%s is gone", paths[i]);
+        size_t len = fread(out, 1, sizeof(out), f);
+        fclose(f);
+        cr_assert(len == strlen(exps[i]) && !memcmp(out, exps[i], len),
+                  "Unexpected contents of %s: '%.*s'", paths[i], (int)len, out);
+        stat(paths[i], &st);
+        if (i) cr_assert_eq(st.st_mtime, past.modtime, "Unchanged file was rewritten");
+        else cr_assert_neq(st.st_mtime, past.modtime, "File was not rewritten");
+    }
+}
+
+/*
+ * Check that the block-at-a-time white space scanners find the same
+ * word boundaries as the byte-at-a-time ones, from every starting
+ * point of buffers mixing every white space char with other bytes.
+ */
+Test(base_suite, scan_space_test) {
+    static const char white[] = " \t\n\v\f\r";
+    char buf[200];
+    unsigned seed = 1;
+
+    for (int round = 0;  round < 200;  ++round) {
+        int density = round % 10;
+        for (int i = 0;  i < sizeof(buf);  ++i) {
+            seed = seed * 1103515245 + 12345;
+            int r = seed >> 16;
+            buf[i] = r % 10 < density ? white[r / 10 % 6] : (char)(r / 60);
+        }
+        for (int from = 0;  from < sizeof(buf);  ++from)
+            for (int to = from;  to <= sizeof(buf);  to += 1 + to % 7) {
+                cr_assert(skipspace(buf + from, buf + to) == skipspace_scalar(buf + from, buf + to),
+                          "skipspace() differs in round %d from %d to %d", round, from, to);
+                cr_assert(skipword(buf + from, buf + to) == skipword_scalar(buf + from, buf + to),
+                          "skipword() differs in round %d from %d to %d", round, from, to);
+                cr_assert(skipascii(buf + from, buf + to) == skipascii_scalar(buf + from, buf + to),
+                          "skipascii() differs in round %d from %d to %d", round, from, to);
+            }
+    }
+}
+
+/*
+ * Check that the block-at-a-time common prefix and suffix routines
+ * agree with the byte-at-a-time ones, for differences at every
+ * position within strings of many lengths.
+ */
+Test(base_suite, scan_affix_test) {
+    char a[100], b[100];
+
+    for (int i = 0;  i < sizeof(a);  ++i) a[i] = b[i] = (char)(i * 37 + 5);
+    for (int n = 0;  n <= sizeof(a);  ++n)
+        for (int diff = -1;  diff < n;  ++diff) {
+            if (diff >= 0) b[diff] ^= 0x80;
+            cr_assert_eq(commonprefix(a, b, n), commonprefix_scalar(a, b, n),
+                         "commonprefix() differs for n %d, difference at %d", n, diff);
+            cr_assert_eq(commonsuffix(a + n, b + n, n), commonsuffix_scalar(a + n, b + n, n),
+                         "commonsuffix() differs for n %d, difference at %d", n, diff);
+            if (diff >= 0) b[diff] ^= 0x80;
+        }
+}
+
+/*
+ * Check that a buffer refuses to grow past the number of bytes a
+ * size_t can count, rather than overflow, and still works after.
+ */
+Test(base_suite, buffer_overflow_test) {
+    struct buffer *buf = newbuffer(sizeof (long));
+
+    cr_assert_not_null(buf, "newbuffer() failed");
+    cr_assert_not_null(growbuffer(buf, 10), "growbuffer() failed for 10 items");
+    cr_assert_null(growbuffer(buf, (size_t) -1 / sizeof (long)),
+                   "growbuffer() did not fail for more bytes than a size_t holds");
+    cr_assert_null(growbuffer(buf, (size_t) -1), "growbuffer() did not fail for SIZE_MAX items");
+    cr_assert_not_null(growbuffer(buf, 10), "growbuffer() failed after a failure");
+    cr_assert_eq(numitems(buf), 20, "Buffer holds %zu items, not 20", numitems(buf));
+    freebuffer(buf);
+}
+
 /*
  * Run the program with default options on a non-empty input file
  * and use valgrind to check for leaks.
@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+#
+# mkwidth.py, for Par 3.20
+#
+# Writes src/widthtab.c, the table of display widths used by width.c,
+# from the Unicode data built into Python's unicodedata module:
+#
+#     python3 tools/mkwidth.py > src/widthtab.c
+#
+# Each code point below U+40000 gets a width of 0, 1 or 2, stored in two
+# bits. The table is in two stages: the first maps the high bits of a
+# code point to one of the distinct blocks of 256 code points, and the
+# second holds those blocks. Code points from U+40000 up are left to
+# width.c, which gives them width 1, save the tags and variation
+# selectors of U+E0000 to U+E0FFF, which have width 0.
+
+import sys
+import unicodedata
+
+LIMIT = 0x40000
+BLOCK = 256
+
+WIDE_UNASSIGNED = [(0x3400, 0x4DBF), (0x4E00, 0x9FFF), (0xF900, 0xFAFF),
+                   (0x20000, 0x2FFFD), (0x30000, 0x3FFFD)]
+
+
+def width(c):
+    ch = chr(c)
+    cat = unicodedata.category(ch)
+    if c == 0x00AD:
+        return 1
+    if cat in ('Mn', 'Me', 'Cf') or 0x1160 <= c <= 0x11FF or c == 0x200B:
+        return 0
+    if unicodedata.east_asian_width(ch) in ('W', 'F'):
+        return 2
+    if cat == 'Cn' and any(lo <= c <= hi for lo, hi in WIDE_UNASSIGNED):
+        return 2
+    return 1
+
+
+def main():
+    for c in range(LIMIT, 0x110000):
+        want = 0 if 0xE0000 <= c <= 0xE0FFF else 1
+        if width(c) != want and unicodedata.category(chr(c)) != 'Cn':
+            sys.exit('U+%04X does not follow the rule for U+40000 up' % c)
+
+    blocks, index = [], []
+    for base in range(0, LIMIT, BLOCK):
+        packed = bytearray(BLOCK // 4)
+        for c in range(base, base + BLOCK):
+            packed[(c - base) // 4] |= width(c) << 2 * (c % 4)
+        packed = bytes(packed)
+        if packed not in blocks:
+            blocks.append(packed)
+        index.append(blocks.index(packed))
+    if len(blocks) > 256:
+        sys.exit('too many distinct blocks')
+
+    out = sys.stdout
+    out.write('/*********************/\n'
+              '/* widthtab.c        */\n'
+              '/* for Par 3.20      */\n'
+              '/*********************/\n\n'
+              '/* Generated by tools/mkwidth.py from Unicode %s. */\n'
+              '/* Do not edit.                                     */\n\n\n'
+              '#include "width.h"\n\n\n'
+              % unicodedata.unidata_version)
+    out.write('const unsigned char widthindex[%d] = {\n' % len(index))
+    for i in range(0, len(index), 16):
+        out.write('  ' + ','.join('%3d' % k for k in index[i:i+16]) + ',\n')
+    out.write('};\n\n')
+    out.write('const unsigned char widthblocks[%d][%d] = {\n'
+              % (len(blocks), BLOCK // 4))
+    for b in blocks:
+        out.write('  {\n')
+        for i in range(0, len(b), 16):
+            out.write('    ' + ','.join('0x%02x' % v for v in b[i:i+16]) + ',\n')
+        out.write('  },\n')
+    out.write('};\n')
+    sys.stderr.write('%d index entries, %d blocks, %d bytes\n'
+                     % (len(index), len(blocks), len(index) + len(blocks) * BLOCK // 4))
+
+
+main()
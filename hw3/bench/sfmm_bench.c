@@ -0,0 +1,99 @@
+/*
+ * Multi-threaded throughput of the allocator, built by "make bench" with SF_THREADS.
+ *
+ * Each thread keeps a few live blocks of 8 to 64 bytes and repeatedly frees one and
+ * allocates another in its place.  One operation in eight instead trades a block through
+ * a mailbox with the next thread and frees what it gets back, so a steady share of frees
+ * come from a thread other than the allocating one.  Every run is done twice: through
+ * sf_malloc and sf_free, and straight through the locked central heap, which is what
+ * every call would cost without the per-thread caches.
+ *
+ * usage: sfmm_bench [ops per thread] [max threads]
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "sfmm.h"
+#include "sfheap.h"
+
+#define LIVE 4          //blocks each thread holds at once
+#define MAX_SIZE 64
+
+static void* mailbox[64];
+static int nthreads, ops, locked;
+static long failures;
+
+void* bench_malloc(sf_size_t size) {
+    if (!locked) {return sf_malloc(size);}
+    heap_lock();
+    void* pp = heap_malloc(size);
+    heap_unlock();
+    return pp;
+}
+
+void bench_free(void* pp) {
+    if (pp == NULL) {return;}
+    if (!locked) {
+        sf_free(pp);
+        return;
+    }
+    heap_lock();
+    heap_free(pp);
+    heap_unlock();
+}
+
+void* worker(void* arg) {
+    int t = (long)arg;
+    unsigned seed = t + 1;
+    void* live[LIVE] = {NULL};
+    long failed = 0;
+    for (int n = 0; n < ops; n++) {
+        int j = rand_r(&seed) % LIVE;
+        if (n % 8 == 7) {
+            void* theirs = __atomic_exchange_n(&mailbox[(t+1) % nthreads], live[j], __ATOMIC_ACQ_REL);
+            live[j] = NULL;
+            bench_free(theirs);
+        } else {
+            bench_free(live[j]);
+        }
+        live[j] = bench_malloc(1 + rand_r(&seed) % MAX_SIZE);
+        if (live[j] == NULL) {failed++;}
+    }
+    for (int j = 0; j < LIVE; j++) {bench_free(live[j]);}
+    __atomic_add_fetch(&failures, failed, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+double run(int n) {
+    pthread_t threads[64];
+    struct timespec start, end;
+    nthreads = n;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long t = 0; t < n; t++) {pthread_create(&threads[t], NULL, worker, (void*)t);}
+    for (int t = 0; t < n; t++) {pthread_join(threads[t], NULL);}
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    for (int t = 0; t < n; t++) {
+        bench_free(mailbox[t]);
+        mailbox[t] = NULL;
+    }
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    return (double)n * ops / secs / 1e6;
+}
+
+int main(int argc, char const *argv[]) {
+    ops = argc > 1 ? atoi(argv[1]) : 1000000;
+    int max_threads = argc > 2 ? atoi(argv[2]) : 8;
+    if (max_threads > 64) {max_threads = 64;}
+
+    printf("threads  cached Mops/s  locked Mops/s\n");
+    for (int n = 1; n <= max_threads; n *= 2) {
+        locked = 0;
+        double cached = run(n);
+        locked = 1;
+        double central = run(n);
+        printf("%7d  %13.2f  %13.2f\n", n, cached, central);
+    }
+    if (failures != 0) {printf("%ld allocations failed for want of memory\n", failures);}
+    return EXIT_SUCCESS;
+}
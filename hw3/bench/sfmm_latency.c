@@ -0,0 +1,145 @@
+/*
+ * Latency of single sf_malloc and sf_free calls, built by "make bench" twice: as
+ * sfmm_latency with the segregated first-fit lists and as sfmm_latency_tlsf with SF_TLSF.
+ *
+ * The workload keeps up to LIVE blocks too big for the quick lists (block sizes of 192 to
+ * MAX_SIZE+8 bytes) and repeatedly frees one at random and allocates one of a random size in
+ * its place, which leaves the heap fragmented.  Each call is timed alone.  To keep
+ * interrupts and other noise out of the maximum, the same workload is run REPEATS times,
+ * each in a fresh child process so that it starts from an empty heap, and every call's
+ * time is taken as its fastest over the runs.  The times include the clock's own
+ * overhead, which is printed too.
+ *
+ * LIVE blocks never make a list long, so a second workload times the worst case of a list
+ * search: it leaves FILL free blocks of 240 bytes in one size class, kept from coalescing by
+ * live blocks between them, and times FILL_OPS requests for a 256-byte block, which is in
+ * the same class but too big for any of them, freeing each before the next.
+ *
+ * usage: sfmm_latency [ops] [seed]
+ */
+#define _DEFAULT_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "sfmm.h"
+
+#define LIVE 16
+#define MAX_SIZE 1200
+#define REPEATS 5
+#define FILL 80                 //free blocks left in one class by the second workload
+#define FILL_OPS 1000
+
+static int ops;
+static uint32_t* times;         //ns for each call, shared with the children: malloc then free of op i
+static uint32_t* fill_times;    //ns for each request of the second workload
+
+uint64_t now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+//runs the workload, keeping for each call the fastest time seen so far
+void run(unsigned seed) {
+    void* live[LIVE] = {NULL};
+    sf_free(sf_malloc(MAX_SIZE));       //set the heap up before timing anything
+    for (int n = 0; n < ops; n++) {
+        int j = rand_r(&seed) % LIVE;
+        sf_size_t size = 184 + rand_r(&seed) % (MAX_SIZE - 183);
+        int freed = live[j] != NULL;
+        uint64_t t0 = now();
+        if (freed) {sf_free(live[j]);}
+        uint64_t t1 = now();
+        live[j] = sf_malloc(size);
+        uint64_t t2 = now();
+        if (t2 - t1 < times[2*n]) {times[2*n] = t2 - t1;}
+        if (freed && t1 - t0 < times[2*n+1]) {times[2*n+1] = t1 - t0;}
+    }
+}
+
+//runs the second workload, keeping for each request the fastest time seen so far
+void run_fill() {
+    void* small[FILL];
+    for (int k = 0; k < FILL; k++) {
+        small[k] = sf_malloc(232);      //a 240-byte block
+        sf_malloc(24);                  //kept, so that the free blocks cannot coalesce
+    }
+    for (int k = 0; k < FILL; k++) {sf_free(small[k]);}
+    for (int n = 0; n < FILL_OPS; n++) {
+        uint64_t t0 = now();
+        void* p = sf_malloc(248);       //a 256-byte block
+        uint64_t t1 = now();
+        sf_free(p);
+        if (t1 - t0 < fill_times[n]) {fill_times[n] = t1 - t0;}
+    }
+}
+
+int compare(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+//prints the average, 99th and 99.9th percentiles and maximum of the count calls timed in
+//src, every stride-th entry
+void report(const char* name, const uint32_t* src, int stride, int count) {
+    uint32_t* t = malloc(count * sizeof *t);
+    int n = 0;
+    double sum = 0;
+    for (int i = 0; i < count; i++) {
+        if (src[stride*i] == UINT32_MAX) {continue;}       //a free with nothing to free
+        t[n] = src[stride*i];
+        sum += t[n++];
+    }
+    qsort(t, n, sizeof *t, compare);
+    printf("%-7s %8.1f %8u %8u %8u\n", name, n == 0 ? 0 : sum/n,
+           n == 0 ? 0 : t[n*99/100], n == 0 ? 0 : t[n*999/1000], n == 0 ? 0 : t[n-1]);
+    free(t);
+}
+
+int main(int argc, char const *argv[]) {
+    ops = argc > 1 ? atoi(argv[1]) : 100000;
+    unsigned seed = argc > 2 ? atoi(argv[2]) : 1;
+    times = mmap(NULL, (2 * ops + FILL_OPS) * sizeof *times, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (times == MAP_FAILED) {
+        perror("mmap");
+        return EXIT_FAILURE;
+    }
+    fill_times = times + 2*ops;
+    for (int i = 0; i < 2*ops + FILL_OPS; i++) {times[i] = UINT32_MAX;}
+
+    for (int r = 0; r < REPEATS; r++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            run(seed);
+            _exit(EXIT_SUCCESS);
+        }
+        waitpid(pid, NULL, 0);
+        pid = fork();
+        if (pid == 0) {
+            run_fill();
+            _exit(EXIT_SUCCESS);
+        }
+        waitpid(pid, NULL, 0);
+    }
+
+    uint64_t overhead = UINT64_MAX;
+    for (int i = 0; i < 1000; i++) {
+        uint64_t t0 = now(), t1 = now();
+        if (t1 - t0 < overhead) {overhead = t1 - t0;}
+    }
+#ifdef SF_TLSF
+    printf("TLSF, %d ops, clock overhead %lu ns\n", ops, (unsigned long)overhead);
+#else
+    printf("segregated first fit, %d ops, clock overhead %lu ns\n", ops, (unsigned long)overhead);
+#endif
+    printf("call    avg (ns)      p99    p99.9      max\n");
+    report("malloc", times, 2, ops);
+    report("free", times + 1, 2, ops);
+    printf("with %d free blocks too small in the request's class:\n", FILL);
+    report("malloc", fill_times, 1, FILL_OPS);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,78 @@
+#ifndef SFHEAP_H
+#define SFHEAP_H
+#include "sfmm.h"
+
+/*
+ * The central heap, as implemented in sfmm.c.  In the ordinary build sf_malloc, sf_free
+ * and sf_realloc simply call these.  In the thread-safe build (compiled with SF_THREADS),
+ * sfcache.c puts a cache of small blocks for each thread in front of them, and they are
+ * only ever called with the heap lock held.
+ */
+
+/* The heap grows by at least this many pages at a time, to save growing again soon after.  Each
+ * growth is a single step however many pages it takes: heap_grows counts them, including the
+ * first page. */
+#ifndef SF_GROW_PAGES
+#define SF_GROW_PAGES 1
+#endif
+extern int heap_grows;
+
+/* Same as sf_malloc, sf_free and sf_realloc, but without any locking or caching. */
+void *heap_malloc(sf_size_t size);
+void heap_free(void *pp);
+void *heap_realloc(void *pp, sf_size_t rsize);
+
+/* Returns 1 if pp could have been returned by heap_malloc and not yet freed, else 0. */
+int is_valid(void *pp);
+
+/* Returns the size of a block, and the size of the block that holds a payload of size bytes
+ * (0 if no block could be that large). */
+int get_block_size(sf_block* block);
+int block_size_for(sf_size_t size);
+
+/* The index of free blocks: segregated first-fit lists in sfmm.c, or with SF_TLSF the
+ * two-level segregated fit in sftlsf.c.  Blocks go in coalesced, with their footers set, and
+ * must still have their headers when they are removed.  find_fit returns a free block of at
+ * least size bytes, still in the index, or NULL. */
+void init_free_list_heads();
+void free_list_add(sf_block* free_block);
+void remove_free_block(sf_block* block);
+sf_block* find_fit(int size);
+
+#ifdef SF_TLSF
+/* The TLSF index: tlsf_mapping gives the first and second level class of a size, and each
+ * class has the list headed by the sentinel tlsf_heads[fl][sl]. */
+#define SL_LOG 3                    //log2 of the number of second level classes
+#define SL_COUNT (1 << SL_LOG)
+#define FL_COUNT 32                 //a block size always fits in 31 bits
+void tlsf_mapping(unsigned int size, int* fl, int* sl);
+extern sf_block tlsf_heads[FL_COUNT][SL_COUNT];
+#endif
+
+#ifdef SF_THREADS
+/* Serialize every access to the central heap, including the statistics. */
+void heap_lock();
+void heap_unlock();
+
+/* The central heap counts a block it hands to a cache as allocated with the largest payload
+ * it can hold.  These correct its totals to count only the blocks the caches have handed
+ * out, with the payloads asked for.  The heap lock must be held. */
+double cache_payload();
+double cache_size();
+
+/* Each thread has its own sf_errno, as it has its own errno: wherever this header is
+ * included, sf_errno names the calling thread's.  Code that includes only sfmm.h reads the
+ * global that sfmm.h declares, so set_sf_errno() stores an error in both.  The global is
+ * shared by all threads, and holds the last error of any of them. */
+int* sf_errno_location();
+void set_sf_errno(int err);
+#define sf_errno (*sf_errno_location())
+#else
+#define heap_lock()
+#define heap_unlock()
+#define cache_payload() 0.0
+#define cache_size() 0.0
+#define set_sf_errno(err) (sf_errno = (err))
+#endif
+
+#endif
@@ -0,0 +1,338 @@
+/*
+ * The thread-safe front end of the allocator, built only with SF_THREADS.
+ *
+ * Each thread keeps a small cache of blocks for each of the quick-list size classes
+ * (32 to 176 bytes) and serves those sizes from it without taking any lock.  Larger
+ * blocks, refills of an empty cache and blocks that do not fit in a full one go to the
+ * central heap in sfmm.c under a single mutex.  A block freed by a thread other than the
+ * one whose cache it came from is pushed onto that thread's remote-free stack, which is
+ * lock-free, and the owner takes the whole stack back the next time one of its classes
+ * runs dry.
+ *
+ * A block in a cache keeps the header it got from the central heap, which marks it as
+ * allocated with the largest payload it can hold.  Nothing outside the heap lock ever
+ * writes a header.  Instead each cache counts the payloads and sizes of the blocks it has
+ * handed out, and the statistics take those in place of the central heap's count of the
+ * blocks the caches hold, so a cached block counts only while it is in use.  The peak is
+ * sampled whenever the central heap is used and when it is asked for.  Each thread has
+ * its own sf_errno, and an error is also stored in the global one.
+ */
+#ifdef SF_THREADS
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "debug.h"
+#include "sfmm.h"
+#include "sfheap.h"
+#include "errno.h"
+
+#define MAX_THREADS 64          //threads beyond this many go straight to the central heap
+#define CACHE_MAX 4             //most blocks a thread keeps for each size class
+#define REFILL 2                //blocks taken from the central heap when a class runs dry
+#define CACHE_HEAP (1 << 20)    //only blocks in the first MB of the heap are ever cached
+
+#define OWNER_LIVE 0x8000       //owner entry of a block that a cache has handed out
+#define OWNER_SIZE 16           //shift of the payload size asked for in a live owner entry
+
+struct cache {
+    sf_block* first[NUM_QUICK_LISTS];   //cached blocks of each class, linked through body.links.next
+    int length[NUM_QUICK_LISTS];
+    sf_block* remote;                   //blocks freed by other threads, pushed without a lock
+    int in_use;                         //the slot belongs to a running thread
+    long pld, al;                       //payload and size handed out, written only by the owner
+    long freed_pld, freed_al;           //payload and size of those freed by other threads
+};
+
+static pthread_mutex_t heap_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct cache caches[MAX_THREADS+1];   //slot 0 is never used: it means "not cached"
+static uint32_t owners[CACHE_HEAP/16];       //slot | class << 8, plus OWNER_LIVE and the size, for each cached block
+static int top_slot;                         //highest slot ever taken
+static double held_pld, held_al;             //what the central heap counts for the cached blocks
+static pthread_key_t cache_key;              //runs release_cache when a thread with a slot exits
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+static __thread int my_slot = -1;            //-1 until the thread first allocates, 0 if it got no slot
+static __thread int my_errno;
+
+void heap_lock() { pthread_mutex_lock(&heap_mutex); }
+void heap_unlock() { pthread_mutex_unlock(&heap_mutex); }
+
+int* sf_errno_location() { return &my_errno; }
+
+//sets the thread's sf_errno, and the global one that code including only sfmm.h reads
+void set_sf_errno(int err) {
+    my_errno = err;
+#undef sf_errno
+    sf_errno = err;
+#define sf_errno (*sf_errno_location())
+}
+
+//adds to the central heap's count of the cached blocks; the heap lock must be held
+void hold(long pld, long al) {
+    held_pld += pld;
+    held_al += al;
+}
+
+//adds to what c has handed out; only c's own thread calls it
+void count(struct cache* c, long pld, long al) {
+    __atomic_store_n(&c->pld, c->pld + pld, __ATOMIC_RELAXED);
+    __atomic_store_n(&c->al, c->al + al, __ATOMIC_RELAXED);
+}
+
+double cache_payload() {
+    double pld = -held_pld;
+    for (int s = 1; s <= top_slot; s++) {
+        pld += __atomic_load_n(&caches[s].pld, __ATOMIC_RELAXED) - __atomic_load_n(&caches[s].freed_pld, __ATOMIC_RELAXED);
+    }
+    return pld;
+}
+
+double cache_size() {
+    double al = -held_al;
+    for (int s = 1; s <= top_slot; s++) {
+        al += __atomic_load_n(&caches[s].al, __ATOMIC_RELAXED) - __atomic_load_n(&caches[s].freed_al, __ATOMIC_RELAXED);
+    }
+    return al;
+}
+
+//index of pp in owners, or -1 if pp cannot be the payload of a cached block
+int owner_index(void* pp) {
+    uintptr_t off = (uintptr_t)pp - (uintptr_t)sf_mem_start();
+    if ((uintptr_t)pp % 16 != 0 || off >= CACHE_HEAP) {return -1;}
+    return off/16;
+}
+
+//returns a cached block to the central heap; the heap lock must be held
+void give_back(sf_block* block) {
+    int idx = owner_index(block->body.payload);
+    long pld = 32 + 16*(owners[idx] >> 8 & 0xF) - 8, al = get_block_size(block);
+    __atomic_store_n(&owners[idx], 0, __ATOMIC_RELAXED);
+    heap_free(block->body.payload);
+    hold(-pld, -al);
+}
+
+//gives every block on a remote-free stack back to the central heap; the heap lock must be held
+void give_back_remote(struct cache* c) {
+    sf_block* block = __atomic_exchange_n(&c->remote, NULL, __ATOMIC_ACQUIRE);
+    while (block != NULL) {
+        sf_block* next = block->body.links.next;
+        give_back(block);
+        block = next;
+    }
+}
+
+//gives all of a cache back to the central heap; the heap lock must be held
+void flush_cache(struct cache* c) {
+    for (int i = 0; i < NUM_QUICK_LISTS; i++) {
+        while (c->first[i] != NULL) {
+            sf_block* block = c->first[i];
+            c->first[i] = block->body.links.next;
+            give_back(block);
+        }
+        c->length[i] = 0;
+    }
+    give_back_remote(c);
+}
+
+void release_cache(void* arg) {
+    struct cache* c = arg;
+    heap_lock();
+    flush_cache(c);
+    c->in_use = 0;      //blocks pushed after this wait for whoever takes the slot next
+    heap_unlock();
+}
+
+void make_cache_key() { pthread_key_create(&cache_key, release_cache); }
+
+//the calling thread's cache, or NULL if every slot is taken
+struct cache* my_cache() {
+    if (my_slot < 0) {
+        pthread_once(&cache_once, make_cache_key);
+        heap_lock();
+        my_slot = 0;
+        for (int s = 1; s <= MAX_THREADS; s++) {
+            if (!caches[s].in_use) {
+                caches[s].in_use = 1;
+                my_slot = s;
+                if (s > top_slot) {top_slot = s;}
+                break;
+            }
+        }
+        heap_unlock();
+        if (my_slot != 0) {pthread_setspecific(cache_key, &caches[my_slot]);}
+    }
+    return my_slot == 0 ? NULL : &caches[my_slot];
+}
+
+void cache_push(struct cache* c, sf_block* block, int i) {
+    block->body.links.next = c->first[i];
+    c->first[i] = block;
+    c->length[i]++;
+}
+
+void remote_push(struct cache* c, sf_block* block) {
+    sf_block* head = __atomic_load_n(&c->remote, __ATOMIC_RELAXED);
+    do {
+        block->body.links.next = head;
+    } while (!__atomic_compare_exchange_n(&c->remote, &head, block, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+//moves the blocks other threads freed back into c; those that do not fit go to the central heap
+void drain_remote(struct cache* c) {
+    sf_block* block = __atomic_exchange_n(&c->remote, NULL, __ATOMIC_ACQUIRE);
+    sf_block* spill = NULL;
+    while (block != NULL) {
+        sf_block* next = block->body.links.next;
+        int i = __atomic_load_n(&owners[owner_index(block->body.payload)], __ATOMIC_RELAXED) >> 8 & 0xF;
+        if (c->length[i] < CACHE_MAX) {
+            cache_push(c, block, i);
+        } else {
+            block->body.links.next = spill;
+            spill = block;
+        }
+        block = next;
+    }
+    if (spill == NULL) {return;}
+    heap_lock();
+    while (spill != NULL) {
+        sf_block* next = spill->body.links.next;
+        give_back(spill);
+        spill = next;
+    }
+    heap_unlock();
+}
+
+//takes up to REFILL blocks of class i from the central heap into c.  If the heap is out of
+//memory, everything this thread and any exited thread has cached goes back and it tries again.
+//Returns 0 on success, -1 (with sf_errno set) if there is no memory, and 1 if the central heap
+//hands out blocks too far up to be cached.
+int refill(struct cache* c, int i) {
+    int ret = 0;
+    heap_lock();
+    for (int n = 0; n < REFILL; n++) {
+        hold(32 + 16*i - 8, 0);     //before the heap counts it, so that the peak never does
+        void* pp = heap_malloc(32 + 16*i - 8);
+        if (pp == NULL && n == 0) {
+            flush_cache(c);
+            for (int s = 1; s <= MAX_THREADS; s++) {
+                if (!caches[s].in_use) {give_back_remote(&caches[s]);}
+            }
+            pp = heap_malloc(32 + 16*i - 8);
+        }
+        if (pp == NULL) {
+            hold(-(32 + 16*i - 8), 0);
+            ret = n == 0 ? -1 : 0;
+            break;
+        }
+        int idx = owner_index(pp);
+        if (idx < 0) {
+            heap_free(pp);
+            hold(-(32 + 16*i - 8), 0);
+            ret = n == 0 ? 1 : 0;
+            break;
+        }
+        __atomic_store_n(&owners[idx], my_slot | i << 8, __ATOMIC_RELAXED);
+        hold(0, get_block_size(pp-16));     //can be more than the class, which is all a cache counts in use
+        cache_push(c, pp-16, i);
+    }
+    heap_unlock();
+    return ret;
+}
+
+void *sf_malloc(sf_size_t size) {
+    int block_size = block_size_for(size);
+    int i = (block_size-32)/16;
+    struct cache* c = NULL;
+    if (size != 0 && block_size != 0 && i < NUM_QUICK_LISTS) {c = my_cache();}
+    if (c != NULL && c->first[i] == NULL) {
+        drain_remote(c);
+        if (c->first[i] == NULL) {
+            int ret = refill(c, i);
+            if (ret < 0) {return NULL;}
+            if (ret > 0) {c = NULL;}
+        }
+    }
+    if (c == NULL) {
+        heap_lock();
+        void* pp = heap_malloc(size);
+        heap_unlock();
+        return pp;
+    }
+
+    sf_block* block = c->first[i];
+    c->first[i] = block->body.links.next;
+    c->length[i]--;
+    __atomic_store_n(&owners[owner_index(block->body.payload)], my_slot | i << 8 | OWNER_LIVE | (uint32_t)size << OWNER_SIZE, __ATOMIC_RELAXED);
+    count(c, size, block_size);
+    return block->body.payload;
+}
+
+void sf_free(void *pp) {
+    int idx = owner_index(pp);
+    uint32_t owner = idx < 0 ? 0 : __atomic_fetch_and(&owners[idx], ~OWNER_LIVE, __ATOMIC_RELAXED);
+    if (owner == 0) {               //not from a cache: the central heap checks it
+        heap_lock();
+        heap_free(pp);
+        heap_unlock();
+        return;
+    }
+    if (!(owner & OWNER_LIVE)) {abort();}   //already back in a cache: freed twice
+
+    sf_block* block = pp-16;
+    int slot = owner & 0xFF, i = owner >> 8 & 0xF;
+    long size = owner >> OWNER_SIZE, al = 32 + 16*i;
+    struct cache* c = &caches[slot];
+    if (slot != my_slot) {
+        __atomic_fetch_add(&c->freed_pld, size, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&c->freed_al, al, __ATOMIC_RELAXED);
+        remote_push(c, block);
+        return;
+    }
+    count(c, -size, -al);
+    if (c->length[i] < CACHE_MAX) {
+        cache_push(c, block, i);
+        return;
+    }
+    heap_lock();
+    give_back(block);
+    heap_unlock();
+}
+
+void *sf_realloc(void *pp, sf_size_t rsize) {
+    int idx = owner_index(pp);
+    uint32_t owner = idx < 0 ? 0 : __atomic_load_n(&owners[idx], __ATOMIC_RELAXED);
+    if (owner == 0) {
+        heap_lock();
+        void* new_pp = heap_realloc(pp, rsize);
+        heap_unlock();
+        return new_pp;
+    }
+    if (!(owner & OWNER_LIVE)) {
+        set_sf_errno(EINVAL);
+        return NULL;
+    }
+    if (rsize == 0) {
+        sf_free(pp);
+        return NULL;
+    }
+
+    int slot = owner & 0xFF, block_size = 32 + 16*(owner >> 8 & 0xF);
+    if (block_size_for(rsize) == block_size) {      //same class: only the size asked for changes
+        __atomic_store_n(&owners[idx], (owner & 0xFFFF) | (uint32_t)rsize << OWNER_SIZE, __ATOMIC_RELAXED);
+        long diff = (long)rsize - (long)(owner >> OWNER_SIZE);
+        if (slot == my_slot) {
+            count(&caches[slot], diff, 0);
+        } else {
+            __atomic_fetch_sub(&caches[slot].freed_pld, diff, __ATOMIC_RELAXED);
+        }
+        return pp;
+    }
+    void* new_pp = sf_malloc(rsize);
+    if (new_pp == NULL) {return NULL;}
+    memcpy(new_pp, pp, rsize < block_size-8 ? rsize : block_size-8);
+    sf_free(pp);
+    return new_pp;
+}
+
+#endif
@@ -7,15 +7,18 @@
 #include <string.h>
 #include "debug.h"
 #include "sfmm.h"
+#include "sfheap.h"
 #include "errno.h"
 
-double curr_pld = 0;
-double max_pld = 0;
+double curr_pld = 0;    //aggregate payload of the allocated blocks
+double curr_al = 0;     //total size of the allocated blocks (not counting quick lists)
+double max_pld = 0;     //peak aggregate payload so far
+int heap_grows = 0;     //times the heap has grown, however many pages each time
 
 void qkl_add(sf_block* block, int i);
-void free_list_add(sf_block* free_block);
+sf_block* coalesce(sf_block* curr);
 
-int get_block_size(sf_block* block) { 
+int get_block_size(sf_block* block) {
     int size = (block->header ^ MAGIC) & 0xFFFFFFF0;
     return size;
 } //retrieve bits 33-60 and store in variable block_size
@@ -27,17 +30,44 @@ void init_header(sf_block* block, sf_size_t pay_size, int block_size, int is_al,
         block->header |= pay_size;        //set header = payload
         block->header <<= 32;             //bit shift by 32
     }
-    block->header ^= MAGIC;   
+    block->header ^= MAGIC;
     int ret = get_block_size(block);         //retrieve bits 33-60 and store in variable ret
-    block->header ^= MAGIC;   
-    ret |= block_size;                       //or ret with block size 
+    block->header ^= MAGIC;
+    ret |= block_size;                       //or ret with block size
     block->header |= ret;                     //set header to ret value
     if (is_al != 0) {block->header |= THIS_BLOCK_ALLOCATED;}   //or with 0x4 to set alloc bit to 1
     if (is_pal != 0) {block->header |= PREV_BLOCK_ALLOCATED;}  //or with 0x2 to set prev_alloc bit to 1
-    if (is_qkl != 0) {block->header |= IN_QUICK_LIST;}         //or with 0x1 to set in qklst bit to 1     
+    if (is_qkl != 0) {block->header |= IN_QUICK_LIST;}         //or with 0x1 to set in qklst bit to 1
     block->header ^= MAGIC;                             //obfuscate header
 }
 
+//turns a payload size into the size of the block that holds it (0 if it would be too large)
+int block_size_for(sf_size_t size) {
+    if (size > 0x7FFFFFE0 - 8) {return 0;}
+    if (size+8 <= 32) {return 32;}
+    return (size + 8 + 15) & ~15;                       //header + payload, rounded up to 16
+}
+
+//makes block a free block of block_size bytes: header, footer, and the next block's prv alloc bit
+void init_free_block(sf_block* block, int block_size, int pal) {
+    init_header(block, 0, block_size, 0, pal, 0);
+    sf_block* next = (void*)block + block_size;
+    next->prev_footer = block->header;                  //footer = header
+    next->header ^= ((next->header ^ MAGIC) & PREV_BLOCK_ALLOCATED);   //next's prv alloc bit = 0
+}
+
+//sets the prv alloc bit of block (and of its footer, if it is free) to pal
+void set_pal(sf_block* block, int pal) {
+    int old = (block->header ^ MAGIC) & PREV_BLOCK_ALLOCATED;
+    if ((old != 0) == (pal != 0)) {return;}
+    block->header ^= PREV_BLOCK_ALLOCATED;              //flip the bit, magic and all
+    if (!((block->header ^ MAGIC) & THIS_BLOCK_ALLOCATED) && get_block_size(block) != 0) {
+        sf_block* next = (void*)block + get_block_size(block);
+        next->prev_footer = block->header;
+    }
+}
+
+#ifndef SF_TLSF
 void init_free_list_heads() {
     for (int i = 0; i < NUM_FREE_LISTS; i++) {
         sf_block* head = &sf_free_list_heads[i];
@@ -46,31 +76,72 @@ void init_free_list_heads() {
     }
 }
 
+//list 0 holds blocks of size 32, list i holds sizes in (32*2^(i-1), 32*2^i], the last list the rest
 int get_free_list(int block_size) {
-    int log = block_size / 32;
-    int i;
-    for (i = 0; log > 1; i++) { log /= 2; }
-    if (i > 9) { i = 9; }
+    int i = 0;
+    for (int max = 32; block_size > max && i < NUM_FREE_LISTS-1; max *= 2) { i++; }
     return i;
 }
 
-void init_qkl() { for (int i = 0; i < NUM_QUICK_LISTS; i++) { sf_quick_lists[i].length = 0; } }
+//adds a free block (already coalesced, with its footer set) to the front of its free list
+void free_list_add(sf_block* free_block) {
+    int index = get_free_list(get_block_size(free_block));   //get the index of the free lists array to add to the correct playlist
+    sf_block* curr = free_block;                      //curr = free_block
+    sf_block* head = &sf_free_list_heads[index];      //head = head of the appropriate list
+
+    curr->body.links.next = head->body.links.next;   //curr->next = head->next
+    head->body.links.next = curr;                    //head->next = curr
+    curr->body.links.prev = head;                    //curr->prev = head
+    curr->body.links.next->body.links.prev = curr;   //next->prev = curr
+}
+
+void remove_free_block(sf_block* curr) {
+    curr->body.links.prev->body.links.next = curr->body.links.next;                      //curr->prev = curr->next
+    curr->body.links.next->body.links.prev = curr->body.links.prev;     //curr->next->prev = curr->prev
+    curr->body.links.next = curr;
+    curr->body.links.prev = curr;
+}
+
+//first fit, starting with the smallest list that might hold a block of size bytes
+sf_block* find_fit(int size) {
+    for (int index = get_free_list(size); index < NUM_FREE_LISTS; index++) {
+        sf_block* head = &sf_free_list_heads[index];
+        for (sf_block* curr = head->body.links.next; curr != head; curr = curr->body.links.next) {
+            if (get_block_size(curr) >= size) { return curr; }
+        }
+    }
+    return NULL;
+}
+#endif
+
+void init_qkl() {
+    for (int i = 0; i < NUM_QUICK_LISTS; i++) {
+        sf_quick_lists[i].length = 0;
+        sf_quick_lists[i].first = NULL;
+    }
+}
 
 int get_qkl(int block_size) { return (block_size-32)/16; }
 
-void qkl_remove(int i) {
-    sf_quick_lists[i].first = sf_quick_lists[i].first->body.links.next;
+sf_block* qkl_remove(int i) {
+    sf_block* block = sf_quick_lists[i].first;
+    sf_quick_lists[i].first = block->body.links.next;
     sf_quick_lists[i].length--;
+    return block;
 }
 
-void qkl_add(sf_block* block, int i) {
-    int len = sf_quick_lists[i].length;
-    if(len == QUICK_LIST_MAX) { 
-        for (int j = 0; i < sf_quick_lists[i].length; j++) { 
-            free_list_add(sf_quick_lists[i].first);
-            qkl_remove(i); 
-        } 
+//returns the blocks of quick list i to the main pool, coalescing each as it goes
+void qkl_flush(int i) {
+    while (sf_quick_lists[i].length > 0) {
+        sf_block* block = qkl_remove(i);
+        int pal = (block->header ^ MAGIC) & PREV_BLOCK_ALLOCATED;
+        init_free_block(block, get_block_size(block), pal);
+        free_list_add(coalesce(block));
     }
+}
+
+void qkl_add(sf_block* block, int i) {
+    if (sf_quick_lists[i].length == QUICK_LIST_MAX) { qkl_flush(i); }
     int size = get_block_size(block);
     int pal = (block->header ^ MAGIC) & PREV_BLOCK_ALLOCATED;
     init_header(block, 0, size, 1, pal, 1);
@@ -79,290 +150,280 @@ void qkl_add(sf_block* block, int i) {
     sf_quick_lists[i].length++;
 }
 
-void free_list_add(sf_block* free_block) {
-    int block_size = get_block_size(free_block);      //get the size of the block you want to add
-    int qkl = get_qkl(block_size);
-    if (qkl < QUICK_LIST_MAX) {
-        qkl_add(free_block, qkl);
-    } else {
-        int index = get_free_list(block_size);            //get the index of the free lists array to add to the correct playlist
-        sf_block* curr = free_block;                      //curr = free_block
-        sf_block* head = &sf_free_list_heads[index];      //head = head of the appropriate list
-
-        curr->body.links.next = head->body.links.next;   //curr->next = head->next
-        head->body.links.next = curr;                    //head->next = curr
-        curr->body.links.prev = head;                    //curr->prev = head
-        curr->body.links.next->body.links.prev = curr;   //next->prev = curr
-    }
-}
-
-void remove_free_block(sf_block* curr) {
-    curr->body.links.prev->body.links.next = curr->body.links.next;                      //curr->prev = curr->next
-    curr->body.links.next->body.links.prev = curr->body.links.prev;     //curr->next->prev = curr->prev
-    curr->body.links.next = curr;
-    curr->body.links.prev = curr;
-}
-
-sf_block* grow_heap() {
+//grows the heap in one step, by as many pages as it takes for the free block at its end (after coalescing
+//with whatever free block was there) to be at least size bytes, but by no fewer than SF_GROW_PAGES.
+//Returns that block, in its free list, or NULL if the heap cannot grow that far, in which case all
+//the pages it could get are left as a free block at the end of the heap
+sf_block* grow_heap(int size) {
     sf_block* free_block = sf_mem_end() - 16;                 //new freeblock starts at where epilogue was
-    if (sf_mem_grow() == NULL) {return NULL; }                //request a new page
-    else {
-        int pal = (free_block->header ^ MAGIC) & PREV_BLOCK_ALLOCATED;      //get the prev alloc bit
-        init_header(free_block, 0, PAGE_SZ, 0, pal, 0);           //initialize free block
-        sf_block* epilogue = (void*)free_block + PAGE_SZ;         //addr of new epilogue is free block + 1024
-        init_header(epilogue, 0, 0, 1, 0, 0);                     //initialize epilogue
-        epilogue->prev_footer = free_block->header;               //initiliaze footer of free block   
-        return free_block;
-    }
+    int pal = (free_block->header ^ MAGIC) & PREV_BLOCK_ALLOCATED;      //get the prev alloc bit
+    int last = pal ? 0 : (free_block->prev_footer ^ MAGIC) & 0xFFFFFFF0;    //size of a free block already at the end
+    int pages = size <= last ? 1 : (size - last + PAGE_SZ - 1) / PAGE_SZ;
+    if (pages < SF_GROW_PAGES) {pages = SF_GROW_PAGES;}
+    int got = 0;
+    while (got < pages && sf_mem_grow() != NULL) {got++;}    //request the pages
+    if (got == 0) {return NULL;}
+    heap_grows++;
+    sf_block* epilogue = (void*)free_block + got*PAGE_SZ;    //addr of new epilogue is free block + the pages
+    init_header(epilogue, 0, 0, 1, 0, 0);                     //initialize epilogue
+    init_free_block(free_block, got*PAGE_SZ, pal);            //initialize free block and its footer
+    free_block = coalesce(free_block);
+    free_list_add(free_block);
+    return get_block_size(free_block) >= size ? free_block : NULL;
 }
 
+//merges a free block that is in no list with any free neighbors, taking them off their lists
 sf_block* coalesce(sf_block* curr) {
     sf_block* next, * prev;
-    int curr_size = get_block_size(curr), prev_size, next_size;
+    int curr_size = get_block_size(curr), prev_size;
     int pal = (curr->header ^ MAGIC) & PREV_BLOCK_ALLOCATED;       //get the prev alloc bit
-    
+
     next = (void*) curr + curr_size;                     //get addr of next block
     int al = (next->header ^ MAGIC) & THIS_BLOCK_ALLOCATED;       //get the alloc bit
     if(al == 0) {
-        next_size = get_block_size(next);               //get next size
-        curr_size += next_size;                         //add next size to curr size
-        init_header(curr, 0, curr_size, 0, pal, 0);
-        sf_block* next_next = (void*)next+next_size;
-        next_next->prev_footer = curr->header;               //update footer of curr
+        curr_size += get_block_size(next);              //add next size to curr size
         remove_free_block(next);
     }
-    if (pal == 0) {  
+    if (pal == 0) {
         prev_size = (curr->prev_footer ^ MAGIC) & 0xFFFFFFF0;     //get prev block size
         prev = (void*)curr - prev_size;                  //prev = prev block addr
         pal = (prev->header ^ MAGIC) & PREV_BLOCK_ALLOCATED;      //get the prev alloc bit
-        prev_size += curr_size;                         //add curr size to prev
-        init_header(prev, 0, prev_size, 0, pal, 0);
-        sf_block* curr_next = (void*)curr + curr_size;
-        curr_next->prev_footer = prev->header;               //init prev footer
+        remove_free_block(prev);
+        curr_size += prev_size;                         //add curr size to prev
         curr = prev;                             //curr = prev
     }
+    init_free_block(curr, curr_size, pal);
     return curr;
 }
 
-sf_block* alloc(int size, int pay_size, int index) {
-    sf_block* head = &sf_free_list_heads[index];      //get the head at the index
-    sf_block* curr = head->body.links.next;           //curr = the block immediately after head       
-    while (curr != head) { 
-        int block_size = get_block_size(curr);                   //get the size of the current block
-        if (size < block_size) { curr = curr->body.links.next; } //if the block in the list has a block size < size, then check the next block
-    } 
-    if (curr == head) {
-        while (curr == head && index < NUM_FREE_LISTS) {    //while curr == head means free list is empty, keep incrementing until you find a non empty list  
-            index++;                                        //increment index      
-            head = &sf_free_list_heads[index];              //get the head at the index
-            curr = head->body.links.next;                   //curr = the block immediately after head
-        }
-        sf_block* free_block;
-        if (index == NUM_FREE_LISTS) {                      //if no free lists have a free block big enough to allocate, grow the heap and coalesce
-            int curr_size = 0;
-            while (size > curr_size) { 
-                curr = grow_heap();                         //grow the heap
-                if (curr != NULL) {
-                    free_block = coalesce(curr);            //coalesce the newly freed block and save it in curr
-                    curr_size = get_block_size(free_block); //get the size of the coalesced block
-                } else {
-                    sf_errno = ENOMEM;
-                    return NULL; 
-                }
-            }
-            curr = free_block;
-        }
-    }      
-    int free_block_size = get_block_size(curr);         //get the size of the free block
-    int pal = (curr->header ^ MAGIC) & PREV_BLOCK_ALLOCATED;      //get the prev alloc bit
-    if (size == free_block_size || free_block_size - size < 32) { 
-        init_header(curr, pay_size, size, 1, pal, 0); 
-        remove_free_block(curr);
+//makes the avail bytes at block an allocated block of size bytes, splitting off the rest if it is
+//big enough to be a block; the rest goes on a free list, not a quick list, since nobody asked for its size
+void carve(sf_block* block, int avail, int size, int pay_size, int pal) {
+    if (avail - size < 32) {                            //the rest would be a splinter: keep it
+        init_header(block, pay_size, avail, 1, pal, 0);
+        set_pal((void*)block + avail, 1);
     } else {
-        //allocate block with size less than free_block_size and > 32
-        init_header(curr, pay_size, size, 1, pal, 0);   //make the allocated block's header 
+        init_header(block, pay_size, size, 1, pal, 0);  //make the allocated block's header
         //split
-        sf_block* free_block = (void*) curr + size;     //the free block's address is the current block's address + its size
-        free_block_size -= size;                        //free block's size decreased since part of it was allocated, need to decrease it by allocated block size
-        init_header(free_block, 0, free_block_size, 0, 1, 0);
-        free_list_add(free_block);                             //add the new free block to its appropriate free list
-        sf_block* next = (void*)free_block + free_block_size;  //next = block after free block
-        next->prev_footer = free_block -> header;              //setting the footer of the free block
-        remove_free_block(curr);
+        sf_block* free_block = (void*) block + size;    //the free block's address is the current block's address + its size
+        init_free_block(free_block, avail - size, 1);
+        free_list_add(coalesce(free_block));            //add the new free block to its appropriate free list
     }
+}
+
+//allocates size bytes of the free block curr, which is on a free list
+sf_block* place(sf_block* curr, int size, int pay_size) {
+    int pal = (curr->header ^ MAGIC) & PREV_BLOCK_ALLOCATED;      //get the prev alloc bit
+    remove_free_block(curr);
+    carve(curr, get_block_size(curr), size, pay_size, pal);
     return curr;
 }
 
-void update_curr_pld() {
+//makes room for the allocated block to grow to size bytes where it is, by taking the free block
+//after it off its list and, if that is the last block, growing the heap until it is big enough.
+//Returns the bytes now at block, or 0 (having changed nothing but maybe the heap size) if it cannot
+int absorb_next(sf_block* block, int size) {
+    int block_size = get_block_size(block);
+    sf_block* next = (void*)block + block_size;
+    int avail = block_size;
+    if (!((next->header ^ MAGIC) & THIS_BLOCK_ALLOCATED)) {avail += get_block_size(next);}
+    if (avail < size && (void*)block + avail != sf_mem_end() - 16) {return 0;}    //not the last block
+    if (avail < size) {
+        if (grow_heap(size - block_size) == NULL) {return 0;}
+        avail = block_size + get_block_size(next);     //the new pages coalesced into next
+    }
+    if (avail > block_size) {remove_free_block(next);}
+    return avail;
+}
+
+//finds a free block of at least size bytes, growing the heap if there is none, and allocates it
+sf_block* alloc(int size, int pay_size) {
+    sf_block* free_block = find_fit(size);
+    if (free_block == NULL) {free_block = grow_heap(size);}    //nothing fits: grow the heap so the last block does
+    if (free_block == NULL) {
+        set_sf_errno(ENOMEM);
+        return NULL;
+    }
+    return place(free_block, size, pay_size);
+}
+
+#ifdef DEBUG
+//walks the whole heap and checks the counters against it, aborting if they disagree
+void check_counters() {
+    if (sf_mem_start() == sf_mem_end()) {return;}
     sf_block* block = sf_mem_start() + 32;
     sf_block* end = sf_mem_end() - 16;
-    curr_pld = 0;
+    double tot_pld = 0, tot_al = 0;
     while (block != end)  {
         int al = (block->header ^ MAGIC) & THIS_BLOCK_ALLOCATED;
         int qkl = (block->header ^ MAGIC) & IN_QUICK_LIST;
-        if (al && !qkl) { curr_pld += (block->header ^ MAGIC) >> 32;}
+        if (al && !qkl) {
+            tot_pld += (block->header ^ MAGIC) >> 32;
+            tot_al += get_block_size(block);
+        }
         block = (void*)block + get_block_size(block);
     }
+    if (tot_pld != curr_pld || tot_al != curr_al) {
+        error("counters out of sync: payload %.0f (heap has %.0f), allocated %.0f (heap has %.0f)",
+              curr_pld, tot_pld, curr_al, tot_al);
+        abort();
+    }
+}
+#else
+void check_counters() {}
+#endif
+
+//called on every change to an allocated block: pay_diff and size_diff are the changes
+//to its payload and block size (negative when it is freed), so the totals stay O(1)
+void update_counters(int pay_diff, int size_diff) {
+    curr_pld += pay_diff;
+    curr_al += size_diff;
+    double pld = curr_pld + cache_payload();
+    if (pld > max_pld) {max_pld = pld;}
+}
+
+//sets up the prologue, the epilogue and one free block spanning the first page
+int init_heap() {
+    if (sf_mem_grow() == NULL) {return -1;}             //req a page
+    heap_grows++;
+
+    sf_block* prologue = sf_mem_start();            //prologue = mem_start addr + 8 bytes
+    sf_block* epilogue = sf_mem_end() - 16;         //epilogue = mem_end addr - 16 bytes
+    prologue->prev_footer = 0;                      //initialize the unused 8 bytes before prologue as 0
+
+    //initialize the prologue and epilogue of the page
+    init_header(prologue, 0, 0x20, 1, 0, 0);     //initialize prologue
+    init_header(epilogue, 0, 0, 1, 0, 0);        //initialize epilogue
+
+    //initialize the first free block, payload size = 0, block size = PAGE_SZ-48, not allocated
+    sf_block* free_block = sf_mem_start() + 32;
+    init_free_block(free_block, PAGE_SZ-48, 1);     //create a free block spanning the page
+    init_free_list_heads();                         //initialize all the sentinels in the array of segregated free lists
+    init_qkl();
+    free_list_add(free_block);                      //add the free_block to the appropriate free list
+    return 0;
 }
 
-void *sf_malloc(sf_size_t size) {
+void *heap_malloc(sf_size_t size) {
     if (size == 0) {return NULL;}
-    if (sf_mem_start() == sf_mem_end()) {
-        sf_mem_grow();                                  //req a page
-
-        sf_block* prologue = sf_mem_start();            //prologue = mem_start addr + 8 bytes
-        sf_block* epilogue = sf_mem_end() - 16;         //epilogue = mem_end addr - 16 bytes
-        prologue->prev_footer = 0;                      //initialize the unused 8 bytes before prologue as 0
-
-        //initialize the prologue and epilogue of the page
-        init_header(prologue, 0, 0x20, 1, 0, 0);     //initialize prologue
-        init_header(epilogue, 0, 0, 1, 0, 0);        //initialize epilogue
-
-        //initialize the first free block, payload size = 0, block size = PAGE_SZ-48, not allocated           
-        sf_block* free_block = sf_mem_start() + 32;
-        init_header(free_block, 0, PAGE_SZ-48, 0, 1, 0);//create a free block spanning the page
-        epilogue->prev_footer = free_block->header;     //set epilogue's footer to free block's header
-        init_free_list_heads();                         //initialize all the sentinels in the array of segregated free lists
-        free_list_add(free_block);                      //add the free_block to the appropriate free list
+    if (sf_mem_start() == sf_mem_end() && init_heap() != 0) {
+        set_sf_errno(ENOMEM);
+        return NULL;
     }
 
     int pay_size = size;                                //payload size = size
-    //turn the payload size into block size
-    if (size+8 <= 32) {size = 32;}
-    else if ((size+8) % 16 != 0) {size = ((size+8) + (16-((size+8)%16)));}
-    else if ((size+8) % 16 == 0) {size += 8;}
-    else size+=8;
+    int block_size = block_size_for(size);              //turn the payload size into block size
+    if (block_size == 0) {
+        set_sf_errno(ENOMEM);
+        return NULL;
+    }
 
-    int index = get_qkl(size);
+    int index = get_qkl(block_size);
     sf_block* ptr;
-    if (index < QUICK_LIST_MAX && sf_quick_lists[index].length != 0) {
-        ptr = sf_quick_lists[index].first; 
+    if (index < NUM_QUICK_LISTS && sf_quick_lists[index].length != 0) {
+        ptr = qkl_remove(index);
         int pal =  (ptr->header ^ MAGIC) & PREV_BLOCK_ALLOCATED;
-        init_header(ptr, pay_size, size, 1, pal, 0);
-        qkl_remove(index);
+        init_header(ptr, pay_size, block_size, 1, pal, 0);
     } else {
-        index = get_free_list(size);                    //get the index of the appropriate free list
-        ptr = alloc(size, pay_size, index);       //call alloc with block size, payload size and the ind
+        ptr = alloc(block_size, pay_size);              //call alloc with block size and payload size
     }
 
-    update_curr_pld();
-    if (curr_pld > max_pld) {max_pld = curr_pld;}
-
     if (ptr == NULL) { return NULL; }
-    else return ptr->body.payload;
+    update_counters(pay_size, get_block_size(ptr));
+    check_counters();
+    return ptr->body.payload;
 }
 
 int is_valid(void *pp) {
+    if (pp == NULL) {return 0;}
+    if ((uintptr_t)pp % 16 != 0) {return 0;}
+    if (pp < sf_mem_start() + 48 || pp > sf_mem_end() - 32) {return 0;}
     sf_block* block = pp-16;
     int block_size = get_block_size(block);
     int al = (block->header ^ MAGIC) & THIS_BLOCK_ALLOCATED;
     int pal =  (block->header ^ MAGIC) & PREV_BLOCK_ALLOCATED;
-    int al_prev =  (block->prev_footer ^ MAGIC) & THIS_BLOCK_ALLOCATED;
-
-    if (pp == NULL) {return 0;}
-    if ((uintptr_t)pp % 16 != 0) {return 0;}
+    int qkl = (block->header ^ MAGIC) & IN_QUICK_LIST;
     if (block_size < 32) {return 0;}
     if (block_size % 16 != 0) {return 0;}
-    if (al == 0) {return 0;}
-    if (pal == 0) { if (al_prev == 1) {return 0;} }
+    if ((void*)block + block_size > sf_mem_end() - 16) {return 0;}
+    if (al == 0 || qkl != 0) {return 0;}
+    if (pal == 0 && ((block->prev_footer ^ MAGIC) & THIS_BLOCK_ALLOCATED) != 0) {return 0;}   //only a free block has a footer
     return 1;
 }
 
-void sf_free(void *pp) {
+void heap_free(void *pp) {
     int val = is_valid(pp);
     if (val == 0) {abort();}
     sf_block* block = pp-16;
     int block_size = get_block_size(block);
     int pal =  (block->header ^ MAGIC) & PREV_BLOCK_ALLOCATED;
-    init_header(block, 0, block_size, 0, pal, 0);
-    sf_block* next = (void*) block + block_size;
-    next->prev_footer = block->header;
-    block = coalesce(block);
-    get_block_size(block);
-    next = (void*) block + block_size;
-    next->prev_footer = block->header;
-    free_list_add(block);
-    update_curr_pld();
-    if (curr_pld > max_pld) {max_pld = curr_pld;}
+    update_counters(-(int)((block->header ^ MAGIC) >> 32), -block_size);
+    int index = get_qkl(block_size);
+    if (index < NUM_QUICK_LISTS) {
+        qkl_add(block, index);                          //small blocks wait on a quick list, uncoalesced
+    } else {
+        init_free_block(block, block_size, pal);
+        free_list_add(coalesce(block));
+    }
+    check_counters();
 }
 
-void *sf_realloc(void *pp, sf_size_t rsize) {
-    int val = is_valid(pp);
-    if (val == 0) {abort();}
+void *heap_realloc(void *pp, sf_size_t rsize) {
+    if (is_valid(pp) == 0) {
+        set_sf_errno(EINVAL);
+        return NULL;
+    }
+    if (rsize == 0) {
+        heap_free(pp);
+        return NULL;
+    }
     sf_block* block = pp-16;
     int block_size = get_block_size(block);
     int pal =  (block->header ^ MAGIC) & PREV_BLOCK_ALLOCATED;
-    if (rsize == 0) {
-        sf_free(block);
-        sf_errno = EINVAL;
-        update_curr_pld();
-        if (curr_pld > max_pld) {max_pld = curr_pld;}
+    int old_pay = (block->header ^ MAGIC) >> 32;
+    int size = block_size_for(rsize);
+    if (size == 0) {
+        set_sf_errno(ENOMEM);
         return NULL;
     }
 
-    sf_block* new_block;
-    if (block_size < rsize) {
-        new_block = (void*) sf_malloc(rsize) - 16;
-        memcpy((void*)new_block+16, pp, rsize);
-        sf_free((void*)block + 16);
-    }
-    if (block_size > rsize) {
-        if (block_size - rsize <= 32) { 
-            init_header(block, rsize, block_size, 1, pal, 0); 
-            update_curr_pld();
-            if (curr_pld > max_pld) {max_pld = curr_pld;}
-            return block->body.payload;
-        }
-        else {
-            int size = rsize;
-            if (size+8 <= 32) {size = 32;}
-            else if ((size+8) % 16 != 0) {size = ((size+8) + (16-((size+8)%16)));}
-            else if ((size+8) % 16 == 0) {size += 8;}
-            else size+=8;
-            debug("%d", size);
-            debug("%d", rsize);
-            init_header(block, rsize, size, 1, pal, 0);    //make the allocated block's header 
-            //split
-            sf_block* free_block = (void*)block + size;     //the free block's address is the current block's address + its size
-            block_size -= size;          //free block's size decreased since part of it was allocated, need to decrease it by allocated block size
-            init_header(free_block, 0, block_size, 0, 1, 0);
-            coalesce(free_block);                             //add the new free block to its appropriate free list
-            free_list_add(free_block);
-            update_curr_pld();
-            if (curr_pld > max_pld) {max_pld = curr_pld;}
-            return block->body.payload;
-        }
+    int avail = block_size;
+    if (size > block_size && (avail = absorb_next(block, size)) == 0) {
+        void *new_pp = heap_malloc(rsize);
+        if (new_pp == NULL) {return NULL;}
+        memcpy(new_pp, pp, old_pay);                    //the new payload is larger than the old one
+        heap_free(pp);
+        return new_pp;
     }
-    update_curr_pld();
-    if (curr_pld > max_pld) {max_pld = curr_pld;}
-    return new_block;
+
+    carve(block, avail, size, rsize, pal);             //grow or shrink in place
+    update_counters(rsize - old_pay, get_block_size(block) - block_size);
+    check_counters();
+    return block->body.payload;
 }
 
+#ifndef SF_THREADS
+void *sf_malloc(sf_size_t size) { return heap_malloc(size); }
+void sf_free(void *pp) { heap_free(pp); }
+void *sf_realloc(void *pp, sf_size_t rsize) { return heap_realloc(pp, rsize); }
+#endif
+
 double sf_internal_fragmentation() {
-    double infr = 0.0;
-    if (sf_mem_start == sf_mem_end) {return infr;}
-    sf_block* block = sf_mem_start() + 32;
-    sf_block* end = sf_mem_end() - 16;
-    double tot_pld = 0, tot_al = 0;
-    while (block != end)  {
-        int al = (block->header ^ MAGIC) & THIS_BLOCK_ALLOCATED;
-        int qkl = (block->header ^ MAGIC) & IN_QUICK_LIST;
-        if (al &&! qkl) {
-            tot_pld += (block->header ^ MAGIC) >> 32;
-            tot_al += get_block_size(block);
-        }
-        block = (void*)block + get_block_size(block);
-    }
-    if(tot_al == 0) {return 0;}
-    infr = tot_pld/tot_al;
+    heap_lock();
+    double al = curr_al + cache_size();
+    double infr = al == 0 ? 0.0 : (curr_pld + cache_payload())/al;    //no allocated blocks (or no heap yet) gives 0
+    heap_unlock();
     return infr;
 }
 
 double sf_peak_utilization() {
     double pkut = 0.0;
-    if (sf_mem_start == sf_mem_end) {return pkut;}
-    double heap_size = sf_mem_end() - sf_mem_start();
-    if (max_pld == 0) {return pkut;}
-    pkut = max_pld/heap_size;
+    heap_lock();
+    update_counters(0, 0);      //takes in what the caches have handed out since the heap was last used
+    if (sf_mem_start() != sf_mem_end()) {
+        double heap_size = sf_mem_end() - sf_mem_start();
+        pkut = max_pld/heap_size;
+    }
+    heap_unlock();
     return pkut;
 }
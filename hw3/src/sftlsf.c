@@ -0,0 +1,90 @@
+/*
+ * A two-level segregated fit (TLSF) index of the free blocks, built instead of the
+ * segregated lists in sfmm.c when compiled with SF_TLSF.
+ *
+ * The first level splits sizes by their highest set bit, and the second splits each of
+ * those ranges into SL_COUNT equal parts, each with its own list.  A bit in fl_bitmap says
+ * that some list of that first level is non-empty, and a bit in sl_bitmap[fl] which one, so
+ * finding, adding and removing a block are a few bit operations and never walk a list.
+ *
+ * find_fit rounds the request up to the next class boundary, so any block in the class it
+ * picks is big enough.  In exchange it can pass over a block in the request's own class that
+ * would just have fit, growing the heap instead (good fit, rather than best fit).  The
+ * free lists in sf_free_list_heads are kept empty, so sf_show_free_lists shows nothing.
+ */
+#ifdef SF_TLSF
+
+#include "sfmm.h"
+#include "sfheap.h"
+
+static unsigned int fl_bitmap;                  //bit fl set if any list of first level fl is non-empty
+static unsigned int sl_bitmap[FL_COUNT];        //bit sl set if list [fl][sl] is non-empty
+sf_block tlsf_heads[FL_COUNT][SL_COUNT];        //sentinels, linked like sf_free_list_heads
+
+//the class of size bytes: fl is the index of its highest bit and sl the SL_LOG bits below it
+void tlsf_mapping(unsigned int size, int* fl, int* sl) {
+    *fl = 31 - __builtin_clz(size);
+    *sl = (size >> (*fl - SL_LOG)) & (SL_COUNT-1);
+}
+
+void init_free_list_heads() {
+    for (int i = 0; i < NUM_FREE_LISTS; i++) {     //left empty, but sf_show_free_lists still walks them
+        sf_free_list_heads[i].body.links.next = &sf_free_list_heads[i];
+        sf_free_list_heads[i].body.links.prev = &sf_free_list_heads[i];
+    }
+    fl_bitmap = 0;
+    for (int fl = 0; fl < FL_COUNT; fl++) {
+        sl_bitmap[fl] = 0;
+        for (int sl = 0; sl < SL_COUNT; sl++) {
+            sf_block* head = &tlsf_heads[fl][sl];
+            head->body.links.next = head;
+            head->body.links.prev = head;
+        }
+    }
+}
+
+void free_list_add(sf_block* free_block) {
+    int fl, sl;
+    tlsf_mapping(get_block_size(free_block), &fl, &sl);
+    sf_block* head = &tlsf_heads[fl][sl];
+
+    free_block->body.links.next = head->body.links.next;
+    head->body.links.next = free_block;
+    free_block->body.links.prev = head;
+    free_block->body.links.next->body.links.prev = free_block;
+    fl_bitmap |= 1u << fl;
+    sl_bitmap[fl] |= 1u << sl;
+}
+
+void remove_free_block(sf_block* curr) {
+    int fl, sl;
+    tlsf_mapping(get_block_size(curr), &fl, &sl);
+    sf_block* head = &tlsf_heads[fl][sl];
+
+    curr->body.links.prev->body.links.next = curr->body.links.next;
+    curr->body.links.next->body.links.prev = curr->body.links.prev;
+    curr->body.links.next = curr;
+    curr->body.links.prev = curr;
+    if (head->body.links.next == head) {        //the list is now empty
+        sl_bitmap[fl] &= ~(1u << sl);
+        if (sl_bitmap[fl] == 0) {fl_bitmap &= ~(1u << fl);}
+    }
+}
+
+sf_block* find_fit(int size) {
+    int fl, sl;
+    unsigned int round = size + (1u << (31 - __builtin_clz(size) - SL_LOG)) - 1;   //up to the next class
+    tlsf_mapping(round, &fl, &sl);
+
+    unsigned int sl_map = sl_bitmap[fl] & (~0u << sl);     //this first level, this class or larger
+    if (sl_map == 0) {
+        unsigned int fl_map = fl == FL_COUNT-1 ? 0 : fl_bitmap & (~0u << (fl+1));
+        if (fl_map == 0) {return NULL;}
+        fl = __builtin_ctz(fl_map);                         //the smallest larger first level
+        sl_map = sl_bitmap[fl];
+    }
+    sl = __builtin_ctz(sl_map);
+    return tlsf_heads[fl][sl].body.links.next;
+}
+
+#endif
@@ -3,17 +3,26 @@
 #include <signal.h>
 #include "debug.h"
 #include "sfmm.h"
+#include "sfheap.h"
 #define TEST_TIMEOUT 15
 
 /*
  * Assert the total number of free blocks of a specified size.
  * If size == 0, then assert the total number of all free blocks.
+ * With SF_TLSF the free blocks are in the lists of the TLSF index instead.
  */
 void assert_free_block_count(size_t size, int count) {
+#ifdef SF_TLSF
+    sf_block *heads = &tlsf_heads[0][0];
+    int num_lists = FL_COUNT * SL_COUNT;
+#else
+    sf_block *heads = sf_free_list_heads;
+    int num_lists = NUM_FREE_LISTS;
+#endif
     int cnt = 0;
-    for(int i = 0; i < NUM_FREE_LISTS; i++) {
-	sf_block *bp = sf_free_list_heads[i].body.links.next;
-	while(bp != &sf_free_list_heads[i]) {
+    for(int i = 0; i < num_lists; i++) {
+	sf_block *bp = heads[i].body.links.next;
+	while(bp != &heads[i]) {
 	    if(size == 0 || size == ((bp->header ^ MAGIC) & 0xfffffff0))
 		cnt++;
 	    bp = bp->body.links.next;
@@ -174,8 +183,14 @@ Test(sfmm_basecode_suite, freelist, .timeout = TEST_TIMEOUT) {
 	assert_free_block_count(928, 1);
 
 	// First block in list should be the most recently freed block not in quick list.
+#ifdef SF_TLSF
+	int i, sl;
+	tlsf_mapping(208, &i, &sl);
+	sf_block *bp = tlsf_heads[i][sl].body.links.next;
+#else
 	int i = 3;
 	sf_block *bp = sf_free_list_heads[i].body.links.next;
+#endif
 	cr_assert_eq(&bp->header, (char *)y - 8,
 		     "Wrong first block in free list %d: (found=%p, exp=%p)",
                      i, &bp->header, (char *)y - 8);
@@ -373,3 +388,158 @@ Test(sfmm_basecode_suite, student_test_malloc_5, .timeout = TEST_TIMEOUT) {
 	cr_assert(sf_errno == 0, "sf_errno is not zero!");
 	cr_assert(sf_mem_start() + PAGE_SZ == sf_mem_end(), "Allocated more than necessary!");
 }
+
+Test(sfmm_basecode_suite, student_test_first_fit_skips_small, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	void *a = sf_malloc(376);
+	/* void *b = */ sf_malloc(50);
+	void *c = sf_malloc(472);
+	/* void *d = */ sf_malloc(32);
+
+	// Both go in the list for (256, 512], the 384-byte block first.
+	sf_free(c);
+	sf_free(a);
+	void *x = sf_malloc(440);
+
+	cr_assert(x == c, "First fit did not skip the block that was too small!");
+	assert_free_block_count(0, 2);
+	assert_free_block_count(384, 1);
+	assert_free_block_count(32, 1);
+	cr_assert(sf_errno == 0, "sf_errno is not zero!");
+}
+
+Test(sfmm_basecode_suite, student_test_coalesce_both_sides, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	void *x = sf_malloc(200);
+	void *y = sf_malloc(200);
+	void *z = sf_malloc(200);
+	/* void *w = */ sf_malloc(200);
+
+	sf_free(x);
+	sf_free(z);
+	sf_block *bp = (sf_block *)((char *)y - 16);
+	cr_assert(!((bp->header ^ MAGIC) & PREV_BLOCK_ALLOCATED), "Prev alloc bit of y is still set!");
+	sf_free(y);
+
+	assert_free_block_count(0, 2);
+	assert_free_block_count(624, 1);
+	cr_assert(sf_errno == 0, "sf_errno is not zero!");
+}
+
+Test(sfmm_basecode_suite, student_test_quick_list_flush, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	void *x[QUICK_LIST_MAX + 1];
+	for (int i = 0; i <= QUICK_LIST_MAX; i++)
+		x[i] = sf_malloc(8);
+	/* void *w = */ sf_malloc(200);
+
+	for (int i = 0; i < QUICK_LIST_MAX; i++)
+		sf_free(x[i]);
+	assert_quick_list_block_count(32, QUICK_LIST_MAX);
+
+	// The full list is flushed and its blocks coalesced before x[5] goes in.
+	sf_free(x[QUICK_LIST_MAX]);
+	assert_quick_list_block_count(0, 1);
+	assert_free_block_count(0, 2);
+	assert_free_block_count(32 * QUICK_LIST_MAX, 1);
+	cr_assert(sf_errno == 0, "sf_errno is not zero!");
+}
+
+Test(sfmm_basecode_suite, student_test_realloc_edge_cases, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	char *x = sf_malloc(20);
+	for (int i = 0; i < 20; i++) x[i] = i;
+	/* void *y = */ sf_malloc(8);
+
+	char *z = sf_realloc(x, 300);
+	cr_assert_not_null(z, "z is NULL!");
+	cr_assert((uintptr_t)z % 16 == 0, "Realloc did not return a payload address!");
+	for (int i = 0; i < 20; i++)
+		cr_assert(z[i] == (char)i, "Payload not preserved at byte %d!", i);
+
+	cr_assert_null(sf_realloc(z + 8, 10), "Realloc of a bad pointer did not fail!");
+	cr_assert(sf_errno == EINVAL, "sf_errno is not EINVAL!");
+
+	sf_errno = 0;
+	cr_assert_null(sf_realloc(z, 0), "Realloc to 0 bytes did not return NULL!");
+	cr_assert(sf_errno == 0, "sf_errno is not zero!");
+	assert_free_block_count(0, 1);
+}
+
+Test(sfmm_basecode_suite, student_test_utilization, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	cr_assert(sf_internal_fragmentation() == 0.0, "Fragmentation of an empty heap is not zero!");
+	cr_assert(sf_peak_utilization() == 0.0, "Utilization of an empty heap is not zero!");
+
+	/* void *x = */ sf_malloc(8);
+	void *y = sf_malloc(200);
+	cr_assert(sf_internal_fragmentation() == 208.0 / 240.0,
+		  "Fragmentation (%f) not what was expected (%f)!",
+		  sf_internal_fragmentation(), 208.0 / 240.0);
+
+	sf_free(y);
+	cr_assert(sf_internal_fragmentation() == 8.0 / 32.0,
+		  "Fragmentation (%f) not what was expected (%f)!",
+		  sf_internal_fragmentation(), 8.0 / 32.0);
+	cr_assert(sf_peak_utilization() == 208.0 / PAGE_SZ,
+		  "Peak utilization (%f) not what was expected (%f)!",
+		  sf_peak_utilization(), 208.0 / PAGE_SZ);
+	cr_assert(sf_errno == 0, "sf_errno is not zero!");
+}
+
+Test(sfmm_basecode_suite, student_test_realloc_in_place, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	size_t sz_x = 100, sz_x1 = 500, sz_x2 = 3000;
+	char *x = sf_malloc(sz_x);
+	for (int i = 0; i < sz_x; i++) x[i] = i;
+
+	// The free block after x is big enough: x grows into it.
+	char *y = sf_realloc(x, sz_x1);
+	cr_assert(y == x, "Payload addresses are different!");
+	sf_block *bp = (sf_block *)(x - 16);
+	cr_assert(((bp->header ^ MAGIC) & 0xfffffff0) == 512,
+		  "Realloc'ed block size (%ld) not what was expected (%ld)!",
+		  (bp->header ^ MAGIC) & 0xfffffff0, 512);
+	assert_free_block_count(0, 1);
+	assert_free_block_count(464, 1);
+
+	// x is the last block: the heap grows under it, and the 16 bytes left over stay with it.
+	y = sf_realloc(x, sz_x2);
+	cr_assert(y == x, "Payload addresses are different!");
+	cr_assert(((bp->header ^ MAGIC) & 0xfffffff0) == 3024,
+		  "Realloc'ed block size (%ld) not what was expected (%ld)!",
+		  (bp->header ^ MAGIC) & 0xfffffff0, 3024);
+	cr_assert((((bp->header ^ MAGIC) >> 32) & 0xffffffff) == sz_x2,
+		  "Realloc'ed block payload size (%ld) not what was expected (%ld)!",
+		  (((bp->header ^ MAGIC) >> 32) & 0xffffffff), sz_x2);
+	assert_free_block_count(0, 0);
+	cr_assert(sf_mem_start() + 3 * PAGE_SZ == sf_mem_end(), "Heap grew more than necessary!");
+	for (int i = 0; i < sz_x; i++)
+		cr_assert(x[i] == (char)i, "Payload not preserved at byte %d!", i);
+
+	// Shrinking gives the tail back as one free block.
+	y = sf_realloc(x, sz_x);
+	cr_assert(y == x, "Payload addresses are different!");
+	assert_free_block_count(0, 1);
+	assert_free_block_count(2912, 1);
+	cr_assert(sf_errno == 0, "sf_errno is not zero!");
+}
+
+Test(sfmm_basecode_suite, student_test_grow_once, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	void *x = sf_malloc(16000);
+
+	// The first page, then the other 15 all at once.
+	cr_assert_not_null(x, "x is NULL!");
+	cr_assert(heap_grows == 2, "Heap grew %d times, not %d!", heap_grows, 2);
+	cr_assert(sf_mem_start() + 16 * PAGE_SZ == sf_mem_end(), "Allocated more than necessary!");
+	assert_free_block_count(0, 1);
+	assert_free_block_count(320, 1);
+
+	// Too large: the heap takes every page it can get in one more step and keeps them free.
+	cr_assert_null(sf_malloc(98304), "Too large a block was allocated!");
+	cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM!");
+	cr_assert(heap_grows == 3, "Heap grew %d times, not %d!", heap_grows, 3);
+	assert_free_block_count(0, 1);
+	assert_free_block_count(8512, 1);
+}
@@ -0,0 +1,60 @@
+#ifdef SF_THREADS
+
+#include <criterion/criterion.h>
+#include <errno.h>
+#include <pthread.h>
+#include "sfmm.h"
+#define TEST_TIMEOUT 15
+
+/*
+ * Only sfmm.h is included, as by a client that knows nothing of the threads, so sf_errno
+ * here is the global that sfmm.h declares, not the calling thread's own.
+ */
+
+static void *malloc_too_much(void *arg) {
+	return sf_malloc(1u << 30);
+}
+
+static void *realloc_freed(void *arg) {
+	return sf_realloc(arg, 100);
+}
+
+Test(sfthreads_suite, errno_enomem, .timeout = TEST_TIMEOUT) {
+	void *p;
+	pthread_t t;
+
+	sf_errno = 0;
+	cr_assert_null(sf_malloc(1u << 30), "Malloc of 1 GB did not fail!");
+	cr_assert(sf_errno == ENOMEM, "sf_errno is %d, not ENOMEM!", sf_errno);
+
+	// The same from a thread of its own.
+	sf_errno = 0;
+	pthread_create(&t, NULL, malloc_too_much, NULL);
+	pthread_join(t, &p);
+	cr_assert_null(p, "Malloc of 1 GB in a thread did not fail!");
+	cr_assert(sf_errno == ENOMEM, "sf_errno is %d after a thread's failure, not ENOMEM!", sf_errno);
+}
+
+Test(sfthreads_suite, errno_einval, .timeout = TEST_TIMEOUT) {
+	void *p;
+	pthread_t t;
+
+	// A bad pointer into a block of the central heap.
+	sf_errno = 0;
+	char *x = sf_malloc(1000);
+	cr_assert_not_null(x, "x is NULL!");
+	cr_assert_null(sf_realloc(x + 8, 10), "Realloc of a bad pointer did not fail!");
+	cr_assert(sf_errno == EINVAL, "sf_errno is %d, not EINVAL!", sf_errno);
+
+	// A block of a thread's cache that has already been freed, from another thread.
+	sf_errno = 0;
+	char *y = sf_malloc(40);
+	cr_assert_not_null(y, "y is NULL!");
+	sf_free(y);
+	pthread_create(&t, NULL, realloc_freed, y);
+	pthread_join(t, &p);
+	cr_assert_null(p, "Realloc of a freed block in a thread did not fail!");
+	cr_assert(sf_errno == EINVAL, "sf_errno is %d after a thread's failure, not EINVAL!", sf_errno);
+}
+
+#endif
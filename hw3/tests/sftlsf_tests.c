@@ -0,0 +1,115 @@
+#ifdef SF_TLSF
+
+#include <criterion/criterion.h>
+#include "sfmm.h"
+#include "sfheap.h"
+#define TEST_TIMEOUT 15
+
+/*
+ * Blocks for the tests that use the TLSF index alone, without a heap: the index only ever
+ * looks at a block's header and links.
+ */
+static sf_block blocks[4];
+
+sf_block *add_block(int i, int size) {
+    blocks[i].header = size ^ MAGIC;
+    free_list_add(&blocks[i]);
+    return &blocks[i];
+}
+
+Test(sftlsf_suite, mapping, .timeout = TEST_TIMEOUT) {
+	int fl, sl;
+	int exp[][3] = {{32, 5, 0}, {48, 5, 4}, {208, 7, 5}, {944, 9, 6}, {1023, 9, 7}, {1024, 10, 0}};
+	for (int i = 0; i < sizeof(exp) / sizeof(exp[0]); i++) {
+		tlsf_mapping(exp[i][0], &fl, &sl);
+		cr_assert(fl == exp[i][1] && sl == exp[i][2], "Size %d maps to (%d, %d), not (%d, %d)!",
+			  exp[i][0], fl, sl, exp[i][1], exp[i][2]);
+	}
+
+	// Every block size falls in the range of its class.
+	for (int size = 32; size <= (1 << 20); size += 16) {
+		tlsf_mapping(size, &fl, &sl);
+		int low = (1 << fl) + (sl << (fl - SL_LOG)), width = 1 << (fl - SL_LOG);
+		cr_assert(low <= size && size < low + width, "Size %d is not in class (%d, %d)!", size, fl, sl);
+	}
+}
+
+Test(sftlsf_suite, find_fit_rounds_up, .timeout = TEST_TIMEOUT) {
+	init_free_list_heads();
+	sf_block *bp = add_block(0, 464);         // Class [448, 480).
+
+	// A request at the bottom of the class takes any block in it.
+	cr_assert(find_fit(448) == bp, "Block of the class was not found for its smallest size!");
+
+	// Any other request is rounded up past the class, even though the block would fit.
+	cr_assert_null(find_fit(464), "Block of the request's own class was found!");
+	sf_block *bp1 = add_block(1, 480);        // Class [480, 512).
+	cr_assert(find_fit(464) == bp1, "Block of the next class was not found!");
+	cr_assert(find_fit(480) == bp1, "Block of the request's class was not found!");
+}
+
+Test(sftlsf_suite, find_fit_larger_classes, .timeout = TEST_TIMEOUT) {
+	init_free_list_heads();
+	add_block(0, 256);
+	sf_block *bp1 = add_block(1, 2048);
+	add_block(2, 8192);
+
+	// Nothing large enough in the first level of 600: the search goes to the smallest larger
+	// non-empty level.
+	cr_assert(find_fit(600) == bp1, "Block of the next larger first level was not found!");
+
+	// A larger class of the same first level comes before any larger first level.
+	sf_block *bp2 = add_block(3, 768);
+	cr_assert(find_fit(600) == bp2, "Block of a larger second level was not found!");
+
+	cr_assert_null(find_fit(16384), "A block too small was found!");
+	cr_assert(find_fit(32) != NULL, "No block found for the smallest size!");
+}
+
+Test(sftlsf_suite, remove_clears_bitmaps, .timeout = TEST_TIMEOUT) {
+	init_free_list_heads();
+	sf_block *bp = add_block(0, 768);
+	sf_block *bp1 = add_block(1, 784);        // The same class as bp.
+	sf_block *bp2 = add_block(2, 2048);
+
+	remove_free_block(bp1);
+	cr_assert(find_fit(768) == bp, "The other block of the class was not found!");
+
+	// With its class empty, the search must skip it rather than return the list's sentinel.
+	remove_free_block(bp);
+	cr_assert(find_fit(768) == bp2, "The emptied class was not skipped!");
+	remove_free_block(bp2);
+	cr_assert_null(find_fit(32), "A block was found in an empty index!");
+}
+
+Test(sftlsf_suite, split_and_coalesce, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	int fl, sl;
+	void *x = sf_malloc(200);
+	void *y = sf_malloc(200);
+	/* void *z = */ sf_malloc(200);
+
+	// What was left of the first page after each split is in the list of its own class.
+	tlsf_mapping(352, &fl, &sl);
+	sf_block *bp = tlsf_heads[fl][sl].body.links.next;
+	cr_assert(bp != &tlsf_heads[fl][sl] && ((bp->header ^ MAGIC) & 0xfffffff0) == 352,
+		  "The remainder of the split is not in its class!");
+
+	// x and y coalesce, and the block moves to the list of its new size.
+	sf_free(x);
+	sf_free(y);
+	tlsf_mapping(416, &fl, &sl);
+	bp = tlsf_heads[fl][sl].body.links.next;
+	cr_assert(bp == (sf_block *)((char *)x - 16), "The coalesced block is not in its class!");
+	cr_assert(((bp->header ^ MAGIC) & 0xfffffff0) == 416, "The coalesced block is %ld bytes, not %d!",
+		  (bp->header ^ MAGIC) & 0xfffffff0, 416);
+	cr_assert(bp->body.links.next == &tlsf_heads[fl][sl], "The class holds more than the coalesced block!");
+
+	// A request of the coalesced block's size takes it rather than grow the heap.
+	void *w = sf_malloc(400);
+	cr_assert(w == x, "The coalesced block was not reused!");
+	cr_assert(sf_mem_start() + PAGE_SZ == sf_mem_end(), "Allocated more than necessary!");
+	cr_assert(sf_errno == 0, "sf_errno is not zero!");
+}
+
+#endif